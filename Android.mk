@@ -196,6 +196,60 @@ LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
 
 
+# plugin: resample
+include $(CLEAR_VARS)
+
+LOCAL_PRELINK_MODULE := false
+
+LOCAL_SRC_FILES := plugins/resample.c
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/src/
+
+LOCAL_SHARED_LIBRARIES := libdl \
+                        libts
+
+LOCAL_MODULE := ts/plugins/resample
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_SHARED_LIBRARY)
+
+
+# plugin: predict
+include $(CLEAR_VARS)
+
+LOCAL_PRELINK_MODULE := false
+
+LOCAL_SRC_FILES := plugins/predict.c
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/src/
+
+LOCAL_SHARED_LIBRARIES := libdl \
+                        libts
+
+LOCAL_MODULE := ts/plugins/predict
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_SHARED_LIBRARY)
+
+
+# plugin: oneeuro
+include $(CLEAR_VARS)
+
+LOCAL_PRELINK_MODULE := false
+
+LOCAL_SRC_FILES := plugins/oneeuro.c
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/src/
+
+LOCAL_SHARED_LIBRARIES := libdl \
+                        libts
+
+LOCAL_MODULE := ts/plugins/oneeuro
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_SHARED_LIBRARY)
+
+
 # plugin: evthres
 include $(CLEAR_VARS)
 
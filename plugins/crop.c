@@ -9,7 +9,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
-#include <sys/stat.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -18,8 +17,8 @@
 
 struct tslib_crop {
 	struct tslib_module_info module;
-	int32_t *last_tid;
-	uint32_t last_pressure;
+	struct ts_clip clip;
+	struct ts_transform t;
 	int	a[7];
 	/* fb res from calibration-time */
 	int32_t cal_res_x;
@@ -27,125 +26,57 @@ struct tslib_crop {
 	uint32_t rot;
 };
 
-static int crop_read(struct tslib_module_info *info, struct ts_sample *samp,
-		     int nr)
+static int crop_process(struct tslib_module_info *info,
+			struct ts_sample *samp, int nr,
+			__attribute__ ((unused)) int max)
 {
 	struct tslib_crop *crop = (struct tslib_crop *)info;
-	int ret;
-	int nread = 0;
-
-	while (nread < nr) {
-		struct ts_sample cur;
-
-		ret = info->next->ops->read(info->next, &cur, 1);
-		if (ret < 0)
-			return ret;
-
-		if (cur.x >= crop->cal_res_x ||
-		    cur.x < 0 ||
-		    cur.y >= crop->cal_res_y ||
-		    cur.y < 0) {
-			if (cur.pressure == 0) {
-				if (crop->last_pressure == 0)
-					continue;
-			} else {
-				continue;
-			}
-		}
-
-		samp[nread++] = cur;
-		crop->last_pressure = cur.pressure;
-	}
 
-	return nread;
+	return ts_transform_process(&crop->t, samp, nr);
 }
 
-static int crop_read_mt(struct tslib_module_info *info,
-		       struct ts_sample_mt **samp, int max_slots, int nr)
+static int crop_process_mt(struct tslib_module_info *info,
+			   struct ts_sample_mt **samp, int max_slots, int nr,
+			   __attribute__ ((unused)) int max)
 {
 	struct tslib_crop *crop = (struct tslib_crop *)info;
-	int32_t ret;
-	int32_t i, j;
-
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr);
-	if (ret < 0)
-		return ret;
-
-	if (!crop->last_tid) {
-		free(crop->last_tid);
 
-		crop->last_tid = calloc(max_slots, sizeof(int32_t));
-		if (!crop->last_tid)
-			return -ENOMEM;
-
-		/* init with -1 because out-of-range would not get
-		 * dropped for first touch, see below. */
-		for (j = 0; j < max_slots; j++)
-			crop->last_tid[j] = -1;
-	}
+	/* assume the input device uses 0..(fb-1) value. */
+	return ts_transform_process_mt(&crop->t, samp, max_slots, nr);
+}
 
-	for (i = 0; i < ret; i++) {
-		for (j = 0; j < max_slots; j++) {
-			if (!(samp[i][j].valid & TSLIB_MT_VALID))
-				continue;
-
-			/* assume the input device uses 0..(fb-1) value. */
-
-			if (samp[i][j].x >= crop->cal_res_x ||
-			    samp[i][j].x < 0 ||
-			    samp[i][j].y >= crop->cal_res_y ||
-			    samp[i][j].y < 0) {
-				if (samp[i][j].tracking_id == -1) {
-					/*
-					 * don't drop except last seen tid also -1
-					 * otherwise, tid would get filtered
-					 * out and new x/y would reach the app
-					 */
-					if (crop->last_tid[j] == -1) {
-						samp[i][j].valid &= ~TSLIB_MT_VALID;
-					}
-				} else {
-					/* drop */
-					samp[i][j].valid &= ~TSLIB_MT_VALID;
-				}
-			}
-
-			/* save the last not-dropped tid value */
-			if (samp[i][j].valid & TSLIB_MT_VALID)
-				crop->last_tid[j] = samp[i][j].tracking_id;
-		}
-	}
+static const struct ts_transform *crop_transform(struct tslib_module_info *info)
+{
+	struct tslib_crop *crop = (struct tslib_crop *)info;
 
-	return ret;
+	return &crop->t;
 }
 
 static int crop_fini(struct tslib_module_info *info)
 {
 	struct tslib_crop *crop = (struct tslib_crop *)info;
 
-	free(crop->last_tid);
+	free(crop->clip.last_tid);
 	free(info);
 
 	return 0;
 }
 
 static const struct tslib_ops crop_ops = {
-	.read		= crop_read,
-	.read_mt	= crop_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= crop_process,
+	.process_mt	= crop_process_mt,
+	.transform	= crop_transform,
 	.fini		= crop_fini,
 };
 
-TSAPI struct tslib_module_info *crop_mod_init(__attribute__ ((unused)) struct tsdev *dev,
+TSAPI struct tslib_module_info *crop_mod_init(struct tsdev *dev,
 					      __attribute__ ((unused)) const char *params)
 {
 	struct tslib_crop *crop;
-	struct stat sbuf;
-	FILE *pcal_fd;
+	const struct tslib_pointercal *pcal;
 	int index;
-	char *calfile;
 
 	crop = malloc(sizeof(struct tslib_crop));
 	if (crop == NULL)
@@ -154,38 +85,42 @@ TSAPI struct tslib_module_info *crop_mod_init(__attribute__ ((unused)) struct ts
 	memset(crop, 0, sizeof(struct tslib_crop));
 	crop->module.ops = &crop_ops;
 
-	crop->last_tid = NULL;
-
 	/*
 	 * Get resolution from calibration file
 	 */
-	if ((calfile = getenv("TSLIB_CALIBFILE")) == NULL)
-		calfile = TS_POINTERCAL;
-
-	if (stat(calfile, &sbuf) == 0) {
-		pcal_fd = fopen(calfile, "r");
-		if (!pcal_fd) {
-			free(crop);
-			perror("fopen");
-			return NULL;
-		}
+	if (tslib_get_pointercal(dev, &pcal)) {
+		free(crop);
+		perror("fopen");
+		return NULL;
+	}
 
-		for (index = 0; index < 7; index++)
-			if (fscanf(pcal_fd, "%d", &crop->a[index]) != 1)
-				break;
+	if (pcal) {
+		for (index = 0; index < pcal->nr_a; index++)
+			crop->a[index] = pcal->a[index];
 
-		if (!fscanf(pcal_fd, "%d %d",
-			    &crop->cal_res_x, &crop->cal_res_y)) {
+		if (pcal->nr_res == 0) {
 			fprintf(stderr,
 				"CROP: Couldn't read resolution values\n");
 		}
+		if (pcal->nr_res >= 1)
+			crop->cal_res_x = pcal->res[0];
+		if (pcal->nr_res >= 2)
+			crop->cal_res_y = pcal->res[1];
 
-		if (!fscanf(pcal_fd, "%d", &crop->rot)) {
+		if (pcal->nr_rot == 0) {
 			fprintf(stderr, "CROP: Couldn't read rotation value\n");
 		}
-
-		fclose(pcal_fd);
+		if (pcal->nr_rot == 1)
+			crop->rot = pcal->rot;
 	}
+
+	crop->clip.w = crop->cal_res_x;
+	crop->clip.h = crop->cal_res_y;
+
+	ts_transform_init(&crop->t);
+	crop->t.clip = &crop->clip;
+	crop->t.flags = TS_TRANSFORM_CLIP;
+
 	return &crop->module;
 }
 
@@ -48,24 +48,20 @@ struct tslib_debounce {
 	enum debounce_mode		*mode_mt;
 };
 
-static int debounce_read(struct tslib_module_info *info, struct ts_sample *samp, int nr)
+static int debounce_process(struct tslib_module_info *info,
+			    struct ts_sample *samp, int nr,
+			    __attribute__ ((unused)) int max)
 {
 	struct tslib_debounce *p = (struct tslib_debounce *)info;
 	struct ts_sample *s;
-	int ret;
 	int num = 0;
 	int i;
 	int64_t now;
 	long dt;
 	int drop = 0;
-	int left;
 	__attribute__ ((unused)) enum debounce_mode mode;
 
-	ret = info->next->ops->read(info->next, samp, nr);
-	if (ret < 0)
-		return ret;
-
-	for (s = samp, i = 0; i < ret; i++, s++) {
+	for (s = samp, i = 0; i < nr; i++, s++) {
 		now = s->tv.tv_sec * 1e6 + s->tv.tv_usec;
 		dt = (long)(now - p->last_release) / 1000; /* ms */
 		mode = MOVE;
@@ -91,26 +87,21 @@ static int debounce_read(struct tslib_module_info *info, struct ts_sample *samp,
 				drop ? "  \033[31mdropped\033[m" : "");
 #endif
 
-		if (drop) {
-			left = ret - num - 1;
-			if (left > 0) {
-				memmove(s, s + 1, left * sizeof(struct ts_sample));
-				s--;
-				continue;
-			}
-			break;
-		}
+		if (drop)
+			continue;
 
+		if (num != i)
+			samp[num] = *s;
 		num++;
 	}
 	return num;
 }
 
-static int debounce_read_mt(struct tslib_module_info *info, struct ts_sample_mt **samp,
-			    int max_slots, int nr_samples)
+static int debounce_process_mt(struct tslib_module_info *info,
+			       struct ts_sample_mt **samp, int max_slots,
+			       int nr_samples, __attribute__ ((unused)) int max)
 {
 	struct tslib_debounce *p = (struct tslib_debounce *)info;
-	int ret;
 	int64_t now;
 	long dt;
 	int nr;
@@ -118,46 +109,32 @@ static int debounce_read_mt(struct tslib_module_info *info, struct ts_sample_mt
 
 	if (p->mode_mt == NULL || max_slots > p->current_max_slots) {
 		free(p->mode_mt);
-
-		p->mode_mt = calloc(max_slots, sizeof(unsigned int));
-		if (!p->mode_mt)
-			return -ENOMEM;
-
-		p->current_max_slots = max_slots;
-	}
-
-	if (p->last_release_mt == NULL || max_slots > p->current_max_slots) {
 		free(p->last_release_mt);
-
-		p->last_release_mt = calloc(max_slots, sizeof(int64_t));
-		if (!p->last_release_mt)
-			return -ENOMEM;
-
-		p->current_max_slots = max_slots;
-	}
-
-	if (p->last_pressure_mt == NULL || max_slots > p->current_max_slots) {
 		free(p->last_pressure_mt);
 
+		p->mode_mt = calloc(max_slots, sizeof(enum debounce_mode));
+		p->last_release_mt = calloc(max_slots, sizeof(int64_t));
 		p->last_pressure_mt = calloc(max_slots, sizeof(int));
-		if (!p->last_pressure_mt)
+		if (!p->mode_mt || !p->last_release_mt || !p->last_pressure_mt) {
+			free(p->mode_mt);
+			free(p->last_release_mt);
+			free(p->last_pressure_mt);
+			p->mode_mt = NULL;
+			p->last_release_mt = NULL;
+			p->last_pressure_mt = NULL;
 			return -ENOMEM;
+		}
 
 		p->current_max_slots = max_slots;
 	}
 
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr_samples);
-	if (ret < 0)
-		return ret;
-
 #ifdef DEBUG
-	printf("DEBOUNCE: read %d samples (mem: %d nr x %d slots)\n", ret, nr_samples, max_slots);
+	if (nr_samples)
+		printf("DEBOUNCE: read %d samples (mem: %d nr x %d slots)\n",
+		       nr_samples, max, max_slots);
 #endif
 
-	for (nr = 0; nr < ret; nr++) {
+	for (nr = 0; nr < nr_samples; nr++) {
 		for (i = 0; i < max_slots; i++) {
 			if (!(samp[nr][i].valid & TSLIB_MT_VALID))
 				continue;
@@ -197,6 +174,7 @@ static int debounce_fini(struct tslib_module_info *info)
 
 	free(p->last_release_mt);
 	free(p->last_pressure_mt);
+	free(p->mode_mt);
 
 	free(info);
 
@@ -204,8 +182,10 @@ static int debounce_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops debounce_ops = {
-	.read = debounce_read,
-	.read_mt = debounce_read_mt,
+	.read = tslib_filter_read,
+	.read_mt = tslib_filter_read_mt,
+	.process = debounce_process,
+	.process_mt = debounce_process_mt,
 	.fini = debounce_fini,
 };
 
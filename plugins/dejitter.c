@@ -106,15 +106,15 @@ static void average(struct tslib_dejitter *djt, struct ts_sample *samp)
 #endif
 }
 
-static int dejitter_read(struct tslib_module_info *info, struct ts_sample *samp,
-			 int nr)
+static int dejitter_process(struct tslib_module_info *info,
+			    struct ts_sample *samp, int nr,
+			    __attribute__ ((unused)) int max)
 {
 	struct tslib_dejitter *djt = (struct tslib_dejitter *)info;
 	struct ts_sample *s;
-	int count = 0, ret;
+	int count = 0;
 
-	ret = info->next->ops->read(info->next, samp, nr);
-	for (s = samp; ret > 0; s++, ret--) {
+	for (s = samp; nr > 0; s++, nr--) {
 		if (s->pressure == 0) {
 			/*
 			 * Pen was released. Reset the state and
@@ -188,23 +188,17 @@ static void average_mt(struct tslib_dejitter *djt, struct ts_sample_mt **samp, i
 #endif
 }
 
-static int dejitter_read_mt(struct tslib_module_info *info,
-			    struct ts_sample_mt **samp, int max_slots, int nr)
+static int dejitter_process_mt(struct tslib_module_info *info,
+			       struct ts_sample_mt **samp, int max_slots,
+			       int ret, __attribute__ ((unused)) int max)
 {
 	struct tslib_dejitter *djt = (struct tslib_dejitter *)info;
-	int ret;
 	int i, j;
 
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr);
-	if (ret < 0)
-		return ret;
-
 #ifdef DEBUG
-	printf("DEJITTER: read %d samples (mem: %d nr x %d slots)\n",
-	       ret, nr, max_slots);
+	if (ret)
+		printf("DEJITTER: read %d samples (mem: %d nr x %d slots)\n",
+		       ret, max, max_slots);
 #endif
 
 	if (djt->hist_mt == NULL || max_slots > djt->slots) {
@@ -215,6 +209,14 @@ static int dejitter_read_mt(struct tslib_module_info *info,
 			free(djt->hist_mt);
 			djt->hist_mt = NULL;
 		}
+		free(djt->nr_mt);
+		free(djt->head_mt);
+		djt->slots = 0;
+
+		djt->nr_mt = calloc(max_slots, sizeof(int));
+		djt->head_mt = calloc(max_slots, sizeof(int));
+		if (!djt->nr_mt || !djt->head_mt)
+			return -ENOMEM;
 
 		djt->hist_mt = malloc(max_slots * sizeof(struct ts_hist *));
 		if (!djt->hist_mt)
@@ -235,22 +237,6 @@ static int dejitter_read_mt(struct tslib_module_info *info,
 		djt->slots = max_slots;
 	}
 
-	if (djt->nr_mt == NULL || max_slots > djt->slots) {
-		free(djt->nr_mt);
-
-		djt->nr_mt = calloc(max_slots, sizeof(int));
-		if (!djt->nr_mt)
-			return -ENOMEM;
-	}
-
-	if (djt->head_mt == NULL || max_slots > djt->slots) {
-		free(djt->head_mt);
-
-		djt->head_mt = calloc(max_slots, sizeof(int));
-		if (!djt->head_mt)
-			return -ENOMEM;
-	}
-
 	for (j = 0; j < ret; j++) {
 		for (i = 0; i < max_slots; i++) {
 			if (!(samp[j][i].valid & TSLIB_MT_VALID))
@@ -315,8 +301,10 @@ static int dejitter_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops dejitter_ops = {
-	.read		= dejitter_read,
-	.read_mt	= dejitter_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= dejitter_process,
+	.process_mt	= dejitter_process_mt,
 	.fini		= dejitter_fini,
 };
 
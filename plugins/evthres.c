@@ -26,13 +26,24 @@
 struct evthres {
 	struct tslib_module_info	module;
 	unsigned int			size;
+	/* samples are queued in the ring buf, starting at head. the first
+	 * 'ready' of them are from a sequence that made it and can be handed
+	 * out, the others are still being checked.
+	 */
 	struct ts_sample		*buf;
+	unsigned int			cap;
+	unsigned int			head;
 	unsigned int			full;
+	unsigned int			ready;
 	unsigned int			filling_mode;
 	int				slots;
+	unsigned int			cap_mt;
 	struct ts_sample_mt		**buf_mt;
+	unsigned int			*head_mt;
 	unsigned int			*full_mt;
+	unsigned int			*ready_mt;
 	unsigned int			*filling_mode_mt;
+	int				*next_mt;
 };
 
 
@@ -54,219 +65,231 @@ static void printsample_mt(__attribute__ ((unused)) char *prefix,
 #endif
 }
 
-static int evthres_read(struct tslib_module_info *info, struct ts_sample *samp,
-			int nr)
+/* slot n of the queue, counted from its head */
+#define EVTHRES_AT(buf, cap, head, n)	((buf)[((head) + (n)) % (cap)])
+
+static int evthres_process(struct tslib_module_info *info,
+			   struct ts_sample *samp, int nr, int max)
 {
 	struct evthres *c = (struct evthres *)info;
-	struct ts_sample *s;
-	int ret, i;
+	struct ts_sample *buf;
+	unsigned int k;
+	int i;
 	int count = 0;
 
-	/* if buffer is full, empty it before reading new samples */
-	for (i = 0; i < nr; i++) {
-		if (!c->filling_mode && c->full > 0) {
-			memcpy(samp, &c->buf[0], sizeof(struct ts_sample));
-			memmove(&c->buf[0],
-				&c->buf[1],
-				(c->size - 1) * sizeof(c->buf[0]));
-			memset(&c->buf[c->size - 1], 0, sizeof(struct ts_sample));
-			c->full--;
-		#ifdef DEBUG
-			printf("EVTHRES: emptying buffer\n");
-		#endif
-			printsample("EVTHRES: ", samp);
-			count++;
-		} else {
-			samp->pressure = 0;
-		}
-	}
-	if (count)
-		return count;
+	if (c->full + nr > c->cap) {
+		buf = malloc((c->size + c->full + nr) * sizeof(struct ts_sample));
+		if (!buf)
+			return -ENOMEM;
 
-	if (!info->next->ops->read)
-		return -ENOSYS;
+		for (k = 0; k < c->full; k++)
+			buf[k] = EVTHRES_AT(c->buf, c->cap, c->head, k);
 
-	ret = info->next->ops->read(info->next, samp, nr);
-	if (ret <= 0)
-		return ret;
+		free(c->buf);
+		c->buf = buf;
+		c->cap = c->size + c->full + nr;
+		c->head = 0;
+	}
 
-	for (s = samp; ret > 0; s++, ret--) {
+	for (i = 0; i < nr; i++) {
 		if (c->filling_mode == 0) {
-			printsample("EVTHRES: ", samp);
-
-			if (!samp->pressure)
+			if (!samp[i].pressure)
 				c->filling_mode = 1;
 
-			count++;
+			/* pass through, unless there's still a queue */
+			if (c->ready == 0) {
+				printsample("EVTHRES: ", &samp[i]);
+				samp[count++] = samp[i];
+			} else {
+				EVTHRES_AT(c->buf, c->cap, c->head, c->full) = samp[i];
+				c->full++;
+				c->ready++;
+			}
 			continue;
 		}
 
 		/* pen up: drop all */
-		if ((!s->pressure) && (c->full < c->size)) {
-			c->full = 0;
-			memset(c->buf, 0,
-			       c->size * sizeof(c->buf[0]));
+		if (!samp[i].pressure) {
+			c->full = c->ready;
+		#ifdef DEBUG
+			printf("EVTHRES: pen up: DROP the sequence\n");
+		#endif
 			continue;
 		}
 
 		/* accept one sample to buf */
-		memmove(c->buf,
-			&c->buf[1],
-			(c->size - 1) * sizeof(c->buf[0]));
-		memcpy(&c->buf[c->size - 1], samp, sizeof(c->buf[0]));
+		EVTHRES_AT(c->buf, c->cap, c->head, c->full) = samp[i];
 		c->full++;
 
-		if (c->full < c->size) {
-			c->filling_mode = 1;
+		if (c->full - c->ready < c->size) {
 		#ifdef DEBUG
 			printf("EVTHRES: filling buffer\n");
 		#endif
 		} else {
 			c->filling_mode = 0;
+			c->ready = c->full;
 		#ifdef DEBUG
 			printf("EVTHRES: buffer full\n");
 		#endif
 		}
 	}
 
+	/* hand out what made it */
+	while (c->ready > 0 && count < max) {
+		samp[count] = c->buf[c->head];
+		c->head = (c->head + 1) % c->cap;
+		c->full--;
+		c->ready--;
+	#ifdef DEBUG
+		printf("EVTHRES: emptying buffer\n");
+	#endif
+		printsample("EVTHRES: ", &samp[count]);
+		count++;
+	}
+
 	return count;
 }
 
-static int evthres_read_mt(struct tslib_module_info *inf,
-			   struct ts_sample_mt **samp, int max_slots, int nr)
+/* make room for max_slots rings that can hold need samples each */
+static int evthres_alloc_mt(struct evthres *c, int max_slots, unsigned int need)
 {
-	struct evthres *c = (struct evthres *)inf;
-	int ret;
-	int i, j;
-	int count_nr = 0;
-	int count = 0;
-
+	struct ts_sample_mt **buf_mt;
+	struct ts_sample_mt *buf;
+	unsigned int *head_mt;
+	unsigned int *full_mt;
+	unsigned int *ready_mt;
+	unsigned int *filling_mode_mt;
+	int *next_mt;
+	unsigned int k;
+	int i;
 
-	/* if buffer is full, empty it before reading new samples */
-	for (i = 0; i < nr; i++) {
-		count = 0;
-		for (j = 0; j < max_slots; j++) {
-			if (c->filling_mode_mt && c->filling_mode_mt[j] == 0 &&
-			    c->full_mt && c->full_mt[j] > 0) {
-				samp[i][j] = c->buf_mt[j][0];
-				memmove(&c->buf_mt[j][0],
-					&c->buf_mt[j][1],
-					(c->size - 1) * sizeof(c->buf_mt[j][0]));
-				memset(&c->buf_mt[j][c->size - 1], 0, sizeof(struct ts_sample_mt));
-				c->full_mt[j]--;
-			#ifdef DEBUG
-				printf("EVTHRES slot %d: emptying buffer\n", j);
-			#endif
-				printsample_mt("EVTHRES: ", &samp[i][j]);
-				count++;
+	if (max_slots > c->slots) {
+		buf_mt = realloc(c->buf_mt, max_slots * sizeof(*buf_mt));
+		if (!buf_mt)
+			return -ENOMEM;
+		c->buf_mt = buf_mt;
 
-				if (!samp[i][j].pressure) {
-		printf("                    INTERNAL ERROR\n");
-				}
-			} else {
-				samp[i][j].valid &= ~TSLIB_MT_VALID;
-			}
-		}
-		if (count)
-			count_nr++;
-	}
-	if (count_nr) {
-	#ifdef DEBUG
-		printf("EVTHRES: %d samples from buffer (mem: %d nr x %d slots)\n",
-		       count_nr, nr, max_slots);
-	#endif
-		return count_nr;
-	}
+		head_mt = realloc(c->head_mt, max_slots * sizeof(*head_mt));
+		if (!head_mt)
+			return -ENOMEM;
+		c->head_mt = head_mt;
 
-	/* buffer is empty. read new samples */
-	if (!inf->next->ops->read_mt)
-		return -ENOSYS;
+		full_mt = realloc(c->full_mt, max_slots * sizeof(*full_mt));
+		if (!full_mt)
+			return -ENOMEM;
+		c->full_mt = full_mt;
 
-	ret = inf->next->ops->read_mt(inf->next, samp, max_slots, nr);
-	if (ret < 0)
-		return ret;
+		ready_mt = realloc(c->ready_mt, max_slots * sizeof(*ready_mt));
+		if (!ready_mt)
+			return -ENOMEM;
+		c->ready_mt = ready_mt;
 
-#ifdef DEBUG
-	if (ret == 0)
-		fprintf(stderr, "EVTHRES: couldn't read data\n");
+		filling_mode_mt = realloc(c->filling_mode_mt,
+					  max_slots * sizeof(*filling_mode_mt));
+		if (!filling_mode_mt)
+			return -ENOMEM;
+		c->filling_mode_mt = filling_mode_mt;
 
-	printf("EVTHRES: read %d samples (mem: %d nr x %d slots)\n",
-	       ret, nr, max_slots);
-#endif
+		next_mt = realloc(c->next_mt, max_slots * sizeof(*next_mt));
+		if (!next_mt)
+			return -ENOMEM;
+		c->next_mt = next_mt;
 
-	if (c->buf_mt == NULL || max_slots > c->slots) {
-		if (c->buf_mt) {
-			for (i = 0; i < c->slots; i++)
-				free(c->buf_mt[i]);
+		for (i = c->slots; i < max_slots; i++) {
+			c->buf_mt[i] = calloc(c->cap_mt,
+					      sizeof(struct ts_sample_mt));
+			if (!c->buf_mt[i])
+				return -ENOMEM;
 
-			free(c->buf_mt);
+			c->head_mt[i] = 0;
+			c->full_mt[i] = 0;
+			c->ready_mt[i] = 0;
+			c->filling_mode_mt[i] = 1;
+			c->slots = i + 1;
 		}
+	}
 
-		c->buf_mt = malloc(max_slots * sizeof(struct ts_sample_mt *));
-		if (!c->buf_mt)
-			return -ENOMEM;
+	if (need > c->cap_mt) {
+		need += c->size;
 
-		for (i = 0; i < max_slots; i++) {
-			c->buf_mt[i] = calloc(c->size,
-					      sizeof(struct ts_sample_mt));
-			if (!c->buf_mt[i]) {
-				for (j = 0; j < i; j++)
-					free(c->buf_mt[j]);
+		for (i = 0; i < c->slots; i++) {
+			buf = malloc(need * sizeof(struct ts_sample_mt));
+			if (!buf)
+				return -ENOMEM;
 
-				free(c->buf_mt);
-				c->buf_mt = NULL;
+			for (k = 0; k < c->full_mt[i]; k++)
+				buf[k] = EVTHRES_AT(c->buf_mt[i], c->cap_mt,
+						    c->head_mt[i], k);
 
-				return -ENOMEM;
-			}
+			free(c->buf_mt[i]);
+			c->buf_mt[i] = buf;
+			c->head_mt[i] = 0;
 		}
-
-		c->slots = max_slots;
+		c->cap_mt = need;
 	}
 
-	if (c->full_mt == NULL || max_slots > c->slots) {
-		free(c->full_mt);
+	return 0;
+}
 
-		c->full_mt = calloc(max_slots, sizeof(unsigned int));
-		if (!c->full_mt)
-			return -ENOMEM;
+static int evthres_process_mt(struct tslib_module_info *inf,
+			      struct ts_sample_mt **samp, int max_slots,
+			      int nr, int max)
+{
+	struct evthres *c = (struct evthres *)inf;
+	unsigned int need = 0;
+	int ret;
+	int i, j;
+	int frames;
+
+	for (j = 0; j < c->slots; j++) {
+		if (c->full_mt[j] > need)
+			need = c->full_mt[j];
 	}
 
-	if (c->filling_mode_mt == NULL || max_slots > c->slots) {
-		free(c->filling_mode_mt);
+	ret = evthres_alloc_mt(c, max_slots, need + nr);
+	if (ret < 0)
+		return ret;
 
-		c->filling_mode_mt = calloc(max_slots, sizeof(unsigned int));
-		if (!c->filling_mode_mt)
-			return -ENOMEM;
+#ifdef DEBUG
+	if (nr)
+		printf("EVTHRES: read %d samples (mem: %d nr x %d slots)\n",
+		       nr, max, max_slots);
+#endif
 
-		for (i = 0; i < max_slots; i++)
-			c->filling_mode_mt[i] = 1;
-	}
+	for (j = 0; j < max_slots; j++)
+		c->next_mt[j] = 0;
 
-	for (i = 0; i < ret; i++) {
+	for (i = 0; i < nr; i++) {
 		for (j = 0; j < max_slots; j++) {
 			if (!(samp[i][j].valid & TSLIB_MT_VALID))
 				continue;
 
 			/* if filling == 0 : return sample */
 			if (c->filling_mode_mt[j] == 0) {
-
-			#ifdef DEBUG
-				printf("EVTHRES slot %d: direct pass through\n", j);
-			#endif
-				printsample_mt("EVTHRES: ", &samp[i][j]);
-
 				if (!samp[i][j].pressure)
 					c->filling_mode_mt[j] = 1;
 
+				/* pass through, unless there's still a queue */
+				if (c->ready_mt[j] == 0) {
+				#ifdef DEBUG
+					printf("EVTHRES slot %d: direct pass through\n", j);
+				#endif
+					printsample_mt("EVTHRES: ", &samp[i][j]);
+					c->next_mt[j] = i + 1;
+				} else {
+					EVTHRES_AT(c->buf_mt[j], c->cap_mt,
+						   c->head_mt[j],
+						   c->full_mt[j]) = samp[i][j];
+					c->full_mt[j]++;
+					c->ready_mt[j]++;
+					samp[i][j].valid &= ~TSLIB_MT_VALID;
+				}
 				continue;
 			}
 
 			/* pen up: drop all */
-			if ((!samp[i][j].pressure) && (c->full_mt[j] < c->size)) {
-				c->full_mt[j] = 0;
-				c->filling_mode_mt[j] = 1;
-				memset(&c->buf_mt[j][0], 0,
-					c->size * sizeof(c->buf_mt[j][0]));
+			if (!samp[i][j].pressure) {
+				c->full_mt[j] = c->ready_mt[j];
 			#ifdef DEBUG
 				printf("EVTHRES: pen up: DROP the sequence\n");
 			#endif
@@ -275,19 +298,17 @@ static int evthres_read_mt(struct tslib_module_info *inf,
 			}
 
 			/* accept one sample to buf */
-			memmove(&c->buf_mt[j][0],
-				&c->buf_mt[j][1],
-				(c->size - 1) * sizeof(c->buf_mt[j][0]));
-			c->buf_mt[j][c->size - 1] = samp[i][j];
+			EVTHRES_AT(c->buf_mt[j], c->cap_mt, c->head_mt[j],
+				   c->full_mt[j]) = samp[i][j];
 			c->full_mt[j]++;
 
-			if (c->full_mt[j] < c->size) {
-				c->filling_mode_mt[j] = 1;
+			if (c->full_mt[j] - c->ready_mt[j] < c->size) {
 			#ifdef DEBUG
 				printf("EVTHRES slot %d: filling buffer\n", j);
 			#endif
 			} else {
 				c->filling_mode_mt[j] = 0;
+				c->ready_mt[j] = c->full_mt[j];
 			#ifdef DEBUG
 				printf("EVTHRES slot %d: buffer full\n", j);
 			#endif
@@ -297,7 +318,39 @@ static int evthres_read_mt(struct tslib_module_info *inf,
 		}
 	}
 
-	return ret;
+	/* hand out what made it, behind what a slot already has in this
+	 * batch. this may need more frames than we got.
+	 */
+	frames = nr;
+	for (j = 0; j < max_slots; j++) {
+		if (c->ready_mt[j] == 0)
+			continue;
+
+		if (c->next_mt[j] + (int)c->ready_mt[j] > frames)
+			frames = c->next_mt[j] + c->ready_mt[j];
+	}
+	if (frames > max)
+		frames = max;
+
+	for (i = nr; i < frames; i++) {
+		for (j = 0; j < max_slots; j++)
+			samp[i][j].valid &= ~TSLIB_MT_VALID;
+	}
+
+	for (j = 0; j < max_slots; j++) {
+		for (i = c->next_mt[j]; i < frames && c->ready_mt[j] > 0; i++) {
+			samp[i][j] = c->buf_mt[j][c->head_mt[j]];
+			c->head_mt[j] = (c->head_mt[j] + 1) % c->cap_mt;
+			c->full_mt[j]--;
+			c->ready_mt[j]--;
+		#ifdef DEBUG
+			printf("EVTHRES slot %d: emptying buffer\n", j);
+		#endif
+			printsample_mt("EVTHRES: ", &samp[i][j]);
+		}
+	}
+
+	return frames;
 }
 
 static int evthres_fini(struct tslib_module_info *inf)
@@ -309,6 +362,12 @@ static int evthres_fini(struct tslib_module_info *inf)
 		free(c->buf_mt[i]);
 
 	free(c->buf_mt);
+	free(c->head_mt);
+	free(c->full_mt);
+	free(c->ready_mt);
+	free(c->filling_mode_mt);
+	free(c->next_mt);
+	free(c->buf);
 
 	free(inf);
 
@@ -316,8 +375,10 @@ static int evthres_fini(struct tslib_module_info *inf)
 }
 
 static const struct tslib_ops evthres_ops = {
-	.read		= evthres_read,
-	.read_mt	= evthres_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= evthres_process,
+	.process_mt	= evthres_process_mt,
 	.fini		= evthres_fini,
 };
 
@@ -337,8 +398,11 @@ static int evthres_size(struct tslib_module_info *inf, char *str,
 	}
 
 	errno = err;
+	free(m->buf);
 	m->buf = malloc(sizeof(struct ts_sample) * n);
 	m->size = n;
+	m->cap = n;
+	m->cap_mt = n;
 
 	return 0;
 }
@@ -374,6 +438,8 @@ TSAPI struct tslib_module_info *evthres_mod_init(__attribute__ ((unused)) struct
 	if (c->buf == NULL) {
 		c->buf = malloc(sizeof(struct ts_sample) * EVTHRES_SIZE_DEFAULT);
 		c->size = EVTHRES_SIZE_DEFAULT;
+		c->cap = c->size;
+		c->cap_mt = c->size;
 	#ifdef DEBUG
 		printf("Using default size of %d\n", c->size);
 	#endif
@@ -50,18 +50,13 @@ static void iir_filter(struct tslib_module_info *info, int32_t *new,
 }
 
 /* legacy read interface */
-static int iir_read(struct tslib_module_info *info, struct ts_sample *samp,
-		    int nr)
+static int iir_process(struct tslib_module_info *info, struct ts_sample *samp,
+		       int nr, __attribute__ ((unused)) int max)
 {
 	struct tslib_iir *iir = (struct tslib_iir *)info;
-	int32_t ret;
 	int32_t i;
 
-	ret = info->next->ops->read(info->next, samp, nr);
-	if (ret < 0)
-		return ret;
-
-	for (i = 0; i < ret; i++, samp++) {
+	for (i = 0; i < nr; i++, samp++) {
 		if (samp->pressure == 0) { /* reset */
 			iir->s = samp->x;
 			iir->t = samp->y;
@@ -87,14 +82,14 @@ static int iir_read(struct tslib_module_info *info, struct ts_sample *samp,
 		samp->y = iir->t;
 	}
 
-	return ret;
+	return nr;
 }
 
-static int iir_read_mt(struct tslib_module_info *info,
-		       struct ts_sample_mt **samp, int max_slots, int nr)
+static int iir_process_mt(struct tslib_module_info *info,
+			  struct ts_sample_mt **samp, int max_slots, int nr,
+			  __attribute__ ((unused)) int max)
 {
 	struct tslib_iir *iir = (struct tslib_iir *)info;
-	int32_t ret;
 	int32_t i, j;
 
 	if (!iir->s_mt || max_slots > iir->slots) {
@@ -117,14 +112,7 @@ static int iir_read_mt(struct tslib_module_info *info,
 		iir->slots = max_slots;
 	}
 
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr);
-	if (ret < 0)
-		return ret;
-
-	for (i = 0; i < ret; i++) {
+	for (i = 0; i < nr; i++) {
 		for (j = 0; j < max_slots; j++) {
 			if (!(samp[i][j].valid & TSLIB_MT_VALID))
 				continue;
@@ -157,7 +145,7 @@ static int iir_read_mt(struct tslib_module_info *info,
 		}
 	}
 
-	return ret;
+	return nr;
 }
 
 static int iir_fini(struct tslib_module_info *info)
@@ -174,8 +162,10 @@ static int iir_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops iir_ops = {
-	.read		= iir_read,
-	.read_mt	= iir_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= iir_process,
+	.process_mt	= iir_process_mt,
 	.fini		= iir_fini,
 };
 
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <stdint.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <stdlib.h>
 #ifdef HAVE_UNISTD_H
@@ -64,11 +65,13 @@ struct tslib_input {
 	int8_t	type_a;
 	int32_t *last_pressure;
 	int8_t	last_type_a_slots;
+	int32_t	next_trackid;	/* made up for type A devices */
 
 	uint16_t	special_device; /* broken device we work around, see below */
 
 	struct libevdev *evdev;
 	int8_t	fd_blocking;
+	int	clock;		/* of the timestamps, see set_clock() */
 };
 
 #ifndef BUS_USB
@@ -275,6 +278,21 @@ static int check_fd(struct tslib_input *i)
 	return ts->fd;
 }
 
+/* libevdev drops what it had queued and syncs, see input-raw.c */
+static void set_clock(struct tslib_input *i)
+{
+	struct tsdev *ts = i->module.dev;
+
+	if (libevdev_set_clock_id(i->evdev, ts->clock) < 0 &&
+	    ts->clock != CLOCK_REALTIME) {
+		fprintf(stderr,
+			"tslib: Unable to set the clock of the input device, timestamps stay in CLOCK_REALTIME\n");
+		ts->clock = CLOCK_REALTIME;
+	}
+
+	i->clock = ts->clock;
+}
+
 static int ts_input_read_without_syn(struct tslib_module_info *inf,
 				     struct ts_sample *samp, int nr)
 {
@@ -382,12 +400,17 @@ static int ts_input_read(struct tslib_module_info *inf,
 	if (!i)
 		return -ENOMEM;
 
-	if (ts->fd != i->last_fd)
+	if (ts->fd != i->last_fd) {
 		i->last_fd = check_fd(i);
+		i->clock = -1;
+	}
 
 	if (i->last_fd == -1)
 		return -ENODEV;
 
+	if (i->clock != ts->clock)
+		set_clock(i);
+
 	if (i->no_pressure)
 		set_pressure(i);
 
@@ -410,6 +433,9 @@ static int ts_input_read(struct tslib_module_info *inf,
 		}
 
 		if (rc == LIBEVDEV_READ_STATUS_SYNC) {
+			__atomic_add_fetch(&i->module.dev->syn_dropped, 1,
+					   __ATOMIC_RELAXED);
+			TS_TRACE0(syn_dropped);
 		#ifdef DEBUG
 			printf("INPUT-RAW: Frame dropped\n");
 		#endif
@@ -434,6 +460,7 @@ static int ts_input_read(struct tslib_module_info *inf,
 			fprintf(stderr, "Failed to handle events: %s\n",
 				strerror(-rc));
 		}
+		TS_TRACE3(raw_event, ev.type, ev.code, ev.value);
 
 		switch (ev.type) {
 		case EV_KEY:
@@ -459,6 +486,8 @@ static int ts_input_read(struct tslib_module_info *inf,
 					samp->pressure = i->current_p;
 				}
 				samp->tv = ev.time;
+				TS_TRACE3(frame, total, ev.time.tv_sec,
+					  ev.time.tv_usec);
 		#ifdef DEBUG
 			fprintf(stderr,
 				"RAW nr %d ---------------------> %d %d %d %lld.%06lld\n",
@@ -554,18 +583,22 @@ static int ts_input_read_mt(struct tslib_module_info *inf,
 	int total = 0;
 	int j, k;
 	uint8_t pen_up = 0;
-	static int32_t next_trackid;
 	struct input_event ev;
 
 	if (!i)
 		return -ENOMEM;
 
-	if (ts->fd != i->last_fd)
+	if (ts->fd != i->last_fd) {
 		i->last_fd = check_fd(i);
+		i->clock = -1;
+	}
 
 	if (i->last_fd == -1)
 		return -ENODEV;
 
+	if (i->clock != ts->clock)
+		set_clock(i);
+
 	if (i->buf == NULL || i->max_slots < max_slots || i->nr < nr) {
 		if (i->buf) {
 			for (j = 0; j < i->nr; j++)
@@ -625,6 +658,9 @@ static int ts_input_read_mt(struct tslib_module_info *inf,
 		}
 
 		if (rc == LIBEVDEV_READ_STATUS_SYNC) {
+			__atomic_add_fetch(&i->module.dev->syn_dropped, 1,
+					   __ATOMIC_RELAXED);
+			TS_TRACE0(syn_dropped);
 		#ifdef DEBUG
 			printf("INPUT-RAW: Frame dropped\n");
 		#endif
@@ -649,6 +685,7 @@ static int ts_input_read_mt(struct tslib_module_info *inf,
 			fprintf(stderr, "Failed to handle events: %s\n",
 				strerror(-rc));
 		}
+		TS_TRACE3(raw_event, ev.type, ev.code, ev.value);
 
 	#ifdef DEBUG
 		printf("INPUT-RAW nr %d: read type %d  code %3d  value %4d  time %lld.%06lld\n",
@@ -717,6 +754,8 @@ static int ts_input_read_mt(struct tslib_module_info *inf,
 				if (i->type_a)
 					i->slot = 0;
 
+				TS_TRACE3(frame, total, ev.time.tv_sec,
+					  ev.time.tv_usec);
 				total++;
 				break;
 			case SYN_MT_REPORT:
@@ -730,7 +769,7 @@ static int ts_input_read_mt(struct tslib_module_info *inf,
 					i->last_pressure[i->slot] = 0;
 				} else if (i->last_pressure[i->slot] == 0) {
 					/* new contact. generate a tracking id */
-					i->buf[total][i->slot].tracking_id = ++next_trackid;
+					i->buf[total][i->slot].tracking_id = ++i->next_trackid;
 					i->last_pressure[i->slot] = 1;
 				}
 
@@ -952,8 +991,10 @@ TSAPI struct tslib_module_info *input_evdev_mod_init(__attribute__ ((unused)) st
 	i->type_a = 0;
 	i->special_device = 0;
 	i->last_pressure = NULL;
+	i->next_trackid = 0;
 	i->fd_blocking = -1;
 	i->evdev = NULL;
+	i->clock = -1;
 	i->using_syn = 1;
 
 	if (tslib_parse_vars(&i->module, raw_vars, NR_VARS, params)) {
@@ -24,7 +24,9 @@
 #include <stdio.h>
 #include <limits.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 #include <stdlib.h>
 #ifdef HAVE_UNISTD_H
@@ -109,7 +111,7 @@
 #define GRAB_EVENTS_WANTED	1
 #define GRAB_EVENTS_ACTIVE	2
 
-#define NUM_EVENTS_READ 1 /* internal. independent from the user call */
+#define NUM_EVENTS_READ 64 /* internal. independent from the user call */
 
 struct tslib_input {
 	struct tslib_module_info module;
@@ -121,23 +123,66 @@ struct tslib_input {
 	int8_t	using_syn;
 	int8_t	grab_events;
 
+	/* what the device has, to ask it for its state after SYN_DROPPED */
+	long	absbit[BITS_TO_LONGS(ABS_CNT)];
+	long	keybit[BITS_TO_LONGS(KEY_CNT)];
+	int8_t	dropped;	/* events are lost until the next SYN_REPORT */
+
+	/* what we don't want the kernel to send us, see set_mask() */
+	long	ignore_abs[BITS_TO_LONGS(ABS_CNT)];
+	int8_t	ignore_msc;
+
+	int	clock;		/* of the timestamps, see set_clock() */
+
+	/* events read from the device but not yet consumed. read() fills
+	 * this in one go and ev_head walks through it, so one syscall serves
+	 * many events and anything left after a SYN_REPORT stays here for
+	 * the next call.
+	 */
 	struct input_event ev[NUM_EVENTS_READ];
-	struct ts_sample_mt **buf;
+	unsigned int ev_head;
+	unsigned int ev_count;
+
+	/* multitouch slot state as decoded so far, plus one spare entry
+	 * collecting data for out-of-range slots. Slots that got data since
+	 * the last SYN_REPORT are listed in dirty[]; only those are handed
+	 * out when the frame is complete.
+	 */
+	struct ts_sample_mt *buf;
+	int	*dirty;
+	int	nr_dirty;
 
 	int	slot;
 	int	max_slots;
-	int	nr;
-	int	pen_down;
+	int8_t	pen_up;
 	int	last_fd;
 	int8_t	mt;
 	int8_t	no_pressure;
 	int8_t	type_a;
-	int32_t *last_pressure;
+	int32_t *last_pressure;	/* whether a slot has a contact */
+	int32_t *values;	/* for EVIOCGMTSLOTS */
 	int8_t	last_type_a_slots;
+	int32_t	next_trackid;	/* made up for type A devices */
 
 	uint16_t	special_device; /* broken device we work around, see below */
+
+#ifdef INPUT_RAW_REPLAY
+	struct replay *replay;
+#endif
 };
 
+/*
+ * Everything we ask of the device goes through these, so that the replay
+ * module can stand in for it; see replay-raw.c.
+ */
+#ifdef INPUT_RAW_REPLAY
+#define input_ioctl(i, req, arg)	replay_ioctl((i)->replay, req, arg)
+#define input_read(i, buf, len)		replay_read((i)->replay, buf, len)
+#else
+#define input_ioctl(i, req, arg)	ioctl((i)->module.dev->fd, req, arg)
+#define input_read(i, buf, len)		read((i)->module.dev->fd, buf, len)
+#endif
+
 #ifndef BUS_USB
 #define BUS_USB 0x03
 #endif
@@ -153,9 +198,8 @@ struct tslib_input {
 static int get_special_device(struct tslib_input *i)
 {
 	struct input_id id;
-	struct tsdev *ts = i->module.dev;
 
-	if ((ioctl(ts->fd, EVIOCGID, &id) < 0)) {
+	if ((input_ioctl(i, EVIOCGID, &id) < 0)) {
 		fprintf(stderr, "tslib: warning, can't read device id\n");
 		return -1;
 	}
@@ -201,30 +245,90 @@ static int get_special_device(struct tslib_input *i)
 	return 0;
 }
 
-static void set_pressure(struct tslib_input *i)
+/* whether ignore= was given */
+static int has_mask(const struct tslib_input *i)
 {
-	int j, k;
+	unsigned int k;
 
-	i->current_p = 255;
+	for (k = 0; k < BITS_TO_LONGS(ABS_CNT); k++) {
+		if (i->ignore_abs[k])
+			return 1;
+	}
 
-	if (i->buf) {
-		for (j = 0; j < i->nr; j++) {
-			for (k = 0; k < i->max_slots; k++)
-				i->buf[j][k].pressure = 255;
-		}
+	return i->ignore_msc;
+}
+
+/*
+ * Many devices send touch sizes, orientations and the like with every
+ * frame. If nobody uses them, the kernel can keep them to itself: they
+ * are neither copied to us nor decoded here. Needs Linux 4.4.
+ */
+#ifdef EVIOCSMASK
+static void set_mask(struct tslib_input *i)
+{
+	long abs[BITS_TO_LONGS(ABS_CNT)];
+	long msc[BITS_TO_LONGS(MSC_CNT)];
+	struct input_mask mask;
+	unsigned int k;
+
+	if (!has_mask(i))
+		return;
+
+	for (k = 0; k < BITS_TO_LONGS(ABS_CNT); k++)
+		abs[k] = ~i->ignore_abs[k];
+
+	/* some devices need these for pen down/up, see ts_input_read_mt() */
+	if (i->special_device == EGALAX_VERSION_210 &&
+	    !(abs[BIT_WORD(ABS_MT_DISTANCE)] & BIT_MASK(ABS_MT_DISTANCE))) {
+		fprintf(stderr, "tslib: warning: the device needs distance for pressure, not ignoring it\n");
+		abs[BIT_WORD(ABS_MT_DISTANCE)] |= BIT_MASK(ABS_MT_DISTANCE);
+	}
+	if (i->no_pressure &&
+	    !(i->absbit[BIT_WORD(ABS_MT_TRACKING_ID)] & BIT_MASK(ABS_MT_TRACKING_ID)) &&
+	    !(abs[BIT_WORD(ABS_MT_TOUCH_MAJOR)] & BIT_MASK(ABS_MT_TOUCH_MAJOR))) {
+		fprintf(stderr, "tslib: warning: the device needs touch for releases, not ignoring it\n");
+		abs[BIT_WORD(ABS_MT_TOUCH_MAJOR)] |= BIT_MASK(ABS_MT_TOUCH_MAJOR);
+	}
+
+	mask.type = EV_ABS;
+	mask.codes_size = sizeof(abs);
+	mask.codes_ptr = (uintptr_t)abs;
+	if (input_ioctl(i, EVIOCSMASK, &mask) < 0) {
+		fprintf(stderr, "tslib: warning: the device can't mask events\n");
+		return;
 	}
+
+	/* so we don't ask for them after SYN_DROPPED either */
+	for (k = 0; k < BITS_TO_LONGS(ABS_CNT); k++)
+		i->absbit[k] &= abs[k];
+
+	if (i->ignore_msc) {
+		memset(msc, 0, sizeof(msc));
+		mask.type = EV_MSC;
+		mask.codes_size = sizeof(msc);
+		mask.codes_ptr = (uintptr_t)msc;
+		if (input_ioctl(i, EVIOCSMASK, &mask) < 0)
+			fprintf(stderr, "tslib: warning: the device can't mask events\n");
+	}
+}
+#else
+static void set_mask(struct tslib_input *i)
+{
+	if (has_mask(i))
+		fprintf(stderr, "tslib: warning: built without EVIOCSMASK, ignore= has no effect\n");
 }
+#endif
 
 static int check_fd(struct tslib_input *i)
 {
 	struct tsdev *ts = i->module.dev;
 	int version;
 	long evbit[BITS_TO_LONGS(EV_CNT)];
-	long absbit[BITS_TO_LONGS(ABS_CNT)];
-	long keybit[BITS_TO_LONGS(KEY_CNT)];
+	long *absbit = i->absbit;
+	long *keybit = i->keybit;
 	long synbit[BITS_TO_LONGS(SYN_CNT)];
 
-	if (ioctl(ts->fd, EVIOCGVERSION, &version) < 0) {
+	if (input_ioctl(i, EVIOCGVERSION, &version) < 0) {
 		fprintf(stderr,
 			"tslib: Selected device is not a Linux input event device\n");
 		return -1;
@@ -237,14 +341,18 @@ static int check_fd(struct tslib_input *i)
 		fprintf(stderr,
 			"tslib: Warning: Selected device uses a different version of the event protocol than tslib was compiled for\n");
 
-	if ((ioctl(ts->fd, EVIOCGBIT(0, sizeof(evbit)), evbit) < 0) ||
+	memset(i->absbit, 0, sizeof(i->absbit));
+	memset(i->keybit, 0, sizeof(i->keybit));
+	i->dropped = 0;
+
+	if ((input_ioctl(i, EVIOCGBIT(0, sizeof(evbit)), evbit) < 0) ||
 		!(evbit[BIT_WORD(EV_ABS)] & BIT_MASK(EV_ABS))) {
 		fprintf(stderr,
 			"tslib: Selected device is not a touchscreen (must support ABS event type)\n");
 		return -1;
 	}
 
-	if ((ioctl(ts->fd, EVIOCGBIT(EV_ABS, sizeof(absbit)), absbit)) < 0 ||
+	if ((input_ioctl(i, EVIOCGBIT(EV_ABS, sizeof(i->absbit)), absbit)) < 0 ||
 	    !(absbit[BIT_WORD(ABS_X)] & BIT_MASK(ABS_X)) ||
 	    !(absbit[BIT_WORD(ABS_Y)] & BIT_MASK(ABS_Y))) {
 		if (!(absbit[BIT_WORD(ABS_MT_POSITION_X)] & BIT_MASK(ABS_MT_POSITION_X)) ||
@@ -263,7 +371,7 @@ static int check_fd(struct tslib_input *i)
 		i->mt = 1;
 
 	if (evbit[BIT_WORD(EV_KEY)] & BIT_MASK(EV_KEY)) {
-		if (ioctl(ts->fd, EVIOCGBIT(EV_KEY, sizeof(keybit)), keybit) < 0) {
+		if (input_ioctl(i, EVIOCGBIT(EV_KEY, sizeof(i->keybit)), keybit) < 0) {
 			fprintf(stderr, "tslib: ioctl EVIOCGBIT error)\n");
 			return -1;
 		}
@@ -308,7 +416,7 @@ static int check_fd(struct tslib_input *i)
 	}
 #endif
 
-	if ((ioctl(ts->fd, EVIOCGBIT(EV_SYN, sizeof(synbit)), synbit)) == -1)
+	if ((input_ioctl(i, EVIOCGBIT(EV_SYN, sizeof(synbit)), synbit)) == -1)
 		fprintf(stderr, "tslib: ioctl error\n");
 
 	/* remember whether we have a multitouch type A device */
@@ -322,7 +430,7 @@ static int check_fd(struct tslib_input *i)
 	}
 
 	if (i->grab_events == GRAB_EVENTS_WANTED) {
-		if (ioctl(ts->fd, EVIOCGRAB, (void *)1)) {
+		if (input_ioctl(i, EVIOCGRAB, (void *)1)) {
 			fprintf(stderr,
 				"tslib: Unable to grab selected input device\n");
 			return -1;
@@ -336,48 +444,200 @@ static int check_fd(struct tslib_input *i)
 		return -1;
 	}
 
+	set_mask(i);
+
 	return ts->fd;
 }
 
+/* Hand out the next buffered event. Only if the buffer is used up we read(),
+ * taking as many events as the kernel has queued for us. Returns 0 on
+ * success or a negative error code, for example -EAGAIN for non-blocking
+ * devices without data.
+ */
+static int get_event(struct tslib_input *i, struct input_event **ev)
+{
+	ssize_t rd;
+
+	if (i->ev_head == i->ev_count) {
+		i->ev_head = 0;
+		i->ev_count = 0;
+
+		rd = input_read(i, i->ev, sizeof(i->ev));
+		if (rd == -1)
+			return errno > 0 ? -errno : -1;
+
+		if (rd < (ssize_t)sizeof(struct input_event))
+			return -1;
+
+		i->ev_count = rd / sizeof(struct input_event);
+	}
+
+	*ev = &i->ev[i->ev_head++];
+	TS_TRACE3(raw_event, (*ev)->type, (*ev)->code, (*ev)->value);
+
+	return 0;
+}
+
+/*
+ * SYN_DROPPED: the kernel's buffer overran and events were lost. What we
+ * got since the last SYN_REPORT is incomplete, and so is everything up to
+ * the next one. We skip that, and then ask the device for its state; see
+ * Documentation/input/event-codes.rst in the kernel.
+ */
+static void syn_dropped(struct tslib_input *i)
+{
+	struct tsdev *ts = i->module.dev;
+
+	i->dropped = 1;
+	__atomic_add_fetch(&ts->syn_dropped, 1, __ATOMIC_RELAXED);
+	TS_TRACE0(syn_dropped);
+#ifdef DEBUG
+	fprintf(stderr, "INPUT-RAW: SYN_DROPPED\n");
+#endif
+}
+
+/* the current value of an axis, if the device has it */
+static int get_abs(struct tslib_input *i, unsigned int code, int *value)
+{
+	struct input_absinfo abs;
+
+	if (!(i->absbit[BIT_WORD(code)] & BIT_MASK(code)))
+		return -1;
+
+	if (input_ioctl(i, EVIOCGABS(code), &abs) < 0)
+		return -1;
+
+	*value = abs.value;
+
+	return 0;
+}
+
+/* 1 if BTN_TOUCH or BTN_LEFT is down, 0 if not, -1 if we can't tell */
+static int get_touch(struct tslib_input *i)
+{
+	long keys[BITS_TO_LONGS(KEY_CNT)];
+
+	if (!(i->keybit[BIT_WORD(BTN_TOUCH)] & BIT_MASK(BTN_TOUCH)) &&
+	    !(i->keybit[BIT_WORD(BTN_LEFT)] & BIT_MASK(BTN_LEFT)))
+		return -1;
+
+	if (input_ioctl(i, EVIOCGKEY(sizeof(keys)), keys) < 0)
+		return -1;
+
+	return (keys[BIT_WORD(BTN_TOUCH)] & BIT_MASK(BTN_TOUCH)) ||
+	       (keys[BIT_WORD(BTN_LEFT)] & BIT_MASK(BTN_LEFT));
+}
+
+/* the single touch sample after SYN_DROPPED */
+static void resync(struct tslib_input *i, int *pen_up)
+{
+	int touch;
+
+	get_abs(i, ABS_X, &i->current_x);
+	get_abs(i, ABS_Y, &i->current_y);
+	if (!i->no_pressure)
+		get_abs(i, ABS_PRESSURE, &i->current_p);
+
+	touch = get_touch(i);
+	if (touch >= 0)
+		*pen_up = !touch;
+}
+
+/*
+ * Have the kernel stamp the events in the clock of TS_CLOCK. When it
+ * switches, it drops what it had queued and sends SYN_DROPPED, so we drop
+ * what we buffered too; it's stamped in the old clock.
+ */
+static void set_clock(struct tslib_input *i)
+{
+	struct tsdev *ts = i->module.dev;
+	int clk = ts->clock;
+	int ret = -1;
+
+#ifdef EVIOCSCLOCKID
+	ret = input_ioctl(i, EVIOCSCLOCKID, &clk);
+#endif
+	if (ret < 0 && clk != CLOCK_REALTIME) {
+		fprintf(stderr,
+			"tslib: Unable to set the clock of the input device, timestamps stay in CLOCK_REALTIME\n");
+		ts->clock = CLOCK_REALTIME;
+	}
+
+	if (ret == 0 && i->clock != -1) {
+		i->ev_head = 0;
+		i->ev_count = 0;
+	}
+
+	i->clock = ts->clock;
+}
+
+static void check_fd_change(struct tslib_input *i)
+{
+	struct tsdev *ts = i->module.dev;
+
+	if (ts->fd != i->last_fd) {
+		/* buffered events belong to the old device */
+		i->ev_head = 0;
+		i->ev_count = 0;
+
+		i->last_fd = check_fd(i);
+		i->clock = -1;
+	}
+
+	if (i->last_fd != -1 && i->clock != ts->clock)
+		set_clock(i);
+}
+
 static int ts_input_read(struct tslib_module_info *inf,
 			 struct ts_sample *samp, int nr)
 {
 	struct tslib_input *i = (struct tslib_input *)inf;
-	struct tsdev *ts = inf->dev;
-	struct input_event ev;
+	struct input_event *ev;
 	int ret = nr;
 	int total = 0;
 	int pen_up = 0;
 
-	if (ts->fd != i->last_fd)
-		i->last_fd = check_fd(i);
+	check_fd_change(i);
 
 	if (i->last_fd == -1)
 		return -ENODEV;
 
+	/* see the comment in check_fd() */
 	if (i->no_pressure)
-		set_pressure(i);
+		i->current_p = 255;
 
 	if (i->using_syn) {
 		while (total < nr) {
-			ret = read(ts->fd, &ev, sizeof(struct input_event));
-			if (ret < (int)sizeof(struct input_event)) {
-				total = -1;
+			ret = get_event(i, &ev);
+			if (ret < 0) {
+				/* don't lose what we already have */
+				if (total == 0)
+					total = ret;
 				break;
 			}
 
-			switch (ev.type) {
+			/* see syn_dropped() */
+			if (i->dropped &&
+			    (ev->type != EV_SYN || ev->code == SYN_MT_REPORT))
+				continue;
+
+			switch (ev->type) {
 			case EV_KEY:
-				switch (ev.code) {
+				switch (ev->code) {
 				case BTN_TOUCH:
 				case BTN_LEFT:
-					if (ev.value == 0)
+					if (ev->value == 0)
 						pen_up = 1;
 					break;
 				}
 				break;
 			case EV_SYN:
-				if (ev.code == SYN_REPORT) {
+				if (ev->code == SYN_REPORT) {
+					if (i->dropped) {
+						i->dropped = 0;
+						resync(i, &pen_up);
+					}
+
 					/* Fill out a new complete event */
 					if (pen_up) {
 						samp->x = 0;
@@ -389,8 +649,10 @@ static int ts_input_read(struct tslib_module_info *inf,
 						samp->y = i->current_y;
 						samp->pressure = i->current_p;
 					}
-					samp->tv.tv_sec = ev.input_event_sec;
-					samp->tv.tv_usec = ev.input_event_usec;
+					samp->tv.tv_sec = ev->input_event_sec;
+					samp->tv.tv_usec = ev->input_event_usec;
+					TS_TRACE3(frame, total, samp->tv.tv_sec,
+						  samp->tv.tv_usec);
 			#ifdef DEBUG
 				fprintf(stderr,
 					"RAW---------------------> %d %d %d %lld.%06lld\n",
@@ -400,7 +662,7 @@ static int ts_input_read(struct tslib_module_info *inf,
 			#endif /* DEBUG */
 					samp++;
 					total++;
-				} else if (ev.code == SYN_MT_REPORT) {
+				} else if (ev->code == SYN_MT_REPORT) {
 					if (!i->type_a)
 						break;
 
@@ -410,60 +672,57 @@ static int ts_input_read(struct tslib_module_info *inf,
 					} else {
 						i->type_a = 1;
 					}
-			#ifdef DEBUG
-				} else if (ev.code == SYN_DROPPED) {
-					fprintf(stderr,
-						"INPUT-RAW: SYN_DROPPED\n");
-			#endif
+				} else if (ev->code == SYN_DROPPED) {
+					syn_dropped(i);
 				}
 				break;
 			case EV_ABS:
 				if (i->special_device == EGALAX_VERSION_210) {
-					switch (ev.code) {
+					switch (ev->code) {
 					case ABS_X:
-						i->current_x = ev.value;
+						i->current_x = ev->value;
 						break;
 					case ABS_Y:
-						i->current_y = ev.value;
+						i->current_y = ev->value;
 						break;
 					case ABS_PRESSURE:
-						i->current_p = ev.value;
+						i->current_p = ev->value;
 						break;
 					case ABS_MT_DISTANCE:
-						if (ev.value > 0)
+						if (ev->value > 0)
 							i->current_p = 0;
 						else
 							i->current_p = 255;
 						break;
 					}
 				} else {
-					switch (ev.code) {
+					switch (ev->code) {
 					case ABS_X:
-						i->current_x = ev.value;
+						i->current_x = ev->value;
 						break;
 					case ABS_Y:
-						i->current_y = ev.value;
+						i->current_y = ev->value;
 						break;
 					case ABS_MT_POSITION_X:
-						i->current_x = ev.value;
+						i->current_x = ev->value;
 						i->type_a++;
 						break;
 					case ABS_MT_POSITION_Y:
-						i->current_y = ev.value;
+						i->current_y = ev->value;
 						i->type_a++;
 						break;
 					case ABS_PRESSURE:
-						i->current_p = ev.value;
+						i->current_p = ev->value;
 						break;
 					case ABS_MT_PRESSURE:
-						i->current_p = ev.value;
+						i->current_p = ev->value;
 						break;
 					case ABS_MT_TOUCH_MAJOR:
-						if (ev.value == 0)
+						if (ev->value == 0)
 							i->current_p = 0;
 						break;
 					case ABS_MT_TRACKING_ID:
-						if (ev.value == -1)
+						if (ev->value == -1)
 							i->current_p = 0;
 						break;
 					}
@@ -473,33 +732,18 @@ static int ts_input_read(struct tslib_module_info *inf,
 		}
 		ret = total;
 	} else {
-		unsigned char *p = (unsigned char *) &ev;
-		int len = sizeof(struct input_event);
-
 		while (total < nr) {
-			ret = read(ts->fd, p, len);
-			if (ret == -1) {
-				if (errno == EINTR)
-					continue;
-
-				break;
-			}
-
-			if (ret < (int)sizeof(struct input_event)) {
-				/* short read
-				 * restart read to get the rest of the event
-				 */
-				p += ret;
-				len -= ret;
+			ret = get_event(i, &ev);
+			if (ret == -EINTR)
 				continue;
-			}
-			/* successful read of a whole event */
+			if (ret < 0)
+				break;
 
-			if (ev.type == EV_ABS) {
-				switch (ev.code) {
+			if (ev->type == EV_ABS) {
+				switch (ev->code) {
 				case ABS_X:
-					if (ev.value != 0) {
-						samp->x = i->current_x = ev.value;
+					if (ev->value != 0) {
+						samp->x = i->current_x = ev->value;
 						samp->y = i->current_y;
 						samp->pressure = i->current_p;
 					} else {
@@ -509,9 +753,9 @@ static int ts_input_read(struct tslib_module_info *inf,
 					}
 					break;
 				case ABS_Y:
-					if (ev.value != 0) {
+					if (ev->value != 0) {
 						samp->x = i->current_x;
-						samp->y = i->current_y = ev.value;
+						samp->y = i->current_y = ev->value;
 						samp->pressure = i->current_p;
 					} else {
 						fprintf(stderr,
@@ -522,11 +766,11 @@ static int ts_input_read(struct tslib_module_info *inf,
 				case ABS_PRESSURE:
 					samp->x = i->current_x;
 					samp->y = i->current_y;
-					samp->pressure = i->current_p = ev.value;
+					samp->pressure = i->current_p = ev->value;
 					break;
 				}
-				samp->tv.tv_sec = ev.input_event_sec;
-				samp->tv.tv_usec = ev.input_event_usec;
+				samp->tv.tv_sec = ev->input_event_sec;
+				samp->tv.tv_usec = ev->input_event_usec;
 	#ifdef DEBUG
 				fprintf(stderr,
 					"RAW---------------------------> %d %d %d\n",
@@ -534,17 +778,17 @@ static int ts_input_read(struct tslib_module_info *inf,
 	#endif /* DEBUG */
 				samp++;
 				total++;
-			} else if (ev.type == EV_KEY) {
-				switch (ev.code) {
+			} else if (ev->type == EV_KEY) {
+				switch (ev->code) {
 				case BTN_TOUCH:
 				case BTN_LEFT:
-					if (ev.value == 0) {
+					if (ev->value == 0) {
 						/* pen up */
 						samp->x = 0;
 						samp->y = 0;
 						samp->pressure = 0;
-						samp->tv.tv_sec = ev.input_event_sec;
-						samp->tv.tv_usec = ev.input_event_usec;
+						samp->tv.tv_sec = ev->input_event_sec;
+						samp->tv.tv_usec = ev->input_event_usec;
 						samp++;
 						total++;
 					}
@@ -553,9 +797,8 @@ static int ts_input_read(struct tslib_module_info *inf,
 			} else {
 				fprintf(stderr,
 					"tslib: Unknown event type %d\n",
-					ev.type);
+					ev->type);
 			}
-			p = (unsigned char *) &ev;
 		}
 		ret = total;
 	}
@@ -563,329 +806,482 @@ static int ts_input_read(struct tslib_module_info *inf,
 	return ret;
 }
 
-static int ts_input_read_mt(struct tslib_module_info *inf,
-			    struct ts_sample_mt **samp, int max_slots, int nr)
+static int alloc_slots(struct tslib_input *i, int max_slots)
 {
-	struct tslib_input *i = (struct tslib_input *)inf;
-	struct tsdev *ts = inf->dev;
-	int ret = nr;
-	int total = 0;
-	unsigned int it;
-	int rd;
-	int j, k;
-	uint8_t pen_up = 0;
-	static int32_t next_trackid;
+	struct ts_sample_mt *buf;
+	int *dirty;
+	int32_t *last_pressure;
+	int32_t *values;
+	int k;
+
+	buf = realloc(i->buf, (max_slots + 1) * sizeof(struct ts_sample_mt));
+	if (!buf)
+		return -ENOMEM;
+	i->buf = buf;
+
+	dirty = realloc(i->dirty, max_slots * sizeof(int));
+	if (!dirty)
+		return -ENOMEM;
+	i->dirty = dirty;
+
+	last_pressure = realloc(i->last_pressure, max_slots * sizeof(int32_t));
+	if (!last_pressure)
+		return -ENOMEM;
+	i->last_pressure = last_pressure;
+
+	for (k = i->max_slots; k < max_slots; k++)
+		i->last_pressure[k] = 0;
+
+	/* the event code, then a value per slot */
+	values = realloc(i->values, (max_slots + 1) * sizeof(int32_t));
+	if (!values)
+		return -ENOMEM;
+	i->values = values;
+
+	/* the spare entry moves up too, it's always just reset */
+	for (k = i->max_slots; k <= max_slots; k++) {
+		memset(&i->buf[k], 0, sizeof(struct ts_sample_mt));
+		i->buf[k].slot = k;
+		i->buf[k].pen_down = -1;
+	}
 
-	if (ts->fd != i->last_fd)
-		i->last_fd = check_fd(i);
+	i->max_slots = max_slots;
 
-	if (i->last_fd == -1)
-		return -ENODEV;
+	return 0;
+}
 
-	if (i->buf == NULL || i->max_slots < max_slots || i->nr < nr) {
-		if (i->buf) {
-			for (j = 0; j < i->nr; j++)
-				free(i->buf[j]);
+/* Return the state of a slot we are about to write to. The first write
+ * to a slot in a frame puts it on the dirty list.
+ */
+static struct ts_sample_mt *get_slot(struct tslib_input *i, int slot,
+				     int max_slots)
+{
+	struct ts_sample_mt *s;
+
+	if (slot < 0 || slot >= max_slots)
+		return &i->buf[i->max_slots];
+
+	s = &i->buf[slot];
+	if (!(s->valid & TSLIB_MT_VALID)) {
+		s->valid |= TSLIB_MT_VALID;
+		/* see the comment in check_fd() */
+		if (i->no_pressure)
+			s->pressure = 255;
+
+		i->dirty[i->nr_dirty++] = slot;
+	}
+
+	return s;
+}
 
-			free(i->buf);
+static int slot_has_data(struct tslib_input *i, int max_slots)
+{
+	return i->slot < max_slots && i->buf[i->slot].valid & TSLIB_MT_VALID;
+}
+
+/* what EVIOCGMTSLOTS tells us about every slot after SYN_DROPPED */
+static const struct {
+	unsigned int code;
+	size_t offset;
+} mt_values[] = {
+	{ ABS_MT_POSITION_X,	offsetof(struct ts_sample_mt, x) },
+	{ ABS_MT_POSITION_Y,	offsetof(struct ts_sample_mt, y) },
+	{ ABS_MT_PRESSURE,	offsetof(struct ts_sample_mt, pressure) },
+	{ ABS_MT_TOOL_TYPE,	offsetof(struct ts_sample_mt, tool_type) },
+	{ ABS_MT_TOOL_X,	offsetof(struct ts_sample_mt, tool_x) },
+	{ ABS_MT_TOOL_Y,	offsetof(struct ts_sample_mt, tool_y) },
+	{ ABS_MT_TOUCH_MAJOR,	offsetof(struct ts_sample_mt, touch_major) },
+	{ ABS_MT_WIDTH_MAJOR,	offsetof(struct ts_sample_mt, width_major) },
+	{ ABS_MT_TOUCH_MINOR,	offsetof(struct ts_sample_mt, touch_minor) },
+	{ ABS_MT_WIDTH_MINOR,	offsetof(struct ts_sample_mt, width_minor) },
+	{ ABS_MT_ORIENTATION,	offsetof(struct ts_sample_mt, orientation) },
+	{ ABS_MT_DISTANCE,	offsetof(struct ts_sample_mt, distance) },
+	{ ABS_MT_BLOB_ID,	offsetof(struct ts_sample_mt, blob_id) },
+};
+
+#define NR_MT_VALUES (sizeof(mt_values) / sizeof(mt_values[0]))
+
+/*
+ * The frame after SYN_DROPPED: every contact as the device has it now, and
+ * a pen-up for every one that vanished meanwhile. Returns the number of
+ * slots in it. Type A devices list all their contacts in every frame, so
+ * for them we just drop this one.
+ */
+static int resync_mt(struct tslib_input *i, int max_slots,
+		     const struct input_event *ev)
+{
+	struct ts_sample_mt *s;
+	unsigned int n;
+	int touch;
+	int k;
+
+	/* forget what we got of the frame the events were lost from */
+	for (k = 0; k < i->nr_dirty; k++) {
+		s = &i->buf[i->dirty[k]];
+		s->valid = 0;
+		s->pen_down = -1;
+	}
+	i->nr_dirty = 0;
+	i->pen_up = 0;
+
+	if (i->type_a) {
+		i->slot = 0;
+		return 0;
+	}
+
+	if (!(i->absbit[BIT_WORD(ABS_MT_SLOT)] & BIT_MASK(ABS_MT_SLOT))) {
+		/* single touch */
+		s = get_slot(i, i->slot, max_slots);
+		get_abs(i, ABS_X, &s->x);
+		get_abs(i, ABS_Y, &s->y);
+		if (!i->no_pressure)
+			get_abs(i, ABS_PRESSURE, (int *)&s->pressure);
+
+		touch = get_touch(i);
+		if (touch >= 0) {
+			s->pen_down = touch;
+			if (!touch)
+				i->pen_up = 1;
 		}
+	} else {
+		if (get_abs(i, ABS_MT_SLOT, &k) == 0 && k >= 0 && k < max_slots)
+			i->slot = k;
 
-		i->buf = malloc(nr * sizeof(struct ts_sample_mt *));
-		if (!i->buf)
-			return -ENOMEM;
+		i->values[0] = ABS_MT_TRACKING_ID;
+		for (k = 1; k <= max_slots; k++)
+			i->values[k] = -1;
 
-		for (j = 0; j < nr; j++) {
-			i->buf[j] = calloc(max_slots,
-					   sizeof(struct ts_sample_mt));
-			if (!i->buf[j])
-				return -ENOMEM;
+		if (input_ioctl(i, EVIOCGMTSLOTS((max_slots + 1) * sizeof(int32_t)),
+			  i->values) < 0)
+			return 0;
+
+		for (k = 0; k < max_slots; k++) {
+			if (i->values[k + 1] == -1 && !i->last_pressure[k]) {
+				i->buf[k].tracking_id = -1;
+				continue;
+			}
+
+			s = get_slot(i, k, max_slots);
+			s->slot = k;
+			s->tracking_id = i->values[k + 1];
+			if (s->tracking_id == -1)
+				s->pressure = 0;
 		}
 
-		i->max_slots = max_slots;
-		i->nr = nr;
+		for (n = 0; n < NR_MT_VALUES; n++) {
+			if (!(i->absbit[BIT_WORD(mt_values[n].code)] &
+			      BIT_MASK(mt_values[n].code)))
+				continue;
 
-		if (i->type_a) {
-			i->last_pressure = calloc(max_slots, sizeof(int32_t));
-			if (!i->last_pressure) {
-				for (j = 0; j < nr; j++)
-					free(i->buf[j]);
+			i->values[0] = mt_values[n].code;
+			if (input_ioctl(i,
+				  EVIOCGMTSLOTS((max_slots + 1) * sizeof(int32_t)),
+				  i->values) < 0)
+				continue;
+
+			for (k = 0; k < i->nr_dirty; k++) {
+				s = &i->buf[i->dirty[k]];
+				if (s->tracking_id == -1)
+					continue;
 
-				return -ENOMEM;
+				*(int *)((char *)s + mt_values[n].offset) =
+					i->values[i->dirty[k] + 1];
 			}
 		}
 	}
 
-	if (i->no_pressure)
-		set_pressure(i);
+	for (k = 0; k < i->nr_dirty; k++) {
+		s = &i->buf[i->dirty[k]];
+		s->tv.tv_sec = ev->input_event_sec;
+		s->tv.tv_usec = ev->input_event_usec;
+	}
 
-	for (j = 0; j < nr; j++) {
-		for (k = 0; k < max_slots; k++) {
-			i->buf[j][k].valid = 0;
-			i->buf[j][k].pen_down = -1;
-		}
+	return i->nr_dirty;
+}
+
+static int ts_input_read_mt(struct tslib_module_info *inf,
+			    struct ts_sample_mt **samp, int max_slots, int nr)
+{
+	struct tslib_input *i = (struct tslib_input *)inf;
+	struct input_event *ev;
+	struct ts_sample_mt *s;
+	int total = 0;
+	int rd;
+	int k;
+
+	check_fd_change(i);
+
+	if (i->last_fd == -1)
+		return -ENODEV;
+
+	if (i->buf == NULL || i->max_slots < max_slots) {
+		rd = alloc_slots(i, max_slots);
+		if (rd < 0)
+			return rd;
 	}
 
 	while (total < nr) {
-		memset(i->ev, 0, sizeof(i->ev));
-		rd = read(ts->fd,
-			  i->ev,
-			  sizeof(struct input_event) * NUM_EVENTS_READ);
-		if (rd == -1) {
-			if (total == 0) {
-				if (errno > 0)
-					return errno * -1;
-				else
-					return errno;
-			} else {
-				return total;
-			}
-		} else if (rd < (int) sizeof(struct input_event)) {
+		rd = get_event(i, &ev);
+		if (rd < 0) {
 			if (total == 0)
-				return -1;
+				return rd;
 			else
 				return total;
 		}
 
-		for (it = 0; it < rd / sizeof(struct input_event); it++) {
-		#ifdef DEBUG
-			printf("INPUT-RAW: read type %d  code %3d  value %4d  time %lld.%06lld\n",
-			       i->ev[it].type, i->ev[it].code,
-			       i->ev[it].value, (long long)i->ev[it].input_event_sec,
-			       (long long)i->ev[it].input_event_usec);
-		#endif
-			switch (i->ev[it].type) {
-			case EV_KEY:
-				switch (i->ev[it].code) {
-				case BTN_TOUCH:
-					i->buf[total][i->slot].pen_down = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					if (i->ev[it].value == 0)
-						pen_up = 1;
+	#ifdef DEBUG
+		printf("INPUT-RAW: read type %d  code %3d  value %4d  time %lld.%06lld\n",
+		       ev->type, ev->code,
+		       ev->value, (long long)ev->input_event_sec,
+		       (long long)ev->input_event_usec);
+	#endif
+		/* see syn_dropped() */
+		if (i->dropped &&
+		    (ev->type != EV_SYN || ev->code == SYN_MT_REPORT))
+			continue;
+
+		switch (ev->type) {
+		case EV_KEY:
+			switch (ev->code) {
+			case BTN_TOUCH:
+				s = get_slot(i, i->slot, max_slots);
+				s->pen_down = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				if (ev->value == 0)
+					i->pen_up = 1;
 
-					break;
-				}
 				break;
-			case EV_SYN:
-				switch (i->ev[it].code) {
-				case SYN_REPORT:
-					if (pen_up && i->no_pressure) {
-						for (k = 0; k < max_slots; k++) {
-							i->buf[total][k].pressure = 0;
-						}
-					}
+			}
+			break;
+		case EV_SYN:
+			switch (ev->code) {
+			case SYN_REPORT:
+				if (i->dropped) {
+					i->dropped = 0;
+					if (resync_mt(i, max_slots, ev) == 0)
+						break;
+				}
+
+				if (i->pen_up && i->no_pressure) {
+					for (k = 0; k < i->nr_dirty; k++)
+						i->buf[i->dirty[k]].pressure = 0;
+				}
 
-					/* subtract last SYN_MT_REPORT to have the slot index */
-					if (i->type_a && i->slot)
-						i->slot--;
+				/* subtract last SYN_MT_REPORT to have the slot index */
+				if (i->type_a && i->slot)
+					i->slot--;
 
-					if (i->slot >= max_slots) {
-						fprintf(stderr, "Critical internal error\n");
-						return -1;
-					}
+				if (i->slot >= max_slots) {
+					fprintf(stderr, "Critical internal error\n");
+					return -1;
+				}
 
-					if (i->type_a && i->slot < i->last_type_a_slots) {
-						for (k = 0; k < max_slots; k++) {
-							if (k < i->last_type_a_slots)
-								continue;
-
-							/* remember / generate other pen-ups */
-							i->buf[total][k].pressure = 0;
-							i->buf[total][k].tracking_id = -1;
-							i->last_pressure[k] = 0;
-							i->buf[total][k].valid |= TSLIB_MT_VALID;
-						}
+				if (i->type_a && i->slot < i->last_type_a_slots) {
+					for (k = i->last_type_a_slots; k < max_slots; k++) {
+						/* remember / generate other pen-ups */
+						s = get_slot(i, k, max_slots);
+						s->pressure = 0;
+						s->tracking_id = -1;
+						i->last_pressure[k] = 0;
 					}
-					i->last_type_a_slots = i->slot;
+				}
+				i->last_type_a_slots = i->slot;
 
-					/* FIXME this pen_up is deprecated in MT */
-					if (pen_up)
-						pen_up = 0;
+				/* FIXME this pen_up is deprecated in MT */
+				i->pen_up = 0;
 
-					for (j = 0; j < nr; j++) {
-						for (k = 0; k < max_slots; k++) {
-							memcpy(&samp[j][k],
-								&i->buf[j][k],
-								sizeof(struct ts_sample_mt));
-						}
-					}
+				/* the frame is complete. hand out what changed */
+				for (k = 0; k < max_slots; k++)
+					samp[total][k].valid = 0;
 
-					if (i->type_a)
-						i->slot = 0;
+				for (k = 0; k < i->nr_dirty; k++) {
+					s = &i->buf[i->dirty[k]];
+					memcpy(&samp[total][i->dirty[k]], s,
+					       sizeof(struct ts_sample_mt));
+					s->valid = 0;
+					s->pen_down = -1;
 
-					total++;
-					break;
-				case SYN_MT_REPORT:
+					/* type A keeps track itself */
 					if (!i->type_a)
-						break;
+						i->last_pressure[i->dirty[k]] =
+							s->tracking_id != -1;
+				}
+				i->nr_dirty = 0;
+				TS_TRACE3(frame, total, ev->input_event_sec,
+					  ev->input_event_usec);
 
-					i->buf[total][i->slot].slot = i->slot;
+				if (i->type_a)
+					i->slot = 0;
+
+				total++;
+				break;
+			case SYN_MT_REPORT:
+				if (!i->type_a)
+					break;
 
-					if (i->buf[total][i->slot].valid < 1) {
+				if (i->slot < max_slots) {
+					if (!slot_has_data(i, max_slots)) {
 						/* SYN_MT_REPORT only is pen-up */
-						i->buf[total][i->slot].pressure = 0;
-						i->buf[total][i->slot].tracking_id = -1;
+						s = get_slot(i, i->slot, max_slots);
+						s->pressure = 0;
+						s->tracking_id = -1;
 						i->last_pressure[i->slot] = 0;
 					} else if (i->last_pressure[i->slot] == 0) {
 						/* new contact. generate a tracking id */
-						i->buf[total][i->slot].tracking_id = ++next_trackid;
+						s = get_slot(i, i->slot, max_slots);
+						s->tracking_id = ++i->next_trackid;
 						i->last_pressure[i->slot] = 1;
+					} else {
+						s = get_slot(i, i->slot, max_slots);
 					}
+					s->slot = i->slot;
 
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-
-					if (i->slot < max_slots)
-						i->slot++;
-
-					break;
-			#ifdef DEBUG
-				case SYN_DROPPED:
-					fprintf(stderr,
-						"INPUT-RAW: SYN_DROPPED\n");
-					break;
-			#endif
+					i->slot++;
 				}
+
 				break;
-			case EV_ABS:
-				switch (i->ev[it].code) {
-				case ABS_X:
-					/* in case we didn't already get data for this
-					 * slot, we go ahead and act as if this would be
-					 * ABS_MT_POSITION_X
-					 */
-					if (i->mt && i->buf[total][i->slot].valid & TSLIB_MT_VALID)
-						break;
-					// fall through
-				case ABS_MT_POSITION_X:
-					i->buf[total][i->slot].x = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					break;
-				case ABS_Y:
-					if (i->mt && i->buf[total][i->slot].valid & TSLIB_MT_VALID)
-						break;
-					// fall through
-				case ABS_MT_POSITION_Y:
-					i->buf[total][i->slot].y = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					break;
-				case ABS_PRESSURE:
-					if (i->mt && i->buf[total][i->slot].valid & TSLIB_MT_VALID)
-						break;
-					// fall through
-				case ABS_MT_PRESSURE:
-					i->buf[total][i->slot].pressure = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					break;
-				case ABS_MT_TOOL_X:
-					i->buf[total][i->slot].tool_x = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					/* for future use
-					 * i->buf[total][i->slot].valid |= TSLIB_MT_VALID_TOOL;
-					 */
-					break;
-				case ABS_MT_TOOL_Y:
-					i->buf[total][i->slot].tool_y = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					/* for future use
-					 * i->buf[total][i->slot].valid |= TSLIB_MT_VALID_TOOL;
-					 */
+			case SYN_DROPPED:
+				syn_dropped(i);
+				break;
+			}
+			break;
+		case EV_ABS:
+			switch (ev->code) {
+			case ABS_X:
+				/* in case we didn't already get data for this
+				 * slot, we go ahead and act as if this would be
+				 * ABS_MT_POSITION_X
+				 */
+				if (i->mt && slot_has_data(i, max_slots))
 					break;
-				case ABS_MT_TOOL_TYPE:
-					i->buf[total][i->slot].tool_type = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					/* for future use
-					 * i->buf[total][i->slot].valid |= TSLIB_MT_VALID_TOOL;
-					 */
+				// fall through
+			case ABS_MT_POSITION_X:
+				s = get_slot(i, i->slot, max_slots);
+				s->x = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				break;
+			case ABS_Y:
+				if (i->mt && slot_has_data(i, max_slots))
 					break;
-				case ABS_MT_ORIENTATION:
-					i->buf[total][i->slot].orientation = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
+				// fall through
+			case ABS_MT_POSITION_Y:
+				s = get_slot(i, i->slot, max_slots);
+				s->y = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				break;
+			case ABS_PRESSURE:
+				if (i->mt && slot_has_data(i, max_slots))
 					break;
-				case ABS_MT_DISTANCE:
-					i->buf[total][i->slot].distance = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-
-					if (i->special_device == EGALAX_VERSION_210) {
-						if (i->ev[it].value > 0)
-							i->buf[total][i->slot].pressure = 0;
-						else
-							i->buf[total][i->slot].pressure = 255;
-					}
+				// fall through
+			case ABS_MT_PRESSURE:
+				s = get_slot(i, i->slot, max_slots);
+				s->pressure = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				break;
+			case ABS_MT_TOOL_X:
+				s = get_slot(i, i->slot, max_slots);
+				s->tool_x = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				/* for future use
+				 * s->valid |= TSLIB_MT_VALID_TOOL;
+				 */
+				break;
+			case ABS_MT_TOOL_Y:
+				s = get_slot(i, i->slot, max_slots);
+				s->tool_y = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				/* for future use
+				 * s->valid |= TSLIB_MT_VALID_TOOL;
+				 */
+				break;
+			case ABS_MT_TOOL_TYPE:
+				s = get_slot(i, i->slot, max_slots);
+				s->tool_type = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				/* for future use
+				 * s->valid |= TSLIB_MT_VALID_TOOL;
+				 */
+				break;
+			case ABS_MT_ORIENTATION:
+				s = get_slot(i, i->slot, max_slots);
+				s->orientation = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				break;
+			case ABS_MT_DISTANCE:
+				s = get_slot(i, i->slot, max_slots);
+				s->distance = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
 
-					break;
-				case ABS_MT_BLOB_ID:
-					i->buf[total][i->slot].blob_id = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					break;
-				case ABS_MT_TOUCH_MAJOR:
-					i->buf[total][i->slot].touch_major = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					if (i->ev[it].value == 0)
-						i->buf[total][i->slot].pressure = 0;
-					break;
-				case ABS_MT_WIDTH_MAJOR:
-					i->buf[total][i->slot].width_major = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					break;
-				case ABS_MT_TOUCH_MINOR:
-					i->buf[total][i->slot].touch_minor = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					break;
-				case ABS_MT_WIDTH_MINOR:
-					i->buf[total][i->slot].width_minor = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					break;
-				case ABS_MT_TRACKING_ID:
-					i->buf[total][i->slot].tracking_id = i->ev[it].value;
-					i->buf[total][i->slot].tv.tv_sec = i->ev[it].input_event_sec;
-					i->buf[total][i->slot].tv.tv_usec = i->ev[it].input_event_usec;
-					i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					if (i->ev[it].value == -1)
-						i->buf[total][i->slot].pressure = 0;
-					break;
-				case ABS_MT_SLOT:
-					if (i->ev[it].value < 0 || i->ev[it].value >= max_slots) {
-						fprintf(stderr, "tslib: warning: slot out of range. data corrupted!\n");
-						i->slot = max_slots - 1;
-					} else {
-						i->slot = i->ev[it].value;
-						i->buf[total][i->slot].slot = i->ev[it].value;
-						i->buf[total][i->slot].valid |= TSLIB_MT_VALID;
-					}
-					break;
+				if (i->special_device == EGALAX_VERSION_210) {
+					if (ev->value > 0)
+						s->pressure = 0;
+					else
+						s->pressure = 255;
 				}
+
 				break;
-			}
-			if (total == ret)
+			case ABS_MT_BLOB_ID:
+				s = get_slot(i, i->slot, max_slots);
+				s->blob_id = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
 				break;
-		} /* just NUM_EVENTS_READ. it's simply 1 */
+			case ABS_MT_TOUCH_MAJOR:
+				s = get_slot(i, i->slot, max_slots);
+				s->touch_major = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				if (ev->value == 0)
+					s->pressure = 0;
+				break;
+			case ABS_MT_WIDTH_MAJOR:
+				s = get_slot(i, i->slot, max_slots);
+				s->width_major = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				break;
+			case ABS_MT_TOUCH_MINOR:
+				s = get_slot(i, i->slot, max_slots);
+				s->touch_minor = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				break;
+			case ABS_MT_WIDTH_MINOR:
+				s = get_slot(i, i->slot, max_slots);
+				s->width_minor = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				break;
+			case ABS_MT_TRACKING_ID:
+				s = get_slot(i, i->slot, max_slots);
+				s->tracking_id = ev->value;
+				s->tv.tv_sec = ev->input_event_sec;
+				s->tv.tv_usec = ev->input_event_usec;
+				if (ev->value == -1)
+					s->pressure = 0;
+				break;
+			case ABS_MT_SLOT:
+				if (ev->value < 0 || ev->value >= max_slots) {
+					fprintf(stderr, "tslib: warning: slot out of range. data corrupted!\n");
+					i->slot = max_slots - 1;
+				} else {
+					i->slot = ev->value;
+					s = get_slot(i, i->slot, max_slots);
+					s->slot = ev->value;
+				}
+				break;
+			}
+			break;
+		}
 	}
 
 	return total;
@@ -894,19 +1290,19 @@ static int ts_input_read_mt(struct tslib_module_info *inf,
 static int ts_input_fini(struct tslib_module_info *inf)
 {
 	struct tslib_input *i = (struct tslib_input *)inf;
-	struct tsdev *ts = inf->dev;
-	int j;
 
 	if (i->grab_events == GRAB_EVENTS_ACTIVE) {
-		if (ioctl(ts->fd, EVIOCGRAB, (void *)0))
+		if (input_ioctl(i, EVIOCGRAB, (void *)0))
 			fprintf(stderr, "tslib: Unable to un-grab selected input device\n");
 	}
 
-	for (j = 0; j < i->nr; j++)
-		free(i->buf[j]);
-
 	free(i->buf);
+	free(i->dirty);
 	free(i->last_pressure);
+	free(i->values);
+#ifdef INPUT_RAW_REPLAY
+	replay_free(i->replay);
+#endif
 
 	free(inf);
 
@@ -919,6 +1315,7 @@ static const struct tslib_ops __ts_input_ops = {
 	.fini		= ts_input_fini,
 };
 
+#ifndef INPUT_RAW_REPLAY
 static int parse_raw_grab(struct tslib_module_info *inf, char *str, void *data)
 {
 	struct tslib_input *i = (struct tslib_input *)inf;
@@ -941,22 +1338,74 @@ static int parse_raw_grab(struct tslib_module_info *inf, char *str, void *data)
 	}
 	return 0;
 }
+#endif
 
-static const struct tslib_vars raw_vars[] = {
-	{ "grab_events", (void *)1, parse_raw_grab },
+/* for ignore=, msc is all of EV_MSC */
+static const struct {
+	const char *name;
+	unsigned int code;
+} ignore_abs[] = {
+	{ "touch",		ABS_MT_TOUCH_MAJOR },
+	{ "touch",		ABS_MT_TOUCH_MINOR },
+	{ "width",		ABS_MT_WIDTH_MAJOR },
+	{ "width",		ABS_MT_WIDTH_MINOR },
+	{ "orientation",	ABS_MT_ORIENTATION },
+	{ "tool",		ABS_MT_TOOL_TYPE },
+	{ "tool",		ABS_MT_TOOL_X },
+	{ "tool",		ABS_MT_TOOL_Y },
+	{ "distance",		ABS_MT_DISTANCE },
+	{ "blob",		ABS_MT_BLOB_ID },
 };
 
-#define NR_VARS (sizeof(raw_vars) / sizeof(raw_vars[0]))
+#define NR_IGNORE_ABS (sizeof(ignore_abs) / sizeof(ignore_abs[0]))
 
-TSAPI struct tslib_module_info *input_mod_init(__attribute__ ((unused)) struct tsdev *dev,
-					       const char *params)
+/* "touch,width,msc" */
+static int parse_raw_ignore(struct tslib_module_info *inf, char *str,
+			    __attribute__ ((unused)) void *data)
 {
-	struct tslib_input *i;
+	struct tslib_input *i = (struct tslib_input *)inf;
+	unsigned int code;
+	size_t len;
+	char *end;
+	int found;
+	unsigned int k;
 
-	i = malloc(sizeof(struct tslib_input));
-	if (i == NULL)
-		return NULL;
+	if (!str)
+		return -1;
+
+	while (*str) {
+		end = strchr(str, ',');
+		len = end ? (size_t)(end - str) : strlen(str);
+		found = 0;
+
+		if (len == 3 && strncmp(str, "msc", len) == 0) {
+			i->ignore_msc = 1;
+			found = 1;
+		}
+
+		for (k = 0; k < NR_IGNORE_ABS; k++) {
+			if (strlen(ignore_abs[k].name) != len ||
+			    strncmp(str, ignore_abs[k].name, len) != 0)
+				continue;
+
+			code = ignore_abs[k].code;
+			i->ignore_abs[BIT_WORD(code)] |= BIT_MASK(code);
+			found = 1;
+		}
+
+		if (!found)
+			return -1;
 
+		if (!end)
+			break;
+		str = end + 1;
+	}
+
+	return 0;
+}
+
+static void input_init(struct tslib_input *i)
+{
 	i->module.ops = &__ts_input_ops;
 	i->current_x = 0;
 	i->current_y = 0;
@@ -964,16 +1413,45 @@ TSAPI struct tslib_module_info *input_mod_init(__attribute__ ((unused)) struct t
 	i->using_syn = 0;
 	i->grab_events = 0;
 	i->slot = 0;
-	i->pen_down = 0;
+	i->pen_up = 0;
 	i->buf = NULL;
+	i->dirty = NULL;
+	i->nr_dirty = 0;
 	i->max_slots = 0;
-	i->nr = 0;
 	i->mt = 0;
 	i->no_pressure = 0;
 	i->last_fd = -2;
 	i->type_a = 0;
 	i->special_device = 0;
 	i->last_pressure = NULL;
+	i->values = NULL;
+	i->dropped = 0;
+	memset(i->ignore_abs, 0, sizeof(i->ignore_abs));
+	i->ignore_msc = 0;
+	i->clock = -1;
+	i->next_trackid = 0;
+	i->ev_head = 0;
+	i->ev_count = 0;
+}
+
+#ifndef INPUT_RAW_REPLAY
+static const struct tslib_vars raw_vars[] = {
+	{ "grab_events", (void *)1, parse_raw_grab },
+	{ "ignore", NULL, parse_raw_ignore },
+};
+
+#define NR_VARS (sizeof(raw_vars) / sizeof(raw_vars[0]))
+
+TSAPI struct tslib_module_info *input_mod_init(__attribute__ ((unused)) struct tsdev *dev,
+					       const char *params)
+{
+	struct tslib_input *i;
+
+	i = malloc(sizeof(struct tslib_input));
+	if (i == NULL)
+		return NULL;
+
+	input_init(i);
 
 	if (tslib_parse_vars(&i->module, raw_vars, NR_VARS, params)) {
 		free(i);
@@ -986,3 +1464,4 @@ TSAPI struct tslib_module_info *input_mod_init(__attribute__ ((unused)) struct t
 #ifndef TSLIB_STATIC_INPUT_MODULE
 	TSLIB_MODULE_INIT(input_mod_init);
 #endif
+#endif /* INPUT_RAW_REPLAY */
@@ -25,70 +25,39 @@ struct tslib_invert {
 	int32_t		y0;
 	uint8_t		invert_x;
 	uint8_t		invert_y;
+	struct ts_transform t;
 };
 
-static int invert_read(struct tslib_module_info *info, struct ts_sample *samp, int nr)
+static int invert_process(struct tslib_module_info *info,
+			  struct ts_sample *samp, int nr,
+			  __attribute__ ((unused)) int max)
 {
 	struct tslib_invert *ctx = (struct tslib_invert *)info;
-	int count = 0;
 
-	while (count < nr) {
-		if (info->next->ops->read(info->next, samp, 1) < 1)
-			return count;
-
-		if (ctx->invert_x)
-			samp->x = ctx->x0 - samp->x;
-
-		if (ctx->invert_y)
-			samp->y = ctx->y0 - samp->y;
-
-		count++;
-	}
-	return count;
+	return ts_transform_process(&ctx->t, samp, nr);
 }
 
-static int invert_read_mt(struct tslib_module_info *info,
-			  struct ts_sample_mt **samp,
-			  int max_slots, int nr)
+static int invert_process_mt(struct tslib_module_info *info,
+			     struct ts_sample_mt **samp,
+			     int max_slots, int nr,
+			     __attribute__ ((unused)) int max)
 {
 	struct tslib_invert *ctx = (struct tslib_invert *)info;
-	int ret;
-	int i, j;
-
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr);
-	if (ret < 0)
-		return ret;
 
 #ifdef DEBUG
-	if (ret == 0)
-		fprintf(stderr, "INVERT: couldn't read data\n");
-
-	printf("INVERT: read %d samples (mem: %d nr x %d slots)\n",
-		ret, nr, max_slots);
+	if (nr)
+		printf("INVERT: read %d samples (mem: %d nr x %d slots)\n",
+		       nr, max, max_slots);
 #endif
 
-	for (i = 0; i < ret; i++) {
-		for (j = 0; j < max_slots; j++) {
-			if (!(samp[i][j].valid & TSLIB_MT_VALID))
-				continue;
-
-			if (ctx->invert_x)
-				samp[i][j].x = ctx->x0 - samp[i][j].x;
-
-			if (ctx->invert_y)
-				samp[i][j].y = ctx->y0 - samp[i][j].y;
+	return ts_transform_process_mt(&ctx->t, samp, max_slots, nr);
+}
 
-		#ifdef DEBUG
-			printf("INVERT: new val slot %d:  X %d  Y %d\n",
-				j, samp[i][j].x, samp[i][j].y);
-		#endif
-		}
-	}
+static const struct ts_transform *invert_transform(struct tslib_module_info *info)
+{
+	struct tslib_invert *ctx = (struct tslib_invert *)info;
 
-	return ret;
+	return &ctx->t;
 }
 
 static int invert_fini(struct tslib_module_info *info)
@@ -99,8 +68,11 @@ static int invert_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops invert_ops = {
-	.read		= invert_read,
-	.read_mt	= invert_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= invert_process,
+	.process_mt	= invert_process_mt,
+	.transform	= invert_transform,
 	.fini		= invert_fini,
 };
 
@@ -161,6 +133,19 @@ TSAPI struct tslib_module_info *invert_mod_init(__attribute__ ((unused)) struct
 		return NULL;
 	}
 
+	/* x = x0 - x, y = y0 - y */
+	ts_transform_init(&ctx->t);
+	if (ctx->invert_x) {
+		ctx->t.m[0][0] = -1;
+		ctx->t.off[0] = ctx->x0;
+		ctx->t.flags |= TS_TRANSFORM_MAP;
+	}
+	if (ctx->invert_y) {
+		ctx->t.m[1][1] = -1;
+		ctx->t.off[1] = ctx->y0;
+		ctx->t.flags |= TS_TRANSFORM_MAP;
+	}
+
 	return &ctx->module;
 }
 
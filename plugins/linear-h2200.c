@@ -55,46 +55,42 @@ struct tslib_linear_h2200 {
 #define M32(x, y) ((long)(((long long)x * (long long)y) >> 32))
 
 static int
-linear_h2200_read(struct tslib_module_info *info, struct ts_sample *samp,
-		  int nr_samples)
+linear_h2200_process(__attribute__ ((unused)) struct tslib_module_info *info,
+		     struct ts_sample *samp, int nr_samples,
+		     __attribute__ ((unused)) int max)
 {
-	int ret;
 	long x, y, new_x, new_y;
+	int nr;
 
-	ret = info->next->ops->read(info->next, samp, nr_samples);
-	if (ret >= 0) {
-		int nr;
+	for (nr = 0; nr < nr_samples; nr++, samp++) {
 
-		for (nr = 0; nr < ret; nr++, samp++) {
+		x = ((long) samp->x) << 20;
+		y = ((long) samp->y) << 20;
 
-			x = ((long) samp->x) << 20;
-			y = ((long) samp->y) << 20;
+		/* Caution: constants have been multiplied by 2^20
+		  (to save runtime). Some of them have been
+		  multiplied by 2^32 when they were too small.
+		  An extra >>12 is then needed.
 
-			/* Caution: constants have been multiplied by 2^20
-			  (to save runtime). Some of them have been
-			  multiplied by 2^32 when they were too small.
-			  An extra >>12 is then needed.
+		  Note: we never multiply x*y or y*y first
+		  (intermediate result too big, could overflow),
+		  we multiply by the constant first. Because of this,
+		  we can't reuse x^2, y^2 and x*y
+		*/
 
-			  Note: we never multiply x*y or y*y first
-			  (intermediate result too big, could overflow),
-			  we multiply by the constant first. Because of this,
-			  we can't reuse x^2, y^2 and x*y
-			*/
+		new_x = 14708834 + M20(1009971, x) + M20(-18416, y) +
+			M20(M32(129310, x), y) + M20(M32(76687, x), x) +
+			M20(M32(5340, y), y);
 
-			new_x = 14708834 + M20(1009971, x) + M20(-18416, y) +
-				M20(M32(129310, x), y) + M20(M32(76687, x), x) +
-				M20(M32(5340, y), y);
+		new_y = -10920238 + M20(129836, x) + M20(951939, y) +
+			M20(M32(-947740, x), y) + M20(M32(22599, x), x) +
+			M20(M32(735087, y), y);
 
-			new_y = -10920238 + M20(129836, x) + M20(951939, y) +
-				M20(M32(-947740, x), y) + M20(M32(22599, x), x) +
-				M20(M32(735087, y), y);
-
-			samp->x = (int) (new_x >> 20);
-			samp->y = (int) (new_y >> 20);
-		}
+		samp->x = (int) (new_x >> 20);
+		samp->y = (int) (new_y >> 20);
 	}
 
-	return ret;
+	return nr_samples;
 }
 
 static int linear_h2200_fini(struct tslib_module_info *info)
@@ -104,8 +100,9 @@ static int linear_h2200_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops linear_h2200_ops = {
-	.read	= linear_h2200_read,
-	.fini	= linear_h2200_fini,
+	.read		= tslib_filter_read,
+	.process	= linear_h2200_process,
+	.fini		= linear_h2200_fini,
 };
 
 TSAPI struct tslib_module_info *linear_h2200_mod_init(__attribute__ ((unused)) struct tsdev *dev,
@@ -16,10 +16,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
-#include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include "config.h"
 #include "tslib-private.h"
@@ -43,160 +43,133 @@ struct tslib_linear {
 
 	/* Rotation. Forced or from calibration time */
 	unsigned int rot;
+
+	/*
+	 * All of the above, for the screen resolution in res_x and res_y.
+	 * See linear_update().
+	 */
+	struct ts_transform t;
+	unsigned int res_x;
+	unsigned int res_y;
 };
 
-static int linear_read(struct tslib_module_info *info, struct ts_sample *samp,
-		       int nr_samples)
+static void linear_update(struct tslib_linear *lin, unsigned int res_x,
+			  unsigned int res_y)
+{
+	struct ts_transform *t = &lin->t;
+	uint32_t m[2][2];
+	uint32_t off[2] = { 0, 0 };
+	int a6 = lin->a[6];
+
+	ts_transform_init(t);
+	t->flags = TS_TRANSFORM_MAP | TS_TRANSFORM_DIV;
+
+	/* (a[2] + a[0] * x + a[1] * y) / a[6] */
+	t->m[0][0] = lin->a[0];
+	t->m[0][1] = lin->a[1];
+	t->off[0] = lin->a[2];
+	t->m[1][0] = lin->a[3];
+	t->m[1][1] = lin->a[4];
+	t->off[1] = lin->a[5];
+	t->div_neg = a6 < 0;
+	ts_div_init(&t->div, a6 < 0 ? -(uint32_t)a6 : (uint32_t)a6);
+
+	t->scale_x = (res_x && lin->cal_res_x) ? res_x : 0;
+	t->scale_y = (res_y && lin->cal_res_y) ? res_y : 0;
+	ts_div_init(&t->div_x, lin->cal_res_x);
+	ts_div_init(&t->div_y, lin->cal_res_y);
+
+	t->p_offset = lin->p_offset;
+	t->p_mult = lin->p_mult;
+	ts_div_init(&t->div_p, lin->p_div);
+
+	/* xyswap */
+	m[0][0] = !lin->swap_xy;
+	m[0][1] = !!lin->swap_xy;
+	m[1][0] = !!lin->swap_xy;
+	m[1][1] = !lin->swap_xy;
+
+	/* then rotate */
+	switch (lin->rot) {
+	case 1:
+		/* x = y, y = cal_res_x - x - 1 */
+		t->m2[0][0] = m[1][0];
+		t->m2[0][1] = m[1][1];
+		t->m2[1][0] = -m[0][0];
+		t->m2[1][1] = -m[0][1];
+		off[1] = lin->cal_res_x - 1;
+		break;
+	case 2:
+		/* x = cal_res_x - x - 1, y = cal_res_y - y - 1 */
+		t->m2[0][0] = -m[0][0];
+		t->m2[0][1] = -m[0][1];
+		t->m2[1][0] = -m[1][0];
+		t->m2[1][1] = -m[1][1];
+		off[0] = lin->cal_res_x - 1;
+		off[1] = lin->cal_res_y - 1;
+		break;
+	case 3:
+		/* x = cal_res_y - y - 1, y = x */
+		t->m2[0][0] = -m[1][0];
+		t->m2[0][1] = -m[1][1];
+		t->m2[1][0] = m[0][0];
+		t->m2[1][1] = m[0][1];
+		off[0] = lin->cal_res_y - 1;
+		break;
+	default:
+		memcpy(t->m2, m, sizeof(m));
+		break;
+	}
+	t->off2[0] = off[0];
+	t->off2[1] = off[1];
+
+	lin->res_x = res_x;
+	lin->res_y = res_y;
+}
+
+static const struct ts_transform *linear_transform(struct tslib_module_info *info)
 {
 	struct tslib_linear *lin = (struct tslib_linear *)info;
-	int ret;
-	int xtemp, ytemp;
 
-	ret = info->next->ops->read(info->next, samp, nr_samples);
-	if (ret >= 0) {
-		int nr;
+	if (info->dev->res_x != lin->res_x || info->dev->res_y != lin->res_y)
+		linear_update(lin, info->dev->res_x, info->dev->res_y);
 
-		for (nr = 0; nr < ret; nr++, samp++) {
-		#ifdef DEBUG
-			fprintf(stderr,
-				"BEFORE CALIB--------------------> %d %d %d\n",
-				samp->x, samp->y, samp->pressure);
-		#endif /* DEBUG */
-			xtemp = samp->x; ytemp = samp->y;
-			samp->x =	(lin->a[2] +
-					lin->a[0]*xtemp +
-					lin->a[1]*ytemp) / lin->a[6];
-			samp->y =	(lin->a[5] +
-					lin->a[3]*xtemp +
-					lin->a[4]*ytemp) / lin->a[6];
-			if (info->dev->res_x && lin->cal_res_x)
-				samp->x = samp->x * info->dev->res_x
-					  / lin->cal_res_x;
-			if (info->dev->res_y && lin->cal_res_y)
-				samp->y = samp->y * info->dev->res_y
-					  / lin->cal_res_y;
-
-			samp->pressure = ((samp->pressure + lin->p_offset)
-					  * lin->p_mult) / lin->p_div;
-			if (lin->swap_xy) {
-				int tmp = samp->x;
-
-				samp->x = samp->y;
-				samp->y = tmp;
-			}
-
-			switch (lin->rot) {
-			int rot_tmp;
-			case 0:
-				break;
-			case 1:
-				rot_tmp = samp->x;
-				samp->x = samp->y;
-				samp->y = lin->cal_res_x - rot_tmp - 1;
-				break;
-			case 2:
-				samp->x = lin->cal_res_x - samp->x - 1;
-				samp->y = lin->cal_res_y - samp->y - 1;
-				break;
-			case 3:
-				rot_tmp = samp->x;
-				samp->x = lin->cal_res_y - samp->y - 1;
-				samp->y = rot_tmp ;
-				break;
-			default:
-				break;
-			}
-		}
-	}
+	return &lin->t;
+}
+
+static int linear_process(struct tslib_module_info *info,
+			  struct ts_sample *samp, int nr_samples,
+			  __attribute__ ((unused)) int max)
+{
+	struct tslib_linear *lin = (struct tslib_linear *)info;
+
+	linear_transform(info);
 
-	return ret;
+#ifdef DEBUG
+	if (nr_samples)
+		fprintf(stderr,
+			"BEFORE CALIB--------------------> %d %d %d\n",
+			samp->x, samp->y, samp->pressure);
+#endif /* DEBUG */
+
+	return ts_transform_process(&lin->t, samp, nr_samples);
 }
 
-static int linear_read_mt(struct tslib_module_info *info,
-			  struct ts_sample_mt **samp,
-			  int max_slots, int nr_samples)
+static int linear_process_mt(struct tslib_module_info *info,
+			     struct ts_sample_mt **samp,
+			     int max_slots, int nr_samples,
+			     __attribute__ ((unused)) int max)
 {
 	struct tslib_linear *lin = (struct tslib_linear *)info;
-	int ret;
-	int xtemp, ytemp;
-	int i;
-	int nr;
-
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr_samples);
-	if (ret < 0)
-		return ret;
-
-	for (nr = 0; nr < ret; nr++) {
-	#ifdef DEBUG
-		printf("LINEAR:   read %d samples (mem: %d nr x %d slots)\n",
-		       ret, nr_samples, max_slots);
-		fprintf(stderr, "BEFORE CALIB:\n");
-	#endif /*DEBUG*/
-		for (i = 0; i < max_slots; i++) {
-			if (!(samp[nr][i].valid & TSLIB_MT_VALID))
-				continue;
-
-		#ifdef DEBUG
-			fprintf(stderr, "          (slot %d) X:%4d Y:%4d P:%d\n",
-				i, samp[nr][i].x, samp[nr][i].y,
-				samp[nr][i].pressure);
-		#endif /*DEBUG*/
-			xtemp = samp[nr][i].x;
-			ytemp = samp[nr][i].y;
-			samp[nr][i].x =	(lin->a[2] +
-					lin->a[0]*xtemp +
-					lin->a[1]*ytemp) / lin->a[6];
-			samp[nr][i].y =	(lin->a[5] +
-					lin->a[3]*xtemp +
-					lin->a[4]*ytemp) / lin->a[6];
-			if (info->dev->res_x && lin->cal_res_x)
-				samp[nr][i].x = samp[nr][i].x *
-						info->dev->res_x /
-						lin->cal_res_x;
-			if (info->dev->res_y && lin->cal_res_y)
-				samp[nr][i].y = samp[nr][i].y *
-						info->dev->res_y /
-						lin->cal_res_y;
-
-			samp[nr][i].pressure = ((samp[nr][i].pressure +
-						 lin->p_offset) *
-						 lin->p_mult) /
-						 lin->p_div;
-			if (lin->swap_xy) {
-				int tmp = samp[nr][i].x;
-
-				samp[nr][i].x = samp[nr][i].y;
-				samp[nr][i].y = tmp;
-			}
-
-			switch (lin->rot) {
-			int rot_tmp;
-			case 0:
-				break;
-			case 1:
-				rot_tmp = samp[nr][i].x;
-				samp[nr][i].x = samp[nr][i].y;
-				samp[nr][i].y = lin->cal_res_x - rot_tmp -1 ;
-				break;
-			case 2:
-				samp[nr][i].x = lin->cal_res_x - samp[nr][i].x - 1;
-				samp[nr][i].y = lin->cal_res_y - samp[nr][i].y - 1;
-				break;
-			case 3:
-				rot_tmp = samp[nr][i].x;
-				samp[nr][i].x = lin->cal_res_y - samp[nr][i].y - 1;
-				samp[nr][i].y = rot_tmp ;
-				break;
-			default:
-				break;
-			}
-		}
-	}
 
-	return ret;
+	linear_transform(info);
+
+#ifdef DEBUG
+	printf("LINEAR:   read %d samples (mem: %d nr x %d slots)\n",
+	       nr_samples, max, max_slots);
+#endif /*DEBUG*/
+
+	return ts_transform_process_mt(&lin->t, samp, max_slots, nr_samples);
 }
 
 static int linear_fini(struct tslib_module_info *info)
@@ -206,8 +179,11 @@ static int linear_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops linear_ops = {
-	.read		= linear_read,
-	.read_mt	= linear_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= linear_process,
+	.process_mt	= linear_process_mt,
+	.transform	= linear_transform,
 	.fini		= linear_fini,
 };
 
@@ -294,15 +270,13 @@ static const struct tslib_vars linear_vars[] = {
 
 #define NR_VARS (sizeof(linear_vars) / sizeof(linear_vars[0]))
 
-TSAPI struct tslib_module_info *linear_mod_init(__attribute__ ((unused)) struct tsdev *dev,
+TSAPI struct tslib_module_info *linear_mod_init(struct tsdev *dev,
 						const char *params)
 {
 
 	struct tslib_linear *lin;
-	struct stat sbuf;
-	FILE *pcal_fd;
+	const struct tslib_pointercal *pcal;
 	int index;
-	char *calfile;
 
 	lin = malloc(sizeof(struct tslib_linear));
 	if (lin == NULL)
@@ -323,34 +297,36 @@ TSAPI struct tslib_module_info *linear_mod_init(__attribute__ ((unused)) struct
 	lin->p_div    = 1;
 	lin->swap_xy  = 0;
 	lin->rot = 0;
+	lin->cal_res_x = 0;
+	lin->cal_res_y = 0;
 
 	/*
 	 * Check calibration file
 	 */
-	if ((calfile = getenv("TSLIB_CALIBFILE")) == NULL)
-		calfile = TS_POINTERCAL;
-
-	if (stat(calfile, &sbuf) == 0) {
-		pcal_fd = fopen(calfile, "r");
-		if (!pcal_fd) {
-			free(lin);
-			perror("fopen");
-			return NULL;
-		}
+	if (tslib_get_pointercal(dev, &pcal)) {
+		free(lin);
+		perror("fopen");
+		return NULL;
+	}
 
-		for (index = 0; index < 7; index++)
-			if (fscanf(pcal_fd, "%d", &lin->a[index]) != 1)
-				break;
+	if (pcal) {
+		for (index = 0; index < pcal->nr_a; index++)
+			lin->a[index] = pcal->a[index];
 
-		if (!fscanf(pcal_fd, "%d %d", &lin->cal_res_x, &lin->cal_res_y))
+		if (pcal->nr_res == 0)
 			fprintf(stderr,
 				"LINEAR: Couldn't read resolution values\n");
+		if (pcal->nr_res >= 1)
+			lin->cal_res_x = pcal->res[0];
+		if (pcal->nr_res >= 2)
+			lin->cal_res_y = pcal->res[1];
 
-		if (!fscanf(pcal_fd, "%d", &lin->rot)) {
+		if (pcal->nr_rot != 1) {
 #ifdef DEBUG
 			printf("LINEAR: Couldn't read rotation value\n");
 #endif
 		} else {
+			lin->rot = pcal->rot;
 #ifdef DEBUG
 			printf("LINEAR: Reading rotation %d from calibfile\n",
 				lin->rot);
@@ -363,7 +339,6 @@ TSAPI struct tslib_module_info *linear_mod_init(__attribute__ ((unused)) struct
 			printf("%d ", lin->a[index]);
 		printf("\n");
 #endif /*DEBUG*/
-		fclose(pcal_fd);
 	}
 
 	/*
@@ -374,6 +349,8 @@ TSAPI struct tslib_module_info *linear_mod_init(__attribute__ ((unused)) struct
 		return NULL;
 	}
 
+	linear_update(lin, 0, 0);
+
 	return &lin->module;
 }
 
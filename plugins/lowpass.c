@@ -23,150 +23,124 @@
 #include "tslib.h"
 #include "tslib-filter.h"
 
+/*
+ * The factor is applied in fixed point, 16 bits fraction, unless we're
+ * configured to do it in floating point like we used to.
+ */
+#define LOWPASS_SHIFT	16
+#define LOWPASS_ONE	(1 << LOWPASS_SHIFT)
+
+struct tslib_lowpass_slot {
+	int x;
+	int y;
+	unsigned int flags;
+};
+
 struct tslib_lowpass {
 	struct tslib_module_info module;
-	struct ts_sample last;
-	struct ts_sample ideal;
-	struct ts_sample_mt *last_mt;
-	struct ts_sample_mt *ideal_mt;
+	struct tslib_lowpass_slot last;
+	struct tslib_lowpass_slot *last_mt;
 	int slots;
+#ifdef ENABLE_LOWPASS_FLOAT
 	float factor;
-	unsigned int flags;
-	unsigned int *flags_mt;
+#else
+	int32_t factor;
+#endif
 	unsigned char threshold;
 #define VAR_PENUP		0x00000001
 };
 
-static int lowpass_read(struct tslib_module_info *info, struct ts_sample *samp, int nr)
+static int lowpass_delta(const struct tslib_lowpass *var, int delta)
 {
-	struct tslib_lowpass *var = (struct tslib_lowpass *)info;
-	struct ts_sample current;
-	int count = 0;
-	int delta;
-
-	while (count < nr) {
-		if (info->next->ops->read(info->next, &current, 1) < 1)
-			return count;
-
-		if (current.pressure == 0) {
-			var->flags |= VAR_PENUP;
-			samp[count++] = current;
-		} else if (var->flags & VAR_PENUP) {
-			var->flags &= ~VAR_PENUP;
-			var->last = current;
-			samp[count++] = current;
-		} else {
-			var->ideal = current;
-
-			var->ideal.x = var->last.x;
-			delta = current.x - var->last.x;
-			if (delta <= var->threshold &&
-					delta >= -var->threshold)
-				delta = 0;
-			delta *= var->factor;
-			var->ideal.x += delta;
-
-			var->ideal.y = var->last.y;
-			delta = current.y - var->last.y;
-			if (delta <= var->threshold &&
-					delta >= -var->threshold)
-				delta = 0;
-			delta *= var->factor;
-			var->ideal.y += delta;
-
-			var->last = var->ideal;
-			samp[count++] = var->ideal;
-		}
+	if (delta <= var->threshold && delta >= -var->threshold)
+		return 0;
+
+#ifdef ENABLE_LOWPASS_FLOAT
+	delta *= var->factor;
+	return delta;
+#else
+	/* truncated towards zero, like the conversion from float did */
+	return (int)((int64_t)delta * var->factor / LOWPASS_ONE);
+#endif
+}
+
+static void lowpass_slot(const struct tslib_lowpass *var,
+			 struct tslib_lowpass_slot *last,
+			 unsigned int pressure, int *x, int *y)
+{
+	if (pressure == 0) {
+		last->flags |= VAR_PENUP;
+		return;
+	}
+
+	if (last->flags & VAR_PENUP) {
+		last->flags &= ~VAR_PENUP;
+		last->x = *x;
+		last->y = *y;
+		return;
 	}
-	return count;
+
+	last->x += lowpass_delta(var, *x - last->x);
+	last->y += lowpass_delta(var, *y - last->y);
+	*x = last->x;
+	*y = last->y;
 }
 
-static int lowpass_read_mt(struct tslib_module_info *info,
-			   struct ts_sample_mt **samp,
-			   int max_slots, int nr)
+static int lowpass_process(struct tslib_module_info *info,
+			   struct ts_sample *samp, int nr,
+			   __attribute__ ((unused)) int max)
 {
 	struct tslib_lowpass *var = (struct tslib_lowpass *)info;
-	int delta;
-	int ret;
-	int i, j;
+	int i;
 
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
+	for (i = 0; i < nr; i++, samp++)
+		lowpass_slot(var, &var->last, samp->pressure, &samp->x, &samp->y);
 
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr);
-	if (ret < 0)
-		return ret;
+	return nr;
+}
 
-#ifdef DEBUG
-	if (ret == 0)
-		fprintf(stderr, "LOWPASS: couldn't read data\n");
+static int lowpass_process_mt(struct tslib_module_info *info,
+			      struct ts_sample_mt **samp,
+			      int max_slots, int nr,
+			      __attribute__ ((unused)) int max)
+{
+	struct tslib_lowpass *var = (struct tslib_lowpass *)info;
+	struct ts_sample_mt *s;
+	int i, j;
 
-	printf("LOWPASS: read %d samples (mem: %d nr x %d slots)\n",
-		ret, nr, max_slots);
+#ifdef DEBUG
+	if (nr)
+		printf("LOWPASS: read %d samples (mem: %d nr x %d slots)\n",
+		       nr, max, max_slots);
 #endif
 
-	if (!var->last_mt || !var->ideal_mt || max_slots > var->slots) {
+	if (!var->last_mt || max_slots > var->slots) {
 		free(var->last_mt);
-		free(var->ideal_mt);
-		free(var->flags_mt);
-
-		var->last_mt = calloc(max_slots, sizeof(struct ts_sample_mt));
-		if (!var->last_mt)
-			return -ENOMEM;
 
-		var->ideal_mt = calloc(max_slots, sizeof(struct ts_sample_mt));
-		if (!var->ideal_mt)
+		var->last_mt = calloc(max_slots, sizeof(*var->last_mt));
+		if (!var->last_mt) {
+			var->slots = 0;
 			return -ENOMEM;
+		}
 
-		var->flags_mt = calloc(max_slots, sizeof(int));
-		if (!var->flags_mt)
-			return -ENOMEM;
+		for (j = 0; j < max_slots; j++)
+			var->last_mt[j].flags = VAR_PENUP;
 
 		var->slots = max_slots;
 	}
 
-	for (i = 0; i < ret; i++) {
-		for (j = 0; j < max_slots; j++) {
-			if (!(samp[i][j].valid & TSLIB_MT_VALID))
+	for (i = 0; i < nr; i++) {
+		s = samp[i];
+		for (j = 0; j < max_slots; j++, s++) {
+			if (!(s->valid & TSLIB_MT_VALID))
 				continue;
 
-			if (samp[i][j].pressure == 0) {
-				var->flags_mt[j] |= VAR_PENUP;
-				continue;
-			} else if (var->flags_mt[j] & VAR_PENUP) {
-				var->flags_mt[j] &= ~VAR_PENUP;
-				var->last_mt[j] = samp[i][j];
-				continue;
-			} else {
-				var->ideal_mt[j] = samp[i][j];
-
-				var->ideal_mt[j].x = var->last_mt[j].x;
-				delta = samp[i][j].x - var->last_mt[j].x;
-				if (delta <= var->threshold &&
-				    delta >= -var->threshold)
-					delta = 0;
-
-				delta *= var->factor;
-				var->ideal_mt[j].x += delta;
-
-
-				var->ideal_mt[j].y = var->last_mt[j].y;
-				delta = samp[i][j].y - var->last_mt[j].y;
-				if (delta <= var->threshold &&
-				    delta >= -var->threshold)
-					delta = 0;
-
-				delta *= var->factor;
-				var->ideal_mt[j].y += delta;
-
-
-				var->last_mt[j] = var->ideal_mt[j];
-				samp[i][j] = var->ideal_mt[j];
-			}
+			lowpass_slot(var, &var->last_mt[j], s->pressure,
+				     &s->x, &s->y);
 		}
 	}
 
-	return ret;
+	return nr;
 }
 
 static int lowpass_fini(struct tslib_module_info *info)
@@ -174,8 +148,6 @@ static int lowpass_fini(struct tslib_module_info *info)
 	struct tslib_lowpass *var = (struct tslib_lowpass *)info;
 
 	free(var->last_mt);
-	free(var->ideal_mt);
-	free(var->flags_mt);
 
 	free(info);
 
@@ -183,8 +155,10 @@ static int lowpass_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops lowpass_ops = {
-	.read		= lowpass_read,
-	.read_mt	= lowpass_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= lowpass_process,
+	.process_mt	= lowpass_process_mt,
 	.fini		= lowpass_fini,
 };
 
@@ -202,7 +176,14 @@ static int lowpass_factor(struct tslib_module_info *inf, char *str, void *data)
 	errno = err;
 	switch ((int)(intptr_t)data) {
 	case 1:
+#ifdef ENABLE_LOWPASS_FLOAT
 		var->factor = v;
+#else
+		/* rounded up, so that e.g. 5 * 0.4 still makes 2 */
+		var->factor = (int32_t)(v * LOWPASS_ONE);
+		if (var->factor < v * LOWPASS_ONE)
+			var->factor++;
+#endif
 #ifdef DEBUG
 		printf("LOWPASS: factor is now %Lf\n", v);
 #endif
@@ -259,13 +240,15 @@ TSAPI struct tslib_module_info *lowpass_mod_init(__attribute__ ((unused)) struct
 	memset(var, 0, sizeof(*var));
 	var->module.ops = &lowpass_ops;
 
+#ifdef ENABLE_LOWPASS_FLOAT
 	var->factor = 0.4;
+#else
+	var->factor = (LOWPASS_ONE * 4 + 9) / 10;
+#endif
 	var->threshold = 2;
-	var->flags = VAR_PENUP;
+	var->last.flags = VAR_PENUP;
 	var->slots = 0;
 	var->last_mt = NULL;
-	var->ideal_mt = NULL;
-	var->flags_mt = NULL;
 
 	if (tslib_parse_vars(&var->module, lowpass_vars, NR_VARS, params)) {
 		free(var);
@@ -28,79 +28,234 @@
 
 #define MEDIAN_DEPTH_MAX 128
 
-#define PREPARESAMPLE(array, context, member) { \
-	int count = context->size; \
-	while (count--) { \
-		array[count] = context->delay[count].member; \
-	} \
-}
+enum {
+	MEDIAN_X,
+	MEDIAN_Y,
+	MEDIAN_PRESSURE,
+	MEDIAN_AXES,
+};
 
-#define PREPARESAMPLE_MT(array, context, member, slot) { \
-	int count = context->size; \
-	while (count--) { \
-		array[count] = context->delay_mt[slot][count].member; \
-	} \
-}
+/*
+ * The delay line of one slot. Per axis, v holds the last 'size' values
+ * in a ring. For larger depths, heap holds ring positions: heap[0 .. size/2)
+ * is a max-heap of the lower half of the values, heap[size/2 .. size) a
+ * min-heap of the upper half, so the median is on top of the latter.
+ * at[] maps ring positions back into heap. Replacing the oldest value
+ * costs O(log size).
+ */
+struct median_window {
+	int64_t		*v[MEDIAN_AXES];
+	uint8_t		*heap[MEDIAN_AXES];
+	uint8_t		*at[MEDIAN_AXES];
+	int		head;
+};
 
 struct median_context {
 	struct tslib_module_info	module;
 	int				size;
-	struct ts_sample		*delay;
-	struct ts_sample_mt		**delay_mt;
+	struct median_window		win;
+	struct median_window		*win_mt;
 	int				withsamples;
 	int				*withsamples_mt;
 	short				*pen_down;
 	int				slots;
-	unsigned int			depth;
-	int32_t				*sorted;
-	uint32_t			*usorted;
 };
 
-static int comp_int(const void *n1, const void *n2)
+#define MEDIAN_SORT(a, b) { \
+	if ((a) > (b)) { \
+		int64_t tmp = (a); \
+		(a) = (b); \
+		(b) = tmp; \
+	} \
+}
+
+/* sorting networks that only get the middle element right */
+static int64_t median_of_3(const int64_t *v)
 {
-	int *i1 = (int *) n1;
-	int *i2 = (int *) n2;
+	int64_t p0 = v[0], p1 = v[1], p2 = v[2];
 
-	return  *i1 < *i2 ? -1 : 1;
+	MEDIAN_SORT(p0, p1); MEDIAN_SORT(p1, p2); MEDIAN_SORT(p0, p1);
+
+	return p1;
 }
 
-static int comp_uint(const void *n1, const void *n2)
+static int64_t median_of_5(const int64_t *v)
 {
-	unsigned int *i1 = (unsigned int *) n1;
-	unsigned int *i2 = (unsigned int *) n2;
+	int64_t p0 = v[0], p1 = v[1], p2 = v[2], p3 = v[3], p4 = v[4];
+
+	MEDIAN_SORT(p0, p1); MEDIAN_SORT(p3, p4); MEDIAN_SORT(p0, p3);
+	MEDIAN_SORT(p1, p4); MEDIAN_SORT(p1, p2); MEDIAN_SORT(p2, p3);
+	MEDIAN_SORT(p1, p2);
 
-	return  *i1 < *i2 ? -1 : 1;
+	return p2;
 }
 
-static void printsamples(__attribute__ ((unused)) char *prefix,
-			 __attribute__ ((unused)) int *samples,
-			 __attribute__ ((unused)) size_t count)
+static int64_t median_of_7(const int64_t *v)
 {
-#ifdef DEBUG
-	size_t j;
+	int64_t p0 = v[0], p1 = v[1], p2 = v[2], p3 = v[3], p4 = v[4];
+	int64_t p5 = v[5], p6 = v[6];
 
-	printf("%s Using %d samples ", prefix, (int) count);
-	for (j = 0; j < count; j++)
-		printf(" %d", samples[j]);
+	MEDIAN_SORT(p0, p5); MEDIAN_SORT(p0, p3); MEDIAN_SORT(p1, p6);
+	MEDIAN_SORT(p2, p4); MEDIAN_SORT(p0, p1); MEDIAN_SORT(p3, p5);
+	MEDIAN_SORT(p2, p6); MEDIAN_SORT(p2, p3); MEDIAN_SORT(p3, p6);
+	MEDIAN_SORT(p4, p5); MEDIAN_SORT(p1, p4); MEDIAN_SORT(p1, p3);
+	MEDIAN_SORT(p3, p4);
 
-	printf("\n");
-#endif
+	return p3;
 }
 
-static void printsamples_mt(__attribute__ ((unused)) char *prefix,
-			    __attribute__ ((unused)) int *samples,
-			    __attribute__ ((unused)) size_t count,
-			    __attribute__ ((unused)) int slot)
+static void median_swap(uint8_t *heap, uint8_t *at, int i, int j)
 {
-#ifdef DEBUG
-	size_t j;
+	uint8_t tmp = heap[i];
 
-	printf("%s (slot %d) Using %d samples ", prefix, slot, (int) count);
-	for (j = 0; j < count; j++)
-		printf(" %d", samples[j]);
+	heap[i] = heap[j];
+	heap[j] = tmp;
+	at[heap[i]] = i;
+	at[heap[j]] = j;
+}
 
-	printf("\n");
-#endif
+/* sift within the heap at heap[base .. base + n). max != 0 for a max-heap */
+static int median_sift_up(const int64_t *v, uint8_t *heap, uint8_t *at,
+			  int base, int i, int max)
+{
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (max ? v[heap[base + i]] <= v[heap[base + parent]] :
+			  v[heap[base + i]] >= v[heap[base + parent]])
+			break;
+
+		median_swap(heap, at, base + i, base + parent);
+		i = parent;
+	}
+
+	return i;
+}
+
+static void median_sift_down(const int64_t *v, uint8_t *heap, uint8_t *at,
+			     int base, int n, int i, int max)
+{
+	int child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= n)
+			break;
+
+		if (child + 1 < n &&
+		    (max ? v[heap[base + child + 1]] > v[heap[base + child]] :
+			   v[heap[base + child + 1]] < v[heap[base + child]]))
+			child++;
+
+		if (max ? v[heap[base + child]] <= v[heap[base + i]] :
+			  v[heap[base + child]] >= v[heap[base + i]])
+			break;
+
+		median_swap(heap, at, base + i, base + child);
+		i = child;
+	}
+}
+
+/* replace the value at ring position pos and return the new median */
+static int64_t median_replace(struct median_window *w, int size, int axis,
+			      int pos, int64_t value)
+{
+	int64_t *v = w->v[axis];
+	uint8_t *heap = w->heap[axis];
+	uint8_t *at = w->at[axis];
+	int nlo = size / 2;
+	int nhi = size - nlo;
+	int i;
+
+	v[pos] = value;
+
+	switch (size) {
+	case 3:
+		return median_of_3(v);
+	case 5:
+		return median_of_5(v);
+	case 7:
+		return median_of_7(v);
+	default:
+		break;
+	}
+
+	i = at[pos];
+	if (i < nlo) {
+		i = median_sift_up(v, heap, at, 0, i, 1);
+		median_sift_down(v, heap, at, 0, nlo, i, 1);
+	} else {
+		i = median_sift_up(v, heap, at, nlo, i - nlo, 0);
+		median_sift_down(v, heap, at, nlo, nhi, i, 0);
+	}
+
+	/* keep every value of the lower half below the upper half */
+	if (nlo > 0 && v[heap[0]] > v[heap[nlo]]) {
+		median_swap(heap, at, 0, nlo);
+		median_sift_down(v, heap, at, 0, nlo, 0, 1);
+		median_sift_down(v, heap, at, nlo, nhi, 0, 0);
+	}
+
+	return v[heap[nlo]];
+}
+
+/* fill the delay line with zeros */
+static void median_window_reset(struct median_window *w, int size)
+{
+	int i, j;
+
+	for (i = 0; i < MEDIAN_AXES; i++) {
+		for (j = 0; j < size; j++) {
+			w->v[i][j] = 0;
+			w->heap[i][j] = j;
+			w->at[i][j] = j;
+		}
+	}
+	w->head = 0;
+}
+
+static int median_window_init(struct median_window *w, int size)
+{
+	int i;
+
+	w->v[0] = malloc(MEDIAN_AXES * size *
+			 (sizeof(int64_t) + 2 * sizeof(uint8_t)));
+	if (!w->v[0])
+		return -ENOMEM;
+
+	for (i = 1; i < MEDIAN_AXES; i++)
+		w->v[i] = w->v[i - 1] + size;
+
+	w->heap[0] = (uint8_t *)(w->v[MEDIAN_AXES - 1] + size);
+	w->at[0] = w->heap[0] + size;
+	for (i = 1; i < MEDIAN_AXES; i++) {
+		w->heap[i] = w->at[i - 1] + size;
+		w->at[i] = w->heap[i] + size;
+	}
+
+	median_window_reset(w, size);
+
+	return 0;
+}
+
+static void median_window_free(struct median_window *w)
+{
+	free(w->v[0]);
+	w->v[0] = NULL;
+}
+
+/* add one sample to the delay line, returning the median of it */
+static void median_push(struct median_window *w, int size,
+			int *x, int *y, unsigned int *pressure)
+{
+	int pos = w->head;
+
+	w->head = (w->head + 1) % size;
+
+	*x = median_replace(w, size, MEDIAN_X, pos, *x);
+	*y = median_replace(w, size, MEDIAN_Y, pos, *y);
+	*pressure = median_replace(w, size, MEDIAN_PRESSURE, pos, *pressure);
 }
 
 static void printsample(__attribute__ ((unused)) char *prefix,
@@ -121,149 +276,91 @@ static void printsample_mt(__attribute__ ((unused)) char *prefix,
 #endif
 }
 
-static int median_read(struct tslib_module_info *inf, struct ts_sample *samp,
-		       int nr)
+static int median_process(struct tslib_module_info *inf,
+			  struct ts_sample *samp, int nr,
+			  __attribute__ ((unused)) int max)
 {
 	struct median_context *c = (struct median_context *)inf;
-	int ret;
-
-	ret = inf->next->ops->read(inf->next, samp, nr);
-	if (ret > 0) {
-		int i;
-		struct ts_sample *s;
-
-		for (s = samp, i = 0; i < ret; i++, s++) {
-			unsigned int cpress;
-
-			cpress = s->pressure;
-
-			memmove(&c->delay[0],
-				&c->delay[1],
-				(c->size - 1) * sizeof(c->delay[0]));
-			c->delay[c->size - 1] = *s;
-
-			PREPARESAMPLE(c->sorted, c, x);
-			printsamples("MEDIAN: X Before", c->sorted, c->size);
-			qsort(&c->sorted[0], c->size,
-			      sizeof(c->sorted[0]),
-			      comp_int);
-			s->x = c->sorted[c->size / 2];
-			printsamples("MEDIAN: X After ", c->sorted, c->size);
-
-			PREPARESAMPLE(c->sorted, c, y);
-			printsamples("MEDIAN: Y Before", c->sorted, c->size);
-			qsort(&c->sorted[0], c->size,
-			      sizeof(c->sorted[0]),
-			      comp_int);
-			s->y = c->sorted[c->size / 2];
-			printsamples("MEDIAN: Y After ", c->sorted, c->size);
-
-			PREPARESAMPLE(c->usorted, c, pressure);
-			printsamples("MEDIAN: Pressure Before",
-				     (int *)c->usorted, c->size);
-			qsort(&c->usorted[0], c->size,
-			      sizeof(c->usorted[0]),
-			      comp_uint);
-			s->pressure = c->usorted[c->size / 2];
-			printsamples("MEDIAN: Pressure After ",
-				     (int *)c->usorted, c->size);
-
-			printsample("", s);
-
-			if ((cpress == 0)  && (c->withsamples != 0)) {
-				/* We have penup. Flush the line we now must
-				 * wait for c->size / 2 samples until we get
-				 * valid data again
-				 */
-				memset(c->delay,
-				       0,
-				       sizeof(struct ts_sample) * c->size);
-				c->withsamples = 0;
-			#ifdef DEBUG
-				printf("MEDIAN: Pen Up\n");
-			#endif
-				s->pressure = cpress;
-			} else if ((cpress != 0) && (c->withsamples == 0)) {
-				/* We have pen down */
-				c->withsamples = 1;
-			#ifdef DEBUG
-				printf("MEDIAN: Pen Down\n");
-			#endif
-			}
+	struct ts_sample *s;
+	int i;
+
+	for (s = samp, i = 0; i < nr; i++, s++) {
+		unsigned int cpress;
+
+		cpress = s->pressure;
+
+		median_push(&c->win, c->size, &s->x, &s->y, &s->pressure);
+
+		printsample("", s);
+
+		if ((cpress == 0)  && (c->withsamples != 0)) {
+			/* We have penup. Flush the line we now must
+			 * wait for c->size / 2 samples until we get
+			 * valid data again
+			 */
+			median_window_reset(&c->win, c->size);
+			c->withsamples = 0;
+		#ifdef DEBUG
+			printf("MEDIAN: Pen Up\n");
+		#endif
+			s->pressure = cpress;
+		} else if ((cpress != 0) && (c->withsamples == 0)) {
+			/* We have pen down */
+			c->withsamples = 1;
+		#ifdef DEBUG
+			printf("MEDIAN: Pen Down\n");
+		#endif
 		}
 	}
 
-	return ret;
+	return nr;
 }
 
-static int median_read_mt(struct tslib_module_info *inf,
-			  struct ts_sample_mt **samp, int max_slots, int nr)
+static int median_process_mt(struct tslib_module_info *inf,
+			     struct ts_sample_mt **samp, int max_slots,
+			     int nr, __attribute__ ((unused)) int max)
 {
 	struct median_context *c = (struct median_context *)inf;
-	int ret;
 	int i, j;
 
-	if (!inf->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = inf->next->ops->read_mt(inf->next, samp, max_slots, nr);
-	if (ret < 0)
-		return ret;
-
 #ifdef DEBUG
-	if (ret == 0)
-		fprintf(stderr, "MEDIAN: couldn't read data\n");
-
-	printf("MEDIAN:   read %d samples (mem: %d nr x %d slots)\n",
-	       ret, nr, max_slots);
+	if (nr)
+		printf("MEDIAN:   read %d samples (mem: %d nr x %d slots)\n",
+		       nr, max, max_slots);
 #endif
 
-	if (c->delay_mt == NULL || max_slots > c->slots) {
-		if (c->delay_mt) {
-			for (i = 0; i < c->slots; i++)
-				free(c->delay_mt[i]);
-
-			free(c->delay_mt);
-		}
+	if (max_slots > c->slots) {
+		struct median_window *win_mt;
+		int *withsamples_mt;
+		short *pen_down;
 
-		c->delay_mt = malloc(max_slots * sizeof(struct ts_sample_mt *));
-		if (!c->delay_mt)
+		win_mt = realloc(c->win_mt, max_slots * sizeof(*win_mt));
+		if (!win_mt)
 			return -ENOMEM;
+		c->win_mt = win_mt;
 
-		for (i = 0; i < max_slots; i++) {
-			c->delay_mt[i] = calloc(c->size,
-						sizeof(struct ts_sample_mt));
-			if (!c->delay_mt[i]) {
-				for (j = 0; j < i; j++)
-					free(c->delay_mt[j]);
-
-				free(c->delay_mt);
-				c->delay_mt = NULL;
-
-				return -ENOMEM;
-			}
-		}
-
-		c->slots = max_slots;
-	}
-
-	if (c->withsamples_mt == NULL || max_slots > c->slots) {
-		free(c->withsamples_mt);
+		withsamples_mt = realloc(c->withsamples_mt,
+					 max_slots * sizeof(*withsamples_mt));
+		if (!withsamples_mt)
+			return -ENOMEM;
+		c->withsamples_mt = withsamples_mt;
 
-		c->withsamples_mt = calloc(max_slots, sizeof(int));
-		if (!c->withsamples_mt)
+		pen_down = realloc(c->pen_down, max_slots * sizeof(*pen_down));
+		if (!pen_down)
 			return -ENOMEM;
-	}
+		c->pen_down = pen_down;
 
-	if (c->pen_down == NULL || max_slots > c->slots) {
-		free(c->pen_down);
+		for (i = c->slots; i < max_slots; i++) {
+			if (median_window_init(&c->win_mt[i], c->size))
+				return -ENOMEM;
 
-		c->pen_down = calloc(max_slots, sizeof(short));
-		if (!c->pen_down)
-			return -ENOMEM;
+			c->withsamples_mt[i] = 0;
+			c->pen_down[i] = -1;
+			c->slots = i + 1;
+		}
 	}
 
-	for (i = 0; i < ret; i++) {
+	for (i = 0; i < nr; i++) {
 		for (j = 0; j < max_slots; j++) {
 			unsigned int cpress = 0;
 			c->pen_down[j] = -1;
@@ -271,36 +368,10 @@ static int median_read_mt(struct tslib_module_info *inf,
 			if (!(samp[i][j].valid & TSLIB_MT_VALID))
 				continue;
 
-			memset(c->sorted, 0, c->size * sizeof(int32_t));
-			memset(c->usorted, 0, c->size * sizeof(uint32_t));
-
 			cpress = samp[i][j].pressure;
 
-			memmove(&c->delay_mt[j][0],
-				&c->delay_mt[j][1],
-				(c->size - 1) * sizeof(c->delay_mt[j][0]));
-			c->delay_mt[j][c->size - 1] = samp[i][j];
-
-			PREPARESAMPLE_MT(c->sorted, c, x, j);
-			printsamples_mt("MEDIAN: X Before", c->sorted, c->size, j);
-			qsort(&c->sorted[0], c->size, sizeof(c->sorted[0]), comp_int);
-			samp[i][j].x = c->sorted[c->size / 2];
-			printsamples_mt("MEDIAN: X After ", c->sorted, c->size, j);
-
-			PREPARESAMPLE_MT(c->sorted, c, y, j);
-			printsamples_mt("MEDIAN: Y Before", c->sorted, c->size, j);
-			qsort(&c->sorted[0], c->size, sizeof(c->sorted[0]), comp_int);
-			samp[i][j].y = c->sorted[c->size / 2];
-			printsamples_mt("MEDIAN: Y After ", c->sorted, c->size, j);
-
-			PREPARESAMPLE_MT(c->usorted, c, pressure, j);
-			printsamples_mt("MEDIAN: Pressure Before",
-					(int *)c->usorted, c->size, j);
-			qsort(&c->usorted[0], c->size, sizeof(c->usorted[0]),
-			      comp_uint);
-			samp[i][j].pressure = c->usorted[c->size / 2];
-			printsamples_mt("MEDIAN: Pressure After ",
-					(int *)c->usorted, c->size, j);
+			median_push(&c->win_mt[j], c->size, &samp[i][j].x,
+				    &samp[i][j].y, &samp[i][j].pressure);
 
 			printsample_mt("MEDIAN: ", &samp[i][j]);
 
@@ -309,9 +380,7 @@ static int median_read_mt(struct tslib_module_info *inf,
 				 * wait for c->size / 2 samples until we get
 				 * valid data again
 				 */
-				memset(c->delay_mt[j],
-				       0,
-				       sizeof(struct ts_sample_mt) * c->size);
+				median_window_reset(&c->win_mt[j], c->size);
 
 				c->withsamples_mt[j] = 0;
 			#ifdef DEBUG
@@ -341,7 +410,7 @@ static int median_read_mt(struct tslib_module_info *inf,
 		}
 	}
 
-	return ret;
+	return nr;
 }
 
 static int median_fini(struct tslib_module_info *inf)
@@ -349,15 +418,14 @@ static int median_fini(struct tslib_module_info *inf)
 	struct median_context *c = (struct median_context *) inf;
 	int i;
 
-	free(c->delay);
+	median_window_free(&c->win);
 
 	for (i = 0; i < c->slots; i++)
-		free(c->delay_mt[i]);
+		median_window_free(&c->win_mt[i]);
 
-	free(c->delay_mt);
+	free(c->win_mt);
 	free(c->withsamples_mt);
-	free(c->sorted);
-	free(c->usorted);
+	free(c->pen_down);
 
 	free(inf);
 
@@ -365,8 +433,10 @@ static int median_fini(struct tslib_module_info *inf)
 }
 
 static const struct tslib_ops median_ops = {
-	.read		= median_read,
-	.read_mt	= median_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= median_process,
+	.process_mt	= median_process_mt,
 	.fini		= median_fini,
 };
 
@@ -385,17 +455,13 @@ static int median_depth(struct tslib_module_info *inf, char *str,
 		return -1;
 	}
 
-	errno = err;
-	m->delay = malloc(sizeof(struct ts_sample) * v);
-	m->size = v;
-
-	m->sorted = calloc(m->size, sizeof(int32_t));
-	if (!m->sorted)
+	if (v == 0) {
+		fprintf(stderr, "MEDIAN: depth has to be at least 1\n");
 		return -1;
+	}
 
-	m->usorted = calloc(m->size, sizeof(uint32_t));
-	if (!m->usorted)
-		return -1;
+	errno = err;
+	m->size = v;
 
 	return 0;
 }
@@ -419,24 +485,26 @@ TSAPI struct tslib_module_info *median_mod_init(__attribute__ ((unused)) struct
 	c->module.ops = &median_ops;
 
 	c->withsamples_mt = NULL;
-	c->delay_mt = NULL;
+	c->win_mt = NULL;
 	c->slots = 0;
-	c->sorted = NULL;
-	c->usorted = NULL;
 
 	if (tslib_parse_vars(&c->module, median_vars, NR_VARS, params)) {
 		free(c);
 		return NULL;
 	}
 
-	if (c->delay == NULL) {
-		c->delay = malloc(sizeof(struct ts_sample) * 3);
+	if (c->size == 0) {
 		c->size = 3;
 	#ifdef DEBUG
 		printf("Using default size of 3\n");
 	#endif
 	}
 
+	if (median_window_init(&c->win, c->size)) {
+		free(c);
+		return NULL;
+	}
+
 	return &c->module;
 }
 
@@ -0,0 +1,289 @@
+/*
+ *  tslib/plugins/oneeuro.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Problem: a smoothing filter with fixed weights, like dejitter or
+ * lowpass, lags as much behind a fast swipe as it does behind a finger
+ * that barely moves. Weak smoothing leaves the slow finger jittery.
+ *
+ * Solution: the 1 Euro filter, a low-pass filter whose cutoff frequency
+ * rises with the speed of the finger. Nearly still, it smooths a lot;
+ * moving fast, the samples almost pass through. The speed it goes by is
+ * low-pass filtered itself, at a fixed cutoff.
+ *
+ * See Casiez, Roussel and Vogel, "1 Euro Filter: A Simple Speed-based
+ * Low-pass Filter for Noisy Input in Interactive Systems", CHI 2012.
+ *
+ * Positions and speeds are kept in fixed point, 16 bits fraction, and
+ * frequencies in mHz; only the parameters are parsed as floating point.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "tslib-filter.h"
+
+#define SHIFT		16
+#define ONE		((int64_t)1 << SHIFT)
+
+/* 1e9 / (2 pi): the time constant in us of a low-pass at 1 mHz */
+#define TAU_1MHZ	159154943LL
+
+/* don't bother with gaps longer than this, in us */
+#define MAX_DELTA	1000000
+
+/* nor with speeds above this, in px/s */
+#define MAX_SPEED	1000000
+
+struct ts_oneeuro_axis {
+	int64_t x;		/* px */
+	int64_t dx;		/* px/s */
+};
+
+struct ts_oneeuro_slot {
+	struct ts_oneeuro_axis axis[2];
+	int64_t t;		/* us */
+	int active;
+	int32_t tracking_id;
+};
+
+struct tslib_oneeuro {
+	struct tslib_module_info module;
+	int64_t mincutoff;	/* mHz */
+	int64_t beta;		/* mHz per px/s */
+	int64_t dcutoff;	/* mHz */
+
+	struct ts_oneeuro_slot st;
+	struct ts_oneeuro_slot *slots_mt;
+	int slots;
+};
+
+/* smoothing factor of a low-pass at cutoff (mHz), for a step of dt (us) */
+static int64_t oneeuro_alpha(int64_t cutoff, int64_t dt)
+{
+	int64_t tau;
+
+	if (cutoff < 1)
+		cutoff = 1;
+
+	tau = TAU_1MHZ / cutoff;
+
+	return (dt << SHIFT) / (dt + tau);
+}
+
+static void oneeuro_axis(const struct tslib_oneeuro *f,
+			 struct ts_oneeuro_axis *ax, int pos, int64_t dt)
+{
+	int64_t x = (int64_t)pos << SHIFT;
+	int64_t dx, speed, a;
+
+	/* how fast it moves, smoothed */
+	dx = (x - ax->x) * 1000000 / dt;
+	if (dx > MAX_SPEED * ONE)
+		dx = MAX_SPEED * ONE;
+	else if (dx < -MAX_SPEED * ONE)
+		dx = -MAX_SPEED * ONE;
+	a = oneeuro_alpha(f->dcutoff, dt);
+	ax->dx += ((dx - ax->dx) * a) >> SHIFT;
+
+	/* the faster, the less we smooth */
+	speed = ax->dx < 0 ? -ax->dx : ax->dx;
+	a = oneeuro_alpha(f->mincutoff + ((f->beta * speed) >> (2 * SHIFT)),
+			  dt);
+	ax->x += ((x - ax->x) * a) >> SHIFT;
+}
+
+static void oneeuro_slot_reset(struct ts_oneeuro_slot *s, int32_t tracking_id)
+{
+	s->active = 0;
+	s->tracking_id = tracking_id;
+}
+
+/* feed a sample of a touching contact, and smooth it */
+static void oneeuro_slot(const struct tslib_oneeuro *f,
+			 struct ts_oneeuro_slot *s, const struct timeval *tv,
+			 int *x, int *y)
+{
+	int64_t t = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	int64_t dt = t - s->t;
+	int i;
+
+	if (!s->active || dt < 0) {
+		s->axis[0].x = (int64_t)*x << SHIFT;
+		s->axis[1].x = (int64_t)*y << SHIFT;
+		for (i = 0; i < 2; i++)
+			s->axis[i].dx = 0;
+		s->t = t;
+		s->active = 1;
+		return;
+	}
+
+	/* no time passed, so it can't have moved much */
+	if (dt == 0)
+		dt = 1;
+	if (dt > MAX_DELTA)
+		dt = MAX_DELTA;
+
+	oneeuro_axis(f, &s->axis[0], *x, dt);
+	oneeuro_axis(f, &s->axis[1], *y, dt);
+	s->t = t;
+
+	*x = (int)((s->axis[0].x + ONE / 2) >> SHIFT);
+	*y = (int)((s->axis[1].x + ONE / 2) >> SHIFT);
+}
+
+static int oneeuro_process(struct tslib_module_info *info,
+			   struct ts_sample *samp, int nr,
+			   __attribute__ ((unused)) int max)
+{
+	struct tslib_oneeuro *f = (struct tslib_oneeuro *)info;
+	int i;
+
+	for (i = 0; i < nr; i++, samp++) {
+		if (samp->pressure == 0) {
+			oneeuro_slot_reset(&f->st, -1);
+			continue;
+		}
+
+		oneeuro_slot(f, &f->st, &samp->tv, &samp->x, &samp->y);
+	}
+
+	return nr;
+}
+
+static int oneeuro_process_mt(struct tslib_module_info *info,
+			      struct ts_sample_mt **samp, int max_slots,
+			      int nr, __attribute__ ((unused)) int max)
+{
+	struct tslib_oneeuro *f = (struct tslib_oneeuro *)info;
+	struct ts_oneeuro_slot *slot;
+	struct ts_sample_mt *s;
+	int i, j;
+
+	if (f->slots_mt == NULL || max_slots > f->slots) {
+		free(f->slots_mt);
+		f->slots_mt = calloc(max_slots, sizeof(*f->slots_mt));
+		if (!f->slots_mt) {
+			f->slots = 0;
+			return -ENOMEM;
+		}
+
+		for (j = 0; j < max_slots; j++)
+			oneeuro_slot_reset(&f->slots_mt[j], -1);
+		f->slots = max_slots;
+	}
+
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < max_slots; j++) {
+			s = &samp[i][j];
+			slot = &f->slots_mt[j];
+
+			if (!(s->valid & TSLIB_MT_VALID))
+				continue;
+
+			if (s->pressure == 0 || s->tracking_id == -1) {
+				oneeuro_slot_reset(slot, -1);
+				continue;
+			}
+			if (s->tracking_id != slot->tracking_id)
+				oneeuro_slot_reset(slot, s->tracking_id);
+
+			oneeuro_slot(f, slot, &s->tv, &s->x, &s->y);
+		}
+	}
+
+	return nr;
+}
+
+static int oneeuro_fini(struct tslib_module_info *info)
+{
+	struct tslib_oneeuro *f = (struct tslib_oneeuro *)info;
+
+	free(f->slots_mt);
+	free(info);
+
+	return 0;
+}
+
+static const struct tslib_ops oneeuro_ops = {
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= oneeuro_process,
+	.process_mt	= oneeuro_process_mt,
+	.fini		= oneeuro_fini,
+};
+
+static int oneeuro_opt(struct tslib_module_info *inf, char *str, void *data)
+{
+	struct tslib_oneeuro *f = (struct tslib_oneeuro *)inf;
+	double v;
+	char *end;
+	int err = errno;
+
+	errno = 0;
+	v = strtod(str, &end);
+
+	if (errno == ERANGE || *end != '\0' || v < 0 || v > 1000)
+		return -1;
+
+	errno = err;
+	switch ((int)(intptr_t)data) {
+	case 1:
+		f->mincutoff = (int64_t)(v * 1000 + 0.5);
+		break;
+	case 2:
+		if (v > 1)
+			return -1;
+		f->beta = (int64_t)(v * 1000 * ONE + 0.5);
+		break;
+	case 3:
+		f->dcutoff = (int64_t)(v * 1000 + 0.5);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static const struct tslib_vars oneeuro_vars[] = {
+	{ "mincutoff",	(void *)1, oneeuro_opt },
+	{ "beta",	(void *)2, oneeuro_opt },
+	{ "dcutoff",	(void *)3, oneeuro_opt },
+};
+
+#define NR_VARS (sizeof(oneeuro_vars) / sizeof(oneeuro_vars[0]))
+
+TSAPI struct tslib_module_info *oneeuro_mod_init(__attribute__ ((unused)) struct tsdev *dev,
+						 const char *params)
+{
+	struct tslib_oneeuro *f;
+
+	f = calloc(1, sizeof(struct tslib_oneeuro));
+	if (f == NULL)
+		return NULL;
+
+	f->module.ops = &oneeuro_ops;
+
+	f->mincutoff = 1000;		/* 1 Hz */
+	f->beta = 10 * ONE;		/* 0.01 Hz per px/s */
+	f->dcutoff = 1000;		/* 1 Hz */
+	oneeuro_slot_reset(&f->st, -1);
+
+	if (tslib_parse_vars(&f->module, oneeuro_vars, NR_VARS, params)) {
+		free(f);
+		return NULL;
+	}
+
+	return &f->module;
+}
+
+#ifndef TSLIB_STATIC_ONEEURO_MODULE
+	TSLIB_MODULE_INIT(oneeuro_mod_init);
+#endif
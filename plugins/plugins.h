@@ -17,6 +17,9 @@ TSLIB_DECLARE_MODULE(iir);
 TSLIB_DECLARE_MODULE(evthres);
 TSLIB_DECLARE_MODULE(lowpass);
 TSLIB_DECLARE_MODULE(crop);
+TSLIB_DECLARE_MODULE(oneeuro);
+TSLIB_DECLARE_MODULE(predict);
+TSLIB_DECLARE_MODULE(resample);
 
 TSLIB_DECLARE_MODULE(arctic2);
 TSLIB_DECLARE_MODULE(collie);
@@ -30,6 +33,8 @@ TSLIB_DECLARE_MODULE(input_evdev);
 TSLIB_DECLARE_MODULE(input);
 TSLIB_DECLARE_MODULE(mk712);
 TSLIB_DECLARE_MODULE(one_wire_ts_input);
+TSLIB_DECLARE_MODULE(replay);
+TSLIB_DECLARE_MODULE(synth);
 TSLIB_DECLARE_MODULE(tatung);
 TSLIB_DECLARE_MODULE(touchkit);
 TSLIB_DECLARE_MODULE(ucb1x00);
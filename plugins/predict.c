@@ -0,0 +1,394 @@
+/*
+ *  tslib/plugins/predict.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Problem: what the user sees lags behind the finger by the time it takes
+ * the sample to get through the application and the display pipeline.
+ * When drawing or dragging, the line ends well behind the finger.
+ *
+ * Solution: we track every contact with a Kalman filter, that models it
+ * as moving at a constant velocity (or with a constant acceleration), and
+ * hand out where it will be after a given time, the horizon. The filter
+ * weighs the motion model against the noise of the samples, so a jittery
+ * panel doesn't make the prediction jump around.
+ *
+ * Everything is done in fixed point, 16 bits fraction, with times in ms.
+ * See https://en.wikipedia.org/wiki/Kalman_filter for the theory.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "tslib-filter.h"
+
+#define SHIFT		16
+#define ONE		((int64_t)1 << SHIFT)
+
+/* model orders: position and velocity, or acceleration too */
+#define MODEL_VELOCITY		2
+#define MODEL_ACCELERATION	3
+
+/* a longer gap than this (in us) starts the track anew */
+#define MAX_DELTA	50000
+
+struct ts_predict_axis {
+	int64_t x[3];		/* px, px/ms, px/ms^2 */
+	int64_t p[3][3];	/* their covariance */
+};
+
+struct ts_predict_slot {
+	struct ts_predict_axis axis[2];
+	int64_t t;		/* of the last sample, in us */
+	int active;
+	int32_t tracking_id;
+};
+
+struct tslib_predict {
+	struct tslib_module_info module;
+	int n;			/* MODEL_VELOCITY or MODEL_ACCELERATION */
+	int64_t horizon;	/* in ms */
+	int64_t noise;		/* of the highest derivative, per ms */
+	int64_t jitter;		/* variance of the samples, px^2 */
+	unsigned int horizon_us;
+
+	struct ts_predict_slot st;
+	struct ts_predict_slot *slots_mt;
+	int slots;
+};
+
+static int64_t mul(int64_t a, int64_t b)
+{
+	return (a * b) >> SHIFT;
+}
+
+static void predict_axis_init(const struct tslib_predict *p,
+			      struct ts_predict_axis *ax, int pos)
+{
+	memset(ax, 0, sizeof(*ax));
+
+	/*
+	 * We know where it is, but not where it's going: allow for up to
+	 * 2 px/ms and 0.1 px/ms^2.
+	 */
+	ax->x[0] = (int64_t)pos << SHIFT;
+	ax->p[0][0] = p->jitter;
+	ax->p[1][1] = 4 * ONE;
+	ax->p[2][2] = ONE / 100;
+}
+
+/* move the state dt (ms) ahead */
+static void predict_axis_time(const struct tslib_predict *p,
+			      struct ts_predict_axis *ax, int64_t dt)
+{
+	int64_t f[3][3] = { { ONE, 0, 0 }, { 0, ONE, 0 }, { 0, 0, ONE } };
+	int64_t fp[3][3];
+	int64_t x[3] = { 0 };
+	int64_t g[3];
+	int n = p->n;
+	int i, j, k;
+
+	f[0][1] = dt;
+	f[1][2] = dt;
+	f[0][2] = mul(dt, dt) / 2;
+
+	/* x = F x, P = F P F' */
+	for (i = 0; i < n; i++) {
+		x[i] = 0;
+		for (k = 0; k < n; k++)
+			x[i] += mul(f[i][k], ax->x[k]);
+	}
+	memcpy(ax->x, x, sizeof(x));
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			fp[i][j] = 0;
+			for (k = 0; k < n; k++)
+				fp[i][j] += mul(f[i][k], ax->p[k][j]);
+		}
+	}
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			ax->p[i][j] = 0;
+			for (k = 0; k < n; k++)
+				ax->p[i][j] += mul(fp[i][k], f[j][k]);
+		}
+	}
+
+	/*
+	 * The highest derivative changes randomly, by noise per ms. That
+	 * adds G G' noise^2 to P, with G what such a change does to the
+	 * state after dt.
+	 */
+	g[n - 1] = dt;
+	g[n - 2] = mul(dt, dt) / 2;
+	if (n == MODEL_ACCELERATION)
+		g[0] = mul(mul(dt, dt), dt) / 6;
+
+	for (i = 0; i < n; i++)
+		g[i] = mul(g[i], p->noise);
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++)
+			ax->p[i][j] += mul(g[i], g[j]);
+	}
+}
+
+/* correct the state by a measured position */
+static void predict_axis_update(const struct tslib_predict *p,
+				struct ts_predict_axis *ax, int pos)
+{
+	int64_t k[3];
+	int64_t p0[3];
+	int64_t s, y;
+	int n = p->n;
+	int i, j;
+
+	s = ax->p[0][0] + p->jitter;
+	if (s <= 0)
+		s = 1;
+
+	y = ((int64_t)pos << SHIFT) - ax->x[0];
+
+	for (i = 0; i < n; i++) {
+		k[i] = (ax->p[i][0] << SHIFT) / s;
+		p0[i] = ax->p[0][i];
+	}
+
+	for (i = 0; i < n; i++) {
+		ax->x[i] += mul(k[i], y);
+		for (j = 0; j < n; j++)
+			ax->p[i][j] -= mul(k[i], p0[j]);
+	}
+}
+
+static int predict_axis_ahead(const struct tslib_predict *p,
+			      const struct ts_predict_axis *ax)
+{
+	int64_t h = p->horizon;
+	int64_t pos;
+
+	pos = ax->x[0] + mul(ax->x[1], h);
+	if (p->n == MODEL_ACCELERATION)
+		pos += mul(ax->x[2], mul(h, h)) / 2;
+
+	return (int)((pos + ONE / 2) >> SHIFT);
+}
+
+static void predict_slot_reset(struct ts_predict_slot *s, int32_t tracking_id)
+{
+	s->active = 0;
+	s->tracking_id = tracking_id;
+}
+
+/* feed a sample of a touching contact, and move it to where it will be */
+static void predict_slot(struct tslib_predict *p, struct ts_predict_slot *s,
+			 const struct timeval *tv, int *x, int *y)
+{
+	int64_t t = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	int64_t dt = t - s->t;
+
+	if (!s->active || dt < 0 || dt > MAX_DELTA) {
+		predict_axis_init(p, &s->axis[0], *x);
+		predict_axis_init(p, &s->axis[1], *y);
+		s->t = t;
+		s->active = 1;
+		return;
+	}
+
+	dt = (dt << SHIFT) / 1000;
+	predict_axis_time(p, &s->axis[0], dt);
+	predict_axis_time(p, &s->axis[1], dt);
+	predict_axis_update(p, &s->axis[0], *x);
+	predict_axis_update(p, &s->axis[1], *y);
+	s->t = t;
+
+	*x = predict_axis_ahead(p, &s->axis[0]);
+	*y = predict_axis_ahead(p, &s->axis[1]);
+}
+
+static int predict_process(struct tslib_module_info *info,
+			   struct ts_sample *samp, int nr,
+			   __attribute__ ((unused)) int max)
+{
+	struct tslib_predict *p = (struct tslib_predict *)info;
+	int i;
+
+	for (i = 0; i < nr; i++, samp++) {
+		if (samp->pressure == 0) {
+			predict_slot_reset(&p->st, -1);
+			continue;
+		}
+
+		predict_slot(p, &p->st, &samp->tv, &samp->x, &samp->y);
+	}
+
+	return nr;
+}
+
+static int predict_process_mt(struct tslib_module_info *info,
+			      struct ts_sample_mt **samp, int max_slots,
+			      int nr, __attribute__ ((unused)) int max)
+{
+	struct tslib_predict *p = (struct tslib_predict *)info;
+	struct ts_predict_slot *slot;
+	struct ts_sample_mt *s;
+	int i, j;
+
+	if (p->slots_mt == NULL || max_slots > p->slots) {
+		free(p->slots_mt);
+		p->slots_mt = calloc(max_slots, sizeof(*p->slots_mt));
+		if (!p->slots_mt) {
+			p->slots = 0;
+			return -ENOMEM;
+		}
+
+		for (j = 0; j < max_slots; j++)
+			predict_slot_reset(&p->slots_mt[j], -1);
+		p->slots = max_slots;
+	}
+
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < max_slots; j++) {
+			s = &samp[i][j];
+			slot = &p->slots_mt[j];
+
+			if (!(s->valid & TSLIB_MT_VALID))
+				continue;
+
+			/* releases stay where they are */
+			if (s->pressure == 0 || s->tracking_id == -1) {
+				predict_slot_reset(slot, -1);
+				continue;
+			}
+			if (s->tracking_id != slot->tracking_id)
+				predict_slot_reset(slot, s->tracking_id);
+
+			predict_slot(p, slot, &s->tv, &s->x, &s->y);
+		}
+	}
+
+	return nr;
+}
+
+static int predict_fini(struct tslib_module_info *info)
+{
+	struct tslib_predict *p = (struct tslib_predict *)info;
+
+	free(p->slots_mt);
+	free(info);
+
+	return 0;
+}
+
+static const struct tslib_ops predict_ops = {
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= predict_process,
+	.process_mt	= predict_process_mt,
+	.fini		= predict_fini,
+};
+
+static int predict_opt(struct tslib_module_info *inf, char *str, void *data)
+{
+	struct tslib_predict *p = (struct tslib_predict *)inf;
+	unsigned long v;
+	char *end;
+	int err = errno;
+
+	if ((int)(intptr_t)data == 2) {
+		if (strcmp(str, "velocity") == 0)
+			p->n = MODEL_VELOCITY;
+		else if (strcmp(str, "acceleration") == 0)
+			p->n = MODEL_ACCELERATION;
+		else
+			return -1;
+		return 0;
+	}
+
+	v = strtoul(str, &end, 0);
+
+	if (v == ULONG_MAX && errno == ERANGE)
+		return -1;
+
+	errno = err;
+	switch ((int)(intptr_t)data) {
+	case 1:
+		/* "15ms", "15000us" or "15" */
+		if (strcmp(end, "us") == 0)
+			;
+		else if (*end == '\0' || strcmp(end, "ms") == 0)
+			v *= 1000;
+		else
+			return -1;
+		if (v > 100000)
+			return -1;
+		p->horizon_us = v;
+		break;
+	case 3:
+		if (*end != '\0' || v > 1000000)
+			return -1;
+		p->noise = ((int64_t)v << SHIFT) / 1000;
+		break;
+	case 4:
+		if (*end != '\0' || v > 1000)
+			return -1;
+		p->jitter = (int64_t)(v * v) << SHIFT;
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static const struct tslib_vars predict_vars[] = {
+	{ "horizon",	(void *)1, predict_opt },
+	{ "model",	(void *)2, predict_opt },
+	{ "noise",	(void *)3, predict_opt },
+	{ "jitter",	(void *)4, predict_opt },
+};
+
+#define NR_VARS (sizeof(predict_vars) / sizeof(predict_vars[0]))
+
+TSAPI struct tslib_module_info *predict_mod_init(__attribute__ ((unused)) struct tsdev *dev,
+						 const char *params)
+{
+	struct tslib_predict *p;
+
+	p = calloc(1, sizeof(struct tslib_predict));
+	if (p == NULL)
+		return NULL;
+
+	p->module.ops = &predict_ops;
+
+	p->n = MODEL_VELOCITY;
+	p->horizon_us = 10000;
+	p->noise = -1;
+	p->jitter = (int64_t)4 << SHIFT;
+	predict_slot_reset(&p->st, -1);
+
+	if (tslib_parse_vars(&p->module, predict_vars, NR_VARS, params)) {
+		free(p);
+		return NULL;
+	}
+
+	p->horizon = ((int64_t)p->horizon_us << SHIFT) / 1000;
+
+	/* in thousandths of a px/ms^2, or px/ms^3 */
+	if (p->noise < 0)
+		p->noise = p->n == MODEL_VELOCITY ? ONE * 20 / 1000 :
+						    ONE * 2 / 1000;
+
+	return &p->module;
+}
+
+#ifndef TSLIB_STATIC_PREDICT_MODULE
+	TSLIB_MODULE_INIT(predict_mod_init);
+#endif
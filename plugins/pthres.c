@@ -35,121 +35,87 @@ struct tslib_pthres {
 	int		*ysave;
 	int		*press;
 	int		current_max_slots;
+	/* single touch, for read() */
+	int		st_xsave;
+	int		st_ysave;
+	int		st_press;
 };
 
-static int pthres_read(struct tslib_module_info *info, struct ts_sample *samp,
-		       int nr_samples)
+static int pthres_process(struct tslib_module_info *info,
+			  struct ts_sample *samp, int nr_samples,
+			  __attribute__ ((unused)) int max)
 {
 	struct tslib_pthres *p = (struct tslib_pthres *)info;
-	int ret;
-	static int xsave, ysave;
-	static int press;
-
-	ret = info->next->ops->read(info->next, samp, nr_samples);
-	if (ret >= 0) {
-		int nr = 0, i;
-		struct ts_sample *s;
-
-		for (s = samp, i = 0; i < ret; i++, s++) {
-			if (s->pressure < p->pmin) {
-				if (press != 0) {
-					/* release */
-					press = 0;
-					s->pressure = 0;
-					s->x = xsave;
-					s->y = ysave;
-				} else {
-					/* release with no press,
-					 * outside bounds, dropping
-					 */
-					int left = ret - nr - 1;
-
-					if (left > 0) {
-						memmove(s,
-							s + 1,
-							left * sizeof(struct ts_sample));
-						s--;
-						continue;
-					}
-					break;
-				}
+	int nr = 0, i;
+	struct ts_sample *s;
+
+	for (s = samp, i = 0; i < nr_samples; i++, s++) {
+		if (s->pressure < p->pmin) {
+			if (p->st_press != 0) {
+				/* release */
+				p->st_press = 0;
+				s->pressure = 0;
+				s->x = p->st_xsave;
+				s->y = p->st_ysave;
 			} else {
-				if (s->pressure > p->pmax) {
-					/* pressure outside bounds, dropping */
-					int left = ret - nr - 1;
-
-					if (left > 0) {
-						memmove(s,
-							s + 1,
-							left * sizeof(struct ts_sample));
-						s--;
-						continue;
-					}
-					break;
-				}
-				/* press */
-				press = 1;
-				xsave = s->x;
-				ysave = s->y;
+				/* release with no press,
+				 * outside bounds, dropping
+				 */
+				continue;
+			}
+		} else {
+			if (s->pressure > p->pmax) {
+				/* pressure outside bounds, dropping */
+				continue;
 			}
-			nr++;
+			/* press */
+			p->st_press = 1;
+			p->st_xsave = s->x;
+			p->st_ysave = s->y;
 		}
-		return nr;
+
+		if (nr != i)
+			samp[nr] = *s;
+		nr++;
 	}
-	return ret;
+	return nr;
 }
 
-static int pthres_read_mt(struct tslib_module_info *info,
-			  struct ts_sample_mt **samp, int max_slots,
-			  int nr_samples)
+static int pthres_process_mt(struct tslib_module_info *info,
+			     struct ts_sample_mt **samp, int max_slots,
+			     int nr_samples, __attribute__ ((unused)) int max)
 {
 	struct tslib_pthres *p = (struct tslib_pthres *)info;
-	int ret;
 	int i, j;
 
 	if (p->xsave == NULL || max_slots > p->current_max_slots) {
 		free(p->xsave);
-
-		p->xsave = calloc(max_slots, sizeof(int));
-		if (!p->xsave)
-			return -ENOMEM;
-
-		p->current_max_slots = max_slots;
-	}
-
-	if (p->ysave == NULL || max_slots > p->current_max_slots) {
 		free(p->ysave);
-
-		p->ysave = calloc(max_slots, sizeof(int));
-		if (!p->ysave)
-			return -ENOMEM;
-
-		p->current_max_slots = max_slots;
-	}
-
-	if (p->press == NULL || max_slots > p->current_max_slots) {
 		free(p->press);
 
+		p->xsave = calloc(max_slots, sizeof(int));
+		p->ysave = calloc(max_slots, sizeof(int));
 		p->press = calloc(max_slots, sizeof(int));
-		if (!p->press)
+		if (!p->xsave || !p->ysave || !p->press) {
+			free(p->xsave);
+			free(p->ysave);
+			free(p->press);
+			p->xsave = NULL;
+			p->ysave = NULL;
+			p->press = NULL;
 			return -ENOMEM;
+		}
 
 		p->current_max_slots = max_slots;
 	}
 
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr_samples);
-	if (ret < 0)
-		return ret;
-
 #ifdef DEBUG
-	printf("PTHRES:   read %d samples (mem: %d nr x %d slots)\n",
-	       ret, nr_samples, max_slots);
+	if (nr_samples)
+		printf("PTHRES:   read %d samples (mem: %d nr x %d slots)\n",
+		       nr_samples, max, max_slots);
 #endif
 
-	for (i = 0; i < ret; i++) {
+	for (i = 0; i < nr_samples; i++) {
 		for (j = 0; j < max_slots; j++) {
 			if (!(samp[i][j].valid & TSLIB_MT_VALID))
 				continue;
@@ -179,7 +145,7 @@ static int pthres_read_mt(struct tslib_module_info *info,
 		}
 	}
 
-	return ret;
+	return nr_samples;
 }
 
 static int pthres_fini(struct tslib_module_info *info)
@@ -196,8 +162,10 @@ static int pthres_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops pthres_ops = {
-	.read		= pthres_read,
-	.read_mt	= pthres_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= pthres_process,
+	.process_mt	= pthres_process_mt,
 	.fini		= pthres_fini,
 };
 
@@ -254,6 +222,9 @@ TSAPI struct tslib_module_info *pthres_mod_init(__attribute__ ((unused)) struct
 	p->ysave = NULL;
 	p->press = NULL;
 	p->current_max_slots = 0;
+	p->st_xsave = 0;
+	p->st_ysave = 0;
+	p->st_press = 0;
 
 	/*
 	 * Parse the parameters.
@@ -0,0 +1,538 @@
+/*
+ *  tslib/plugins/replay-raw.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Replay a recording of evemu-record, like those in tests/scripts/, through
+ * the filters in ts.conf. There is no device, no uinput and no root needed.
+ *
+ * We stand in for the device underneath input-raw, which is compiled in
+ * here: it asks us what the device has and reads the events from us, and
+ * decodes them exactly like it would those of the real thing. With
+ * speed=max, events are handed out as fast as they're read, stamped with
+ * the recorded times, for benchmarks and regression tests.
+ *
+ * With speed=realtime, only blocking reads wait for the next event. The
+ * device or file underneath is always readable, so a reader that polls it
+ * and reads non-blocking gets -EAGAIN and spins until the event is due.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+
+struct replay;
+
+static int replay_ioctl(struct replay *r, unsigned long req, void *arg);
+static ssize_t replay_read(struct replay *r, void *buf, size_t len);
+static void replay_free(struct replay *r);
+
+#define INPUT_RAW_REPLAY
+#include "input-raw.c"
+
+#include <fcntl.h>
+#include <time.h>
+
+#ifdef __FreeBSD__
+#define _IOC_NR(req)	((req) & 0xff)
+#define _IOC_TYPE(req)	(((req) >> 8) & 0xff)
+#define _IOC_SIZE(req)	IOCPARM_LEN(req)
+#endif
+
+/* between the end of the recording and the start of the next loop, in us */
+#define REPLAY_LOOP_GAP	100000
+
+struct replay_event {
+	int64_t time;		/* us, as recorded */
+	uint16_t type;
+	uint16_t code;
+	int32_t value;
+};
+
+struct replay {
+	struct tsdev *ts;
+	char *file;
+	int realtime;
+	int warned;		/* about a non-blocking read with realtime */
+	int loops;		/* left to play, 0 for ever */
+
+	/* what the device is, from the recording's header */
+	struct input_id id;
+	long bits[EV_CNT][BITS_TO_LONGS(KEY_CNT)];
+	struct input_absinfo abs[ABS_CNT];
+
+	/* and its state, after what we handed out */
+	long key[BITS_TO_LONGS(KEY_CNT)];
+	int32_t *mt;		/* [code - ABS_MT_SLOT - 1][slot] */
+	int slots;
+
+	/* what input-raw told us */
+	long mask_abs[BITS_TO_LONGS(ABS_CNT)];
+	long mask_msc[BITS_TO_LONGS(MSC_CNT)];
+	int clock;
+
+	struct replay_event *ev;
+	size_t nr;
+	size_t pos;
+	int64_t offset;		/* us, for the loops played already */
+	int64_t start;		/* us of clock when speed=realtime started */
+	int dropped;		/* handed out SYN_DROPPED, not yet SYN_REPORT */
+};
+
+#define REPLAY_MT_CODES	(ABS_MT_TOOL_Y - ABS_MT_SLOT)
+
+static int test_bit(const long *bits, unsigned int nr)
+{
+	return !!(bits[BIT_WORD(nr)] & BIT_MASK(nr));
+}
+
+static int64_t replay_now(const struct replay *r)
+{
+	struct timespec now;
+
+	clock_gettime(r->clock, &now);
+
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* "B: 03 03 00 00 00 00 80 e0 0a", the next 8 bytes of type 03 */
+static void replay_parse_bits(struct replay *r, const char *line,
+			      unsigned int *len)
+{
+	unsigned int type, byte, bit;
+	int n;
+
+	if (sscanf(line, "B: %x%n", &type, &n) != 1 || type >= EV_CNT)
+		return;
+
+	line += n;
+	while (sscanf(line, " %x%n", &byte, &n) == 1) {
+		for (bit = 0; bit < 8; bit++) {
+			if (!(byte & (1 << bit)) || len[type] + bit >= KEY_CNT)
+				continue;
+			r->bits[type][BIT_WORD(len[type] + bit)] |=
+						BIT_MASK(len[type] + bit);
+		}
+		len[type] += 8;
+		line += n;
+	}
+}
+
+static int replay_add(struct replay *r, const struct replay_event *e,
+		      size_t *size)
+{
+	struct replay_event *ev;
+
+	if (r->nr == *size) {
+		*size = *size ? *size * 2 : 4096;
+		ev = realloc(r->ev, *size * sizeof(*ev));
+		if (!ev)
+			return -ENOMEM;
+		r->ev = ev;
+	}
+
+	r->ev[r->nr++] = *e;
+
+	return 0;
+}
+
+static int replay_load(struct replay *r)
+{
+	unsigned int len[EV_CNT] = { 0 };
+	struct replay_event e;
+	unsigned int code, type;
+	long sec, usec;
+	char line[256];
+	size_t size = 0;
+	FILE *f;
+	int j, k;
+
+	if (r->file)
+		f = fopen(r->file, "r");
+	else
+		f = fdopen(dup(r->ts->fd), "r");
+	if (!f) {
+		fprintf(stderr, "tslib: replay: can't open %s: %s\n",
+			r->file ? r->file : r->ts->eventpath, strerror(errno));
+		return -1;
+	}
+
+	/* loaded again by ts_reconfig(), we read the device till the end */
+	if (!r->file)
+		fseek(f, 0, SEEK_SET);
+
+	while (fgets(line, sizeof(line), f)) {
+		switch (line[0]) {
+		case 'I':
+			sscanf(line, "I: %hx %hx %hx %hx", &r->id.bustype,
+			       &r->id.vendor, &r->id.product, &r->id.version);
+			break;
+		case 'B':
+			replay_parse_bits(r, line, len);
+			break;
+		case 'A':
+			if (sscanf(line, "A: %x", &code) != 1 || code >= ABS_CNT)
+				break;
+			sscanf(line, "A: %*x %d %d %d %d %d",
+			       &r->abs[code].minimum, &r->abs[code].maximum,
+			       &r->abs[code].fuzz, &r->abs[code].flat,
+			       &r->abs[code].resolution);
+			break;
+		case 'E':
+			if (sscanf(line, "E: %ld.%ld %x %x %d", &sec, &usec,
+				   &type, &code, &e.value) != 5)
+				break;
+			e.time = (int64_t)sec * 1000000 + usec;
+			e.type = type;
+			e.code = code;
+			if (replay_add(r, &e, &size)) {
+				fclose(f);
+				return -1;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	fclose(f);
+
+	if (r->nr == 0) {
+		fprintf(stderr, "tslib: replay: no events in %s\n",
+			r->file ? r->file : r->ts->eventpath);
+		return -1;
+	}
+
+	r->slots = 1;
+	if (test_bit(r->bits[EV_ABS], ABS_MT_SLOT))
+		r->slots = r->abs[ABS_MT_SLOT].maximum + 1;
+
+	r->mt = calloc((size_t)REPLAY_MT_CODES * r->slots, sizeof(*r->mt));
+	if (!r->mt)
+		return -1;
+
+	/* no contacts yet */
+	k = ABS_MT_TRACKING_ID - ABS_MT_SLOT - 1;
+	for (j = 0; j < r->slots; j++)
+		r->mt[k * r->slots + j] = -1;
+	r->abs[ABS_MT_TRACKING_ID].value = -1;
+
+	return 0;
+}
+
+/* what the kernel would have stored of e */
+static void replay_state(struct replay *r, const struct replay_event *e)
+{
+	int slot = r->abs[ABS_MT_SLOT].value;
+
+	switch (e->type) {
+	case EV_KEY:
+		if (e->code >= KEY_CNT || e->value == 2)
+			break;
+		if (e->value)
+			r->key[BIT_WORD(e->code)] |= BIT_MASK(e->code);
+		else
+			r->key[BIT_WORD(e->code)] &= ~BIT_MASK(e->code);
+		break;
+	case EV_ABS:
+		if (e->code >= ABS_CNT)
+			break;
+		r->abs[e->code].value = e->value;
+		if (e->code > ABS_MT_SLOT && e->code <= ABS_MT_TOOL_Y &&
+		    slot >= 0 && slot < r->slots)
+			r->mt[(e->code - ABS_MT_SLOT - 1) * r->slots + slot] =
+								e->value;
+		break;
+	default:
+		break;
+	}
+}
+
+static int replay_masked(const struct replay *r, const struct replay_event *e)
+{
+	if (e->type == EV_ABS && e->code < ABS_CNT)
+		return !test_bit(r->mask_abs, e->code);
+	if (e->type == EV_MSC && e->code < MSC_CNT)
+		return !test_bit(r->mask_msc, e->code);
+
+	return 0;
+}
+
+/* the next event to hand out, NULL when we're done */
+static const struct replay_event *replay_next(struct replay *r)
+{
+	if (r->pos == r->nr) {
+		if (r->loops == 1)
+			return NULL;
+		if (r->loops > 1)
+			r->loops--;
+
+		r->offset += r->ev[r->nr - 1].time - r->ev[0].time +
+			     REPLAY_LOOP_GAP;
+		r->pos = 0;
+	}
+
+	return &r->ev[r->pos];
+}
+
+/*
+ * Like read() from the device: what is due, at least one event, waiting
+ * for it if the device was opened blocking. -ENODATA at the end.
+ */
+static ssize_t replay_read(struct replay *r, void *buf, size_t len)
+{
+	struct input_event *ev = buf;
+	const struct replay_event *e;
+	struct timespec delay;
+	size_t n = 0;
+	int64_t t, now;
+
+	if (r->realtime && r->start < 0)
+		r->start = replay_now(r);
+
+	while (n < len / sizeof(*ev)) {
+		e = replay_next(r);
+		if (!e)
+			break;
+
+		t = e->time + r->offset;
+		if (r->realtime) {
+			t += r->start - r->ev[0].time;
+			now = replay_now(r);
+			if (t > now && n > 0)
+				break;
+
+			if (t > now) {
+				if (fcntl(r->ts->fd, F_GETFL) & O_NONBLOCK) {
+					if (!r->warned)
+						fprintf(stderr, "tslib: replay: speed=realtime needs blocking reads, poll() spins until events are due\n");
+					r->warned = 1;
+					errno = EAGAIN;
+					return -1;
+				}
+
+				delay.tv_sec = (t - now) / 1000000;
+				delay.tv_nsec = (t - now) % 1000000 * 1000;
+				nanosleep(&delay, NULL);
+			}
+		}
+
+		r->pos++;
+		replay_state(r, e);
+		if (replay_masked(r, e))
+			continue;
+
+		ev[n].input_event_sec = t / 1000000;
+		ev[n].input_event_usec = t % 1000000;
+		ev[n].type = e->type;
+		ev[n].code = e->code;
+		ev[n].value = e->value;
+		n++;
+
+		/*
+		 * After SYN_DROPPED, input-raw asks for the state at the next
+		 * SYN_REPORT. Stop there, so that it's the state it gets.
+		 */
+		if (e->type == EV_SYN && e->code == SYN_DROPPED) {
+			r->dropped = 1;
+		} else if (r->dropped && e->type == EV_SYN &&
+			   e->code == SYN_REPORT) {
+			r->dropped = 0;
+			break;
+		}
+	}
+
+	if (n == 0) {
+		errno = ENODATA;
+		return -1;
+	}
+
+	return n * sizeof(*ev);
+}
+
+static int replay_ioctl(struct replay *r, unsigned long req, void *arg)
+{
+	unsigned int nr = _IOC_NR(req);
+	size_t size = _IOC_SIZE(req);
+	int32_t *values = arg;
+	unsigned int j, k;
+
+	if (_IOC_TYPE(req) != 'E') {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (req == EVIOCGVERSION) {
+		*(int *)arg = EV_VERSION;
+		return 0;
+	} else if (req == EVIOCGID) {
+		memcpy(arg, &r->id, sizeof(r->id));
+		return 0;
+	} else if (req == EVIOCGRAB) {
+		return 0;
+	} else if (req == EVIOCSCLOCKID) {
+		r->clock = *(int *)arg;
+		return 0;
+#ifdef EVIOCSMASK
+	} else if (req == EVIOCSMASK) {
+		struct input_mask *mask = arg;
+
+		if (mask->type == EV_ABS) {
+			memset(r->mask_abs, 0, sizeof(r->mask_abs));
+			memcpy(r->mask_abs, (void *)(uintptr_t)mask->codes_ptr,
+			       mask->codes_size < sizeof(r->mask_abs) ?
+			       mask->codes_size : sizeof(r->mask_abs));
+		} else if (mask->type == EV_MSC) {
+			memset(r->mask_msc, 0, sizeof(r->mask_msc));
+			memcpy(r->mask_msc, (void *)(uintptr_t)mask->codes_ptr,
+			       mask->codes_size < sizeof(r->mask_msc) ?
+			       mask->codes_size : sizeof(r->mask_msc));
+		}
+		return 0;
+#endif
+	}
+
+	/* EVIOCGBIT(ev, len) */
+	if (nr >= 0x20 && nr < 0x20 + EV_CNT) {
+		if (size > sizeof(r->bits[0]))
+			size = sizeof(r->bits[0]);
+		memcpy(arg, r->bits[nr - 0x20], size);
+		return size;
+	}
+
+	/* EVIOCGABS(abs) */
+	if (nr >= 0x40 && nr < 0x40 + ABS_CNT && size == sizeof(r->abs[0])) {
+		if (!test_bit(r->bits[EV_ABS], nr - 0x40)) {
+			errno = EINVAL;
+			return -1;
+		}
+		memcpy(arg, &r->abs[nr - 0x40], sizeof(r->abs[0]));
+		return 0;
+	}
+
+	/* EVIOCGKEY(len) */
+	if (req == EVIOCGKEY(size)) {
+		if (size > sizeof(r->key))
+			size = sizeof(r->key);
+		memcpy(arg, r->key, size);
+		return size;
+	}
+
+	/* EVIOCGMTSLOTS(len), the code in values[0] */
+	if (req == EVIOCGMTSLOTS(size)) {
+		k = values[0];
+		if (k <= ABS_MT_SLOT || k > ABS_MT_TOOL_Y) {
+			errno = EINVAL;
+			return -1;
+		}
+		for (j = 0; j + 1 < size / sizeof(*values); j++) {
+			values[j + 1] = j < (unsigned int)r->slots ?
+				r->mt[(k - ABS_MT_SLOT - 1) * r->slots + j] : 0;
+		}
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+static void replay_free(struct replay *r)
+{
+	if (!r)
+		return;
+
+	free(r->file);
+	free(r->mt);
+	free(r->ev);
+	free(r);
+}
+
+static int replay_opt(struct tslib_module_info *inf, char *str, void *data)
+{
+	struct tslib_input *i = (struct tslib_input *)inf;
+	struct replay *r = i->replay;
+	unsigned long v;
+	char *end;
+	int err = errno;
+
+	if (!str)
+		return -1;
+
+	switch ((int)(intptr_t)data) {
+	case 1:
+		free(r->file);
+		r->file = strdup(str);
+		if (!r->file)
+			return -1;
+		break;
+	case 2:
+		if (strcmp(str, "realtime") == 0)
+			r->realtime = 1;
+		else if (strcmp(str, "max") == 0)
+			r->realtime = 0;
+		else
+			return -1;
+		break;
+	case 3:
+		errno = 0;
+		v = strtoul(str, &end, 0);
+		if (errno || *end != '\0' || v > INT_MAX)
+			return -1;
+		errno = err;
+		r->loops = v;
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static const struct tslib_vars replay_vars[] = {
+	{ "file",	(void *)1, replay_opt },
+	{ "speed",	(void *)2, replay_opt },
+	{ "loop",	(void *)3, replay_opt },
+	{ "ignore",	NULL, parse_raw_ignore },
+};
+
+#define NR_REPLAY_VARS (sizeof(replay_vars) / sizeof(replay_vars[0]))
+
+TSAPI struct tslib_module_info *replay_mod_init(struct tsdev *dev,
+						const char *params)
+{
+	struct tslib_input *i;
+	struct replay *r;
+
+	i = malloc(sizeof(struct tslib_input));
+	r = calloc(1, sizeof(struct replay));
+	if (i == NULL || r == NULL) {
+		free(i);
+		free(r);
+		return NULL;
+	}
+
+	input_init(i);
+	i->replay = r;
+
+	r->ts = dev;
+	r->realtime = 1;
+	r->loops = 1;
+	r->clock = CLOCK_REALTIME;
+	r->start = -1;
+	memset(r->mask_abs, 0xff, sizeof(r->mask_abs));
+	memset(r->mask_msc, 0xff, sizeof(r->mask_msc));
+
+	if (tslib_parse_vars(&i->module, replay_vars, NR_REPLAY_VARS, params) ||
+	    replay_load(r)) {
+		replay_free(r);
+		free(i);
+		return NULL;
+	}
+
+	return &i->module;
+}
+
+#ifndef TSLIB_STATIC_REPLAY_MODULE
+	TSLIB_MODULE_INIT(replay_mod_init);
+#endif
@@ -0,0 +1,404 @@
+/*
+ *  tslib/plugins/resample.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Problem: the touch panel and the display run on clocks of their own.
+ * If a panel reports at 120Hz and the display shows 60 frames a second,
+ * a frame shows the position of one or two samples ago, depending on how
+ * the clocks drift against each other. A steady drag then judders.
+ *
+ * Solution: we move every sample to where the finger was a fixed time
+ * before the frame it will be shown in. That is interpolated between the
+ * last samples, or extrapolated a little from them. The times of the
+ * frames come from ts_option(ts, TS_VSYNC, &tv), or, if the application
+ * doesn't tell us, from the display's rate. The kernel timestamps are
+ * smoothed first, as they carry the jitter of the interrupt handling.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "tslib-private.h"
+#include "tslib-filter.h"
+
+/* positions per slot we interpolate in */
+#define NR_HIST		4
+
+/* frame times to fit a line through */
+#define NR_TIMES	8
+
+/* don't extrapolate further than this, or from samples further apart */
+#define MAX_PREDICTION	8000
+#define MIN_DELTA	2000
+#define MAX_DELTA	20000
+
+struct ts_resample_hist {
+	int64_t t;
+	int x;
+	int y;
+};
+
+struct ts_resample_slot {
+	struct ts_resample_hist hist[NR_HIST];
+	int nr;
+	int head;
+	int32_t tracking_id;
+};
+
+struct tslib_resample {
+	struct tslib_module_info module;
+	unsigned int rate;		/* of the display, in Hz */
+	int64_t latency;		/* in us */
+
+	/* kernel timestamps of the last frames */
+	int64_t t[NR_TIMES];
+	int nr_t;
+	int head_t;
+	int64_t last_t;			/* the smoothed one */
+	int64_t panel_period;		/* fitted, in us, 0 until we know */
+	int64_t t0;			/* our display clock if we have none */
+
+	struct ts_resample_slot st;
+	struct ts_resample_slot *slots_mt;
+	int slots;
+};
+
+static int64_t tv_to_us(const struct timeval *tv)
+{
+	return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static void us_to_tv(int64_t t, struct timeval *tv)
+{
+	tv->tv_sec = t / 1000000;
+	tv->tv_usec = t % 1000000;
+}
+
+/*
+ * Fit a line through the last frame times, over the frame numbers, and
+ * take its value at the last frame. The panel scans at a steady rate, so
+ * that's when it was really read; the kernel stamps it only some time
+ * after that.
+ */
+static int64_t resample_smooth_time(struct tslib_resample *r, int64_t raw)
+{
+	int64_t gap = r->panel_period ? 4 * r->panel_period : 4 * MAX_DELTA;
+	int64_t sum = 0;
+	int64_t sum_xy = 0;
+	int64_t ref, t;
+	int n, i, k;
+
+	/*
+	 * A new stroke, or the clock was set. That's a gap of some panel
+	 * periods, the display's have nothing to do with it.
+	 */
+	if (r->nr_t && (raw < r->t[(r->head_t - 1) & (NR_TIMES - 1)] ||
+			raw - r->t[(r->head_t - 1) & (NR_TIMES - 1)] > gap))
+		r->nr_t = 0;
+
+	r->t[r->head_t] = raw;
+	r->head_t = (r->head_t + 1) & (NR_TIMES - 1);
+	if (r->nr_t < NR_TIMES)
+		r->nr_t++;
+
+	n = r->nr_t;
+	if (n < 3) {
+		r->last_t = raw;
+		return raw;
+	}
+
+	/* oldest first, with i - (n - 1) / 2 doubled to keep it integer */
+	k = (r->head_t - n) & (NR_TIMES - 1);
+	ref = r->t[k];
+	for (i = 0; i < n; i++) {
+		t = r->t[(k + i) & (NR_TIMES - 1)] - ref;
+		sum += t;
+		sum_xy += (2 * i - (n - 1)) * t;
+	}
+
+	t = ref + sum / n + 3 * sum_xy / (n * (n + 1));
+
+	/* the slope, kept for the next stroke */
+	if (sum_xy > 0)
+		r->panel_period = 6 * sum_xy / (n * (n * n - 1));
+
+	/* the kernel is late, never early */
+	if (t > raw)
+		t = raw;
+	if (t < r->last_t)
+		t = r->last_t;
+
+	r->last_t = t;
+
+	return t;
+}
+
+/* when the frame after t should show the finger */
+static int64_t resample_target(struct tslib_resample *r, int64_t t)
+{
+	int64_t period = 1000000 / r->rate;
+	int64_t vsync;
+	int64_t k;
+
+	vsync = __atomic_load_n(&r->module.dev->vsync, __ATOMIC_RELAXED);
+	if (vsync) {
+		/* that's modulo 1000 seconds, take the one closest to t */
+		vsync -= t % 1000000000;
+		if (vsync > 500000000)
+			vsync -= 1000000000;
+		else if (vsync < -500000000)
+			vsync += 1000000000;
+		vsync += t;
+	} else {
+		if (r->t0 == 0)
+			r->t0 = t;
+		vsync = r->t0;
+	}
+
+	/* the first vsync at or after t, in either direction */
+	k = t - vsync;
+	if (k > 0)
+		k = (k + period - 1) / period;
+	else
+		k = -(-k / period);
+
+	return vsync + k * period - r->latency;
+}
+
+static void resample_slot_reset(struct ts_resample_slot *s, int32_t tracking_id)
+{
+	s->nr = 0;
+	s->head = 0;
+	s->tracking_id = tracking_id;
+}
+
+/*
+ * Add a sample to the history of its slot and return where the finger
+ * was at *target, or as close to it as we dare to guess. Returns 0 if it's
+ * better left where it is.
+ */
+static int resample_slot(struct ts_resample_slot *s, int64_t t,
+			 int64_t *target, int *x, int *y)
+{
+	const struct ts_resample_hist *a, *b;
+	int64_t dt;
+	int i;
+
+	s->hist[s->head].t = t;
+	s->hist[s->head].x = *x;
+	s->hist[s->head].y = *y;
+	s->head = (s->head + 1) & (NR_HIST - 1);
+	if (s->nr < NR_HIST)
+		s->nr++;
+
+	if (s->nr < 2)
+		return 0;
+
+	b = &s->hist[(s->head - 1) & (NR_HIST - 1)];
+	a = &s->hist[(s->head - 2) & (NR_HIST - 1)];
+
+	if (*target > b->t) {
+		dt = b->t - a->t;
+		if (dt < MIN_DELTA || dt > MAX_DELTA)
+			return 0;
+
+		if (*target > b->t + dt / 2)
+			*target = b->t + dt / 2;
+		if (*target > b->t + MAX_PREDICTION)
+			*target = b->t + MAX_PREDICTION;
+	} else {
+		/* look back for the two samples around the target */
+		for (i = 2; *target < a->t && i < s->nr; i++) {
+			b = a;
+			a = &s->hist[(s->head - 1 - i) & (NR_HIST - 1)];
+		}
+		if (*target < a->t)
+			*target = a->t;
+		dt = b->t - a->t;
+		if (dt <= 0)
+			return 0;
+	}
+
+	*x = a->x + (b->x - a->x) * (*target - a->t) / dt;
+	*y = a->y + (b->y - a->y) * (*target - a->t) / dt;
+
+	return 1;
+}
+
+static int resample_process(struct tslib_module_info *info,
+			    struct ts_sample *samp, int nr,
+			    __attribute__ ((unused)) int max)
+{
+	struct tslib_resample *r = (struct tslib_resample *)info;
+	struct ts_sample *s;
+	int64_t t, target;
+	int i;
+
+	for (s = samp, i = 0; i < nr; i++, s++) {
+		t = resample_smooth_time(r, tv_to_us(&s->tv));
+
+		if (s->pressure == 0) {
+			resample_slot_reset(&r->st, -1);
+			continue;
+		}
+
+		target = resample_target(r, t);
+		if (resample_slot(&r->st, t, &target, &s->x, &s->y))
+			us_to_tv(target, &s->tv);
+	}
+
+	return nr;
+}
+
+static int resample_process_mt(struct tslib_module_info *info,
+			       struct ts_sample_mt **samp, int max_slots,
+			       int nr, __attribute__ ((unused)) int max)
+{
+	struct tslib_resample *r = (struct tslib_resample *)info;
+	struct ts_resample_slot *slot;
+	struct ts_sample_mt *s;
+	int64_t t, target, when;
+	int i, j;
+
+	if (r->slots_mt == NULL || max_slots > r->slots) {
+		free(r->slots_mt);
+		r->slots_mt = calloc(max_slots, sizeof(*r->slots_mt));
+		if (!r->slots_mt) {
+			r->slots = 0;
+			return -ENOMEM;
+		}
+
+		for (j = 0; j < max_slots; j++)
+			resample_slot_reset(&r->slots_mt[j], -1);
+		r->slots = max_slots;
+	}
+
+	for (i = 0; i < nr; i++) {
+		/* the samples of a frame share their timestamp */
+		for (j = 0; j < max_slots; j++) {
+			if (samp[i][j].valid & TSLIB_MT_VALID)
+				break;
+		}
+		if (j == max_slots)
+			continue;
+
+		t = resample_smooth_time(r, tv_to_us(&samp[i][j].tv));
+		target = resample_target(r, t);
+
+		for (; j < max_slots; j++) {
+			s = &samp[i][j];
+			slot = &r->slots_mt[j];
+
+			if (!(s->valid & TSLIB_MT_VALID))
+				continue;
+
+			/* touches and releases stay where they are */
+			if (s->pressure == 0 || s->tracking_id == -1) {
+				resample_slot_reset(slot, -1);
+				continue;
+			}
+			if (s->tracking_id != slot->tracking_id)
+				resample_slot_reset(slot, s->tracking_id);
+
+			when = target;
+			if (resample_slot(slot, t, &when, &s->x, &s->y))
+				us_to_tv(when, &s->tv);
+		}
+	}
+
+	return nr;
+}
+
+static int resample_fini(struct tslib_module_info *info)
+{
+	struct tslib_resample *r = (struct tslib_resample *)info;
+
+	free(r->slots_mt);
+	free(info);
+
+	return 0;
+}
+
+static const struct tslib_ops resample_ops = {
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= resample_process,
+	.process_mt	= resample_process_mt,
+	.fini		= resample_fini,
+};
+
+static int resample_opt(struct tslib_module_info *inf, char *str, void *data)
+{
+	struct tslib_resample *r = (struct tslib_resample *)inf;
+	unsigned long v;
+	char *end;
+	int err = errno;
+
+	v = strtoul(str, &end, 0);
+
+	if (v == ULONG_MAX && errno == ERANGE)
+		return -1;
+
+	errno = err;
+	switch ((int)(intptr_t)data) {
+	case 1:
+		if (v == 0 || v > 1000)
+			return -1;
+		r->rate = v;
+		break;
+	case 2:
+		/* "5ms", "5000us" or "5" */
+		if (strcmp(end, "us") == 0)
+			r->latency = v;
+		else if (*end == '\0' || strcmp(end, "ms") == 0)
+			r->latency = (int64_t)v * 1000;
+		else
+			return -1;
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static const struct tslib_vars resample_vars[] = {
+	{ "rate",	(void *)1, resample_opt },
+	{ "latency",	(void *)2, resample_opt },
+};
+
+#define NR_VARS (sizeof(resample_vars) / sizeof(resample_vars[0]))
+
+TSAPI struct tslib_module_info *resample_mod_init(__attribute__ ((unused)) struct tsdev *dev,
+						  const char *params)
+{
+	struct tslib_resample *r;
+
+	r = calloc(1, sizeof(struct tslib_resample));
+	if (r == NULL)
+		return NULL;
+
+	r->module.ops = &resample_ops;
+
+	r->rate = 60;
+	r->latency = 5000;
+	resample_slot_reset(&r->st, -1);
+
+	if (tslib_parse_vars(&r->module, resample_vars, NR_VARS, params)) {
+		free(r);
+		return NULL;
+	}
+
+	return &r->module;
+}
+
+#ifndef TSLIB_STATIC_RESAMPLE_MODULE
+	TSLIB_MODULE_INIT(resample_mod_init);
+#endif
@@ -70,17 +70,16 @@ static void reset_skip_mt(struct tslib_skip *s, int slot)
 	s->sent_mt[slot] = 0;
 }
 
-static int skip_read(struct tslib_module_info *info, struct ts_sample *samp,
-		     int nr)
+static int skip_process(struct tslib_module_info *info,
+			struct ts_sample *samp, int nr,
+			__attribute__ ((unused)) int max)
 {
 	struct tslib_skip *skip = (struct tslib_skip *)info;
 	int nread = 0;
+	int i;
 
-	while (nread < nr) {
-		struct ts_sample cur;
-
-		if (info->next->ops->read(info->next, &cur, 1) < 1)
-			return nread;
+	for (i = 0; i < nr; i++) {
+		struct ts_sample cur = samp[i];
 
 		/* skip the first N samples */
 		if (skip->N < skip->nhead) {
@@ -137,15 +136,13 @@ static int skip_read(struct tslib_module_info *info, struct ts_sample *samp,
 	return nread;
 }
 
-static int skip_read_mt(struct tslib_module_info *info,
-			struct ts_sample_mt **samp, int max_slots, int nr)
+static int skip_process_mt(struct tslib_module_info *info,
+			   struct ts_sample_mt **samp, int max_slots, int nr,
+			   __attribute__ ((unused)) int max)
 {
 	struct tslib_skip *skip = (struct tslib_skip *)info;
-	int nread = 0;
 	int i, j;
-	int ret = 0;
-	int count = 0;
-	int count_current = 0;
+	int count;
 
 	if (skip->cur_mt == NULL || max_slots > skip->slots) {
 		if (skip->cur_mt) {
@@ -246,19 +243,13 @@ static int skip_read_mt(struct tslib_module_info *info,
 		skip->slots = max_slots;
 	}
 
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	ret = info->next->ops->read_mt(info->next, samp, max_slots, nr);
-	if (ret < 0)
-		return ret;
-
 #ifdef DEBUG
-	printf("SKIP: read %d samples (%d slots)\n",
-	       ret, max_slots);
+	if (nr)
+		printf("SKIP: read %d samples (%d slots)\n",
+		       nr, max_slots);
 #endif
-	while (nread < ret) {
-		count_current = 0;
+	/* frames keep their position, dropped samples are just invalid */
+	for (count = 0; count < nr; count++) {
 		memcpy(skip->cur_mt[0], samp[count],
 		       max_slots * sizeof(struct ts_sample_mt));
 		for (i = 0; i < max_slots; i++) {
@@ -302,11 +293,6 @@ static int skip_read_mt(struct tslib_module_info *info,
 				memcpy(&samp[count][i], &skip->cur_mt[0][i],
 				       sizeof(struct ts_sample_mt));
 
-				if (count_current == 0) {
-					nread++;
-				}
-				count_current++;
-
 				skip->sent_mt[i] = 1;
 				if (skip->cur_mt[0][i].pressure == 0)
 					reset_skip_mt(skip, i);
@@ -359,11 +345,6 @@ static int skip_read_mt(struct tslib_module_info *info,
 				skip->buf_mt[skip->M_mt[i]][i].pen_down);
 
 	#endif
-			if (count_current == 0) {
-				nread++;
-			}
-			count_current++;
-
 			if (skip->cur_mt[0][i].pressure == 0) {
 				reset_skip_mt(skip, i);
 			} else {
@@ -381,14 +362,9 @@ static int skip_read_mt(struct tslib_module_info *info,
 			}
 
 		}
-		count++;
-		if (count == ret)
-			break;
-
-
 	}
 
-	return nread;
+	return nr;
 }
 
 static int skip_fini(struct tslib_module_info *info)
@@ -419,8 +395,10 @@ static int skip_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops skip_ops = {
-	.read		= skip_read,
-	.read_mt	= skip_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= skip_process,
+	.process_mt	= skip_process_mt,
 	.fini		= skip_fini,
 };
 
@@ -0,0 +1,558 @@
+/*
+ *  tslib/plugins/synth-raw.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * A touchscreen that isn't there: made up strokes of any number of
+ * contacts, at any report rate, with the noise, spikes and lost frames of a
+ * bad panel, to load test the filters, ts_uinput and the applications.
+ *
+ * Time is cut into frames of 1/rate. A stroke lasts stroke ms, then all
+ * contacts are up for gap ms. The frames are made up as they're read: with
+ * speed=realtime (the default) each one when it's due, with speed=max as
+ * fast as they're read, stamped as if they'd come at the rate. The random
+ * numbers are seeded, so the same parameters always make the same strokes.
+ *
+ * Nothing here makes the device readable when a frame is due. With
+ * speed=realtime, only blocking reads wait for it; poll() on the device
+ * tells nothing, so a non-blocking reader, ts_start_async() and
+ * ts_read_latest() included, gets -EAGAIN and either spins (/dev/null) or
+ * never wakes up (a real touchscreen). speed=max is always ready.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tslib-private.h"
+
+#define SYNTH_PRESSURE	255
+
+enum synth_pattern {
+	SYNTH_TAP,	/* every contact stays where it landed */
+	SYNTH_DRAG,	/* every contact from one random point to another */
+	SYNTH_SWIPE,	/* all side by side, from left to right */
+};
+
+struct synth_contact {
+	int x0, y0;	/* where the stroke starts */
+	int x1, y1;	/* and ends */
+};
+
+struct tslib_synth {
+	struct tslib_module_info module;
+
+	int contacts;
+	int rate;		/* frames per second */
+	int pattern;
+	int64_t stroke;		/* us */
+	int64_t gap;		/* us */
+	int width;
+	int height;
+	int jitter;		/* standard deviation, in 1/256 px */
+	uint32_t spikes;	/* chance per sample, in 1/2^32 */
+	uint32_t drop;		/* chance per frame, in 1/2^32 */
+	int realtime;
+	int warned;		/* about a non-blocking read with realtime */
+	unsigned long frames;	/* to hand out, 0 for ever */
+	uint32_t rand;
+
+	struct synth_contact *c;
+	struct ts_sample_mt *buf;	/* the frame made last */
+	int64_t cycle;		/* stroke + gap, us */
+	int64_t stroke_nr;	/* of the contacts down, -1 when up */
+	unsigned int tracking_id;
+	uint64_t n;		/* the next frame */
+	unsigned long done;	/* frames handed out */
+	int clock;
+	int64_t start;		/* us of clock at frame 0, -1 before reading */
+};
+
+static int64_t synth_now(const struct tslib_synth *s)
+{
+	struct timespec now;
+
+	clock_gettime(s->clock, &now);
+
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* us since frame 0 */
+static int64_t synth_time(const struct tslib_synth *s, uint64_t n)
+{
+	return (int64_t)(n * 1000000 / s->rate);
+}
+
+/* xorshift32 */
+static uint32_t synth_rand(struct tslib_synth *s)
+{
+	uint32_t x = s->rand;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	s->rand = x;
+
+	return x;
+}
+
+static int synth_range(struct tslib_synth *s, int n)
+{
+	return (int)(((uint64_t)synth_rand(s) * n) >> 32);
+}
+
+/* gaussian, from the sum of 12 uniform numbers, in px */
+static int synth_noise(struct tslib_synth *s)
+{
+	int64_t sum = 0;
+	int k;
+
+	if (!s->jitter)
+		return 0;
+
+	for (k = 0; k < 12; k++)
+		sum += synth_rand(s) >> 16;
+	sum -= 6 * 65536;
+
+	return (int)(sum * s->jitter / (65536 * 256));
+}
+
+static int synth_clamp(int v, int max)
+{
+	if (v < 0)
+		return 0;
+	if (v >= max)
+		return max - 1;
+	return v;
+}
+
+static void synth_new_stroke(struct tslib_synth *s)
+{
+	struct synth_contact *c;
+	int j;
+
+	for (j = 0; j < s->contacts; j++) {
+		c = &s->c[j];
+
+		switch (s->pattern) {
+		case SYNTH_TAP:
+			c->x0 = synth_range(s, s->width);
+			c->y0 = synth_range(s, s->height);
+			c->x1 = c->x0;
+			c->y1 = c->y0;
+			break;
+		case SYNTH_DRAG:
+			c->x0 = synth_range(s, s->width);
+			c->y0 = synth_range(s, s->height);
+			c->x1 = synth_range(s, s->width);
+			c->y1 = synth_range(s, s->height);
+			break;
+		case SYNTH_SWIPE:
+			c->x0 = s->width / 10;
+			c->x1 = s->width - 1 - s->width / 10;
+			c->y0 = (int)((int64_t)s->height * (j + 1) /
+				      (s->contacts + 1));
+			c->y1 = c->y0;
+			break;
+		}
+	}
+}
+
+/* no contacts down and none to come in frame n */
+static int synth_idle(const struct tslib_synth *s, uint64_t n)
+{
+	return s->stroke_nr < 0 && synth_time(s, n) % s->cycle >= s->stroke;
+}
+
+/*
+ * Make up frame n in s->buf. Returns 0 if there's nothing in it, that is,
+ * when all contacts are up or the frame is lost.
+ */
+static int synth_frame(struct tslib_synth *s, uint64_t n, int64_t t)
+{
+	struct ts_sample_mt *samp;
+	struct synth_contact *c;
+	int64_t time = synth_time(s, n);
+	int64_t stroke_nr = time / s->cycle;
+	int64_t phase = time % s->cycle;
+	int pen_down = -1;
+	int dx, dy, j;
+
+	if (s->stroke_nr >= 0 &&
+	    (stroke_nr != s->stroke_nr || phase >= s->stroke)) {
+		/* the end of the stroke, all contacts go up */
+		for (j = 0; j < s->contacts; j++) {
+			samp = &s->buf[j];
+			samp->pressure = 0;
+			samp->tracking_id = -1;
+			samp->pen_down = 0;
+			samp->tv.tv_sec = t / 1000000;
+			samp->tv.tv_usec = t % 1000000;
+			samp->valid = TSLIB_MT_VALID;
+		}
+		s->stroke_nr = -1;
+		return 1;
+	}
+
+	if (s->stroke_nr < 0) {
+		if (phase >= s->stroke)
+			return 0;
+
+		synth_new_stroke(s);
+		s->stroke_nr = stroke_nr;
+		pen_down = 1;
+		for (j = 0; j < s->contacts; j++)
+			s->buf[j].tracking_id = s->tracking_id++ & INT_MAX;
+	} else if (s->drop && synth_rand(s) < s->drop) {
+		/* lost, like a SYN_DROPPED of one frame */
+		__atomic_add_fetch(&s->module.dev->syn_dropped, 1,
+				   __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	for (j = 0; j < s->contacts; j++) {
+		c = &s->c[j];
+		samp = &s->buf[j];
+
+		samp->x = c->x0 + (int)((c->x1 - c->x0) * phase / s->stroke);
+		samp->y = c->y0 + (int)((c->y1 - c->y0) * phase / s->stroke);
+		samp->x += synth_noise(s);
+		samp->y += synth_noise(s);
+
+		if (s->spikes && synth_rand(s) < s->spikes) {
+			dx = s->width / 4 + synth_range(s, s->width / 4 + 1);
+			dy = s->height / 4 + synth_range(s, s->height / 4 + 1);
+			samp->x += synth_rand(s) & 1 ? dx : -dx;
+			samp->y += synth_rand(s) & 1 ? dy : -dy;
+		}
+
+		samp->x = synth_clamp(samp->x, s->width);
+		samp->y = synth_clamp(samp->y, s->height);
+		samp->pressure = SYNTH_PRESSURE;
+		samp->pen_down = pen_down;
+		samp->tv.tv_sec = t / 1000000;
+		samp->tv.tv_usec = t % 1000000;
+		samp->valid = TSLIB_MT_VALID;
+	}
+
+	return 1;
+}
+
+/*
+ * The next frame, waiting for it with speed=realtime if the device was
+ * opened blocking and the read has no frame yet. 0 if the frame isn't
+ * due, -ENODATA after the last one.
+ */
+static int synth_next(struct tslib_synth *s, int more)
+{
+	struct tsdev *ts = s->module.dev;
+	struct timespec delay;
+	int64_t t, now;
+
+	while (1) {
+		if (s->frames && s->done == s->frames)
+			return -ENODATA;
+
+		/* skip the gap, to the first frame of the next stroke */
+		if (synth_idle(s, s->n)) {
+			t = (synth_time(s, s->n) / s->cycle + 1) * s->cycle;
+			s->n = ((uint64_t)t * s->rate + 999999) / 1000000;
+		}
+
+		t = s->start + synth_time(s, s->n);
+		if (s->realtime) {
+			now = synth_now(s);
+			if (t > now) {
+				if (more)
+					return 0;
+				if (fcntl(ts->fd, F_GETFL) & O_NONBLOCK) {
+					if (!s->warned)
+						fprintf(stderr, "tslib: synth: speed=realtime needs blocking reads, poll() won't wake up for frames\n");
+					s->warned = 1;
+					return 0;
+				}
+
+				delay.tv_sec = (t - now) / 1000000;
+				delay.tv_nsec = (t - now) % 1000000 * 1000;
+				nanosleep(&delay, NULL);
+			}
+		}
+
+		if (synth_frame(s, s->n++, t)) {
+			s->done++;
+			return 1;
+		}
+	}
+}
+
+/* frame 0 is now, on the clock the application wants */
+static void synth_start(struct tslib_synth *s)
+{
+	struct tsdev *ts = s->module.dev;
+
+	if (s->start >= 0 && s->clock == ts->clock)
+		return;
+
+	s->clock = ts->clock;
+	s->start = synth_now(s) - synth_time(s, s->n);
+}
+
+static int synth_read(struct tslib_module_info *inf, struct ts_sample *samp,
+		      int nr)
+{
+	struct tslib_synth *s = (struct tslib_synth *)inf;
+	int i, ret;
+
+	synth_start(s);
+
+	for (i = 0; i < nr; i++) {
+		ret = synth_next(s, i);
+		if (ret < 0 && i == 0)
+			return ret;
+		if (ret <= 0)
+			break;
+
+		/* a single touch is the first contact */
+		samp[i].x = s->buf[0].x;
+		samp[i].y = s->buf[0].y;
+		samp[i].pressure = s->buf[0].pressure;
+		samp[i].tv = s->buf[0].tv;
+	}
+
+	return i ? i : -EAGAIN;
+}
+
+static int synth_read_mt(struct tslib_module_info *inf,
+			 struct ts_sample_mt **samp, int max_slots, int nr)
+{
+	struct tslib_synth *s = (struct tslib_synth *)inf;
+	int slots = max_slots < s->contacts ? max_slots : s->contacts;
+	int i, ret;
+
+	synth_start(s);
+
+	for (i = 0; i < nr; i++) {
+		ret = synth_next(s, i);
+		if (ret < 0 && i == 0)
+			return ret;
+		if (ret <= 0)
+			break;
+
+		memcpy(samp[i], s->buf, slots * sizeof(**samp));
+		if (max_slots > slots)
+			memset(samp[i] + slots, 0,
+			       (max_slots - slots) * sizeof(**samp));
+	}
+
+	return i ? i : -EAGAIN;
+}
+
+static int synth_fini(struct tslib_module_info *inf)
+{
+	struct tslib_synth *s = (struct tslib_synth *)inf;
+
+	free(s->c);
+	free(s->buf);
+	free(s);
+
+	return 0;
+}
+
+static const struct tslib_ops synth_ops = {
+	.read		= synth_read,
+	.read_mt	= synth_read_mt,
+	.fini		= synth_fini,
+};
+
+/* in percent, as a chance in 1/2^32 */
+static int synth_chance(const char *str, uint32_t *chance)
+{
+	double v;
+	char *end;
+
+	v = strtod(str, &end);
+	if (*end != '\0' || !(v >= 0 && v <= 100))
+		return -1;
+
+	*chance = v >= 100 ? UINT32_MAX : (uint32_t)(v / 100 * 4294967296.0);
+
+	return 0;
+}
+
+static int synth_opt(struct tslib_module_info *inf, char *str, void *data)
+{
+	struct tslib_synth *s = (struct tslib_synth *)inf;
+	unsigned long v;
+	double d;
+	char *end;
+	int err = errno;
+
+	if (!str)
+		return -1;
+
+	switch ((int)(intptr_t)data) {
+	case 4:
+		if (strcmp(str, "tap") == 0)
+			s->pattern = SYNTH_TAP;
+		else if (strcmp(str, "drag") == 0)
+			s->pattern = SYNTH_DRAG;
+		else if (strcmp(str, "swipe") == 0)
+			s->pattern = SYNTH_SWIPE;
+		else
+			return -1;
+		return 0;
+	case 9:
+		d = strtod(str, &end);
+		if (*end != '\0' || !(d >= 0 && d <= 10000))
+			return -1;
+		s->jitter = (int)(d * 256 + 0.5);
+		return 0;
+	case 10:
+		return synth_chance(str, &s->spikes);
+	case 11:
+		return synth_chance(str, &s->drop);
+	case 12:
+		if (strcmp(str, "realtime") == 0)
+			s->realtime = 1;
+		else if (strcmp(str, "max") == 0)
+			s->realtime = 0;
+		else
+			return -1;
+		return 0;
+	default:
+		break;
+	}
+
+	errno = 0;
+	v = strtoul(str, &end, 0);
+	if (errno || *end != '\0' || v > INT_MAX)
+		return -1;
+	errno = err;
+
+	switch ((int)(intptr_t)data) {
+	case 1:
+		if (v == 0 || v > 1024)
+			return -1;
+		s->contacts = v;
+		break;
+	case 2:
+		if (v == 0 || v > 1000000)
+			return -1;
+		s->rate = v;
+		break;
+	case 3:
+		s->rand = v;
+		break;
+	case 5:
+		if (v == 0)
+			return -1;
+		s->stroke = (int64_t)v * 1000;
+		break;
+	case 6:
+		s->gap = (int64_t)v * 1000;
+		break;
+	case 7:
+		if (v == 0)
+			return -1;
+		s->width = v;
+		break;
+	case 8:
+		if (v == 0)
+			return -1;
+		s->height = v;
+		break;
+	case 13:
+		s->frames = v;
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static const struct tslib_vars synth_vars[] = {
+	{ "contacts",	(void *)1, synth_opt },
+	{ "rate",	(void *)2, synth_opt },
+	{ "seed",	(void *)3, synth_opt },
+	{ "pattern",	(void *)4, synth_opt },
+	{ "stroke",	(void *)5, synth_opt },
+	{ "gap",	(void *)6, synth_opt },
+	{ "width",	(void *)7, synth_opt },
+	{ "height",	(void *)8, synth_opt },
+	{ "jitter",	(void *)9, synth_opt },
+	{ "spikes",	(void *)10, synth_opt },
+	{ "drop",	(void *)11, synth_opt },
+	{ "speed",	(void *)12, synth_opt },
+	{ "frames",	(void *)13, synth_opt },
+};
+
+#define NR_VARS (sizeof(synth_vars) / sizeof(synth_vars[0]))
+
+TSAPI struct tslib_module_info *synth_mod_init(struct tsdev *dev,
+					       const char *params)
+{
+	struct tslib_synth *s;
+	int j;
+
+	s = calloc(1, sizeof(struct tslib_synth));
+	if (s == NULL)
+		return NULL;
+
+	s->module.ops = &synth_ops;
+	s->module.dev = dev;
+
+	s->contacts = 1;
+	s->rate = 120;
+	s->rand = 1;
+	s->pattern = SYNTH_DRAG;
+	s->stroke = 500000;
+	s->gap = 100000;
+	s->width = 800;
+	s->height = 480;
+	s->realtime = 1;
+	s->stroke_nr = -1;
+	s->start = -1;
+
+	if (tslib_parse_vars(&s->module, synth_vars, NR_VARS, params))
+		goto fail;
+
+	s->cycle = s->stroke + s->gap;
+
+	/* xorshift starts slowly from small seeds, and never from 0 */
+	s->rand *= 2654435761u;
+	if (!s->rand)
+		s->rand = 1;
+
+	s->c = calloc(s->contacts, sizeof(*s->c));
+	s->buf = calloc(s->contacts, sizeof(*s->buf));
+	if (!s->c || !s->buf)
+		goto fail;
+
+	for (j = 0; j < s->contacts; j++) {
+		s->buf[j].slot = j;
+		s->buf[j].tracking_id = -1;
+		s->buf[j].pen_down = -1;
+	}
+
+	return &s->module;
+
+fail:
+	free(s->c);
+	free(s->buf);
+	free(s);
+	return NULL;
+}
+
+#ifndef TSLIB_STATIC_SYNTH_MODULE
+	TSLIB_MODULE_INIT(synth_mod_init);
+#endif
@@ -42,6 +42,14 @@ enum {
 /* Is is a start of packet ? */
 #define IsStart(x) (((x)|1) == PACKET_SIGNATURE)
 
+struct tslib_touchkit {
+	struct tslib_module_info module;
+	int initDone;
+	/* enough space for 2 "normal" packets */
+	unsigned char buffer[BUFFER_SIZE];
+	int pos;
+};
+
 static int touchkit_init(int dev)
 {
 	struct termios tty;
@@ -65,35 +73,33 @@ static int touchkit_init(int dev)
 static int touchkit_read(struct tslib_module_info *inf, struct ts_sample *samp,
 			 __attribute__ ((unused)) int nr)
 {
-	static int initDone;
-	/* enough space for 2 "normal" packets */
-	static unsigned char buffer[BUFFER_SIZE];
-	static int pos;
+	struct tslib_touchkit *tk = (struct tslib_touchkit *)inf;
+	unsigned char *buffer = tk->buffer;
 	int ret;
 	struct tsdev *ts = inf->dev;
 	int p;
 	int total = 0;
 	int q;
 
-	if (initDone == 0) {
-		initDone = touchkit_init(ts->fd);
-		if (initDone == -1)
+	if (tk->initDone == 0) {
+		tk->initDone = touchkit_init(ts->fd);
+		if (tk->initDone == -1)
 			return -1;
 	}
 	/* read some new bytes (enough for 1 normal packet) */
-	ret = read(ts->fd, buffer + pos, PACKET_SIZE);
+	ret = read(ts->fd, buffer + tk->pos, PACKET_SIZE);
 	if (ret <= 0)
 		return -1;
 
-	pos += ret;
-	if (pos < PACKET_SIZE)
+	tk->pos += ret;
+	if (tk->pos < PACKET_SIZE)
 		return 0;
 
 	/* find start */
-	for (p = 0; p < pos; ++p)
+	for (p = 0; p < tk->pos; ++p)
 		if (IsStart(buffer[p])) {
 			/* we have enough data for a packet ? */
-			if (p + PACKET_SIZE > pos) {
+			if (p + PACKET_SIZE > tk->pos) {
 				if (p > 0) {
 					/*
 					 * we have found a start >0, it means
@@ -101,8 +107,8 @@ static int touchkit_read(struct tslib_module_info *inf, struct ts_sample *samp,
 					 * buffer so let's shift data to ignore
 					 * this garbage
 					 */
-					memcpy(buffer, buffer + p, pos - p);
-					pos -= p;
+					memcpy(buffer, buffer + p, tk->pos - p);
+					tk->pos -= p;
 				}
 				break;
 			}
@@ -139,8 +145,8 @@ static int touchkit_read(struct tslib_module_info *inf, struct ts_sample *samp,
 
 			/* now remove it */
 			memcpy(buffer, buffer + p + PACKET_SIZE,
-			       pos - p - PACKET_SIZE);
-			pos -= p + PACKET_SIZE;
+			       tk->pos - p - PACKET_SIZE);
+			tk->pos -= p + PACKET_SIZE;
 			total = 1;
 			break;
 		}
@@ -155,14 +161,14 @@ static const struct tslib_ops touchkit_ops = {
 TSAPI struct tslib_module_info *touchkit_mod_init(__attribute__ ((unused)) struct tsdev *dev,
 						  __attribute__ ((unused)) const char *params)
 {
-	struct tslib_module_info *m;
+	struct tslib_touchkit *tk;
 
-	m = malloc(sizeof(struct tslib_module_info));
-	if (m == NULL)
+	tk = calloc(1, sizeof(struct tslib_touchkit));
+	if (tk == NULL)
 		return NULL;
 
-	m->ops = &touchkit_ops;
-	return m;
+	tk->module.ops = &touchkit_ops;
+	return &tk->module;
 }
 #ifndef TSLIB_STATIC_TOUCHKIT_MODULE
 	TSLIB_MODULE_INIT(touchkit_mod_init);
@@ -46,10 +46,15 @@ struct tslib_variance {
 #define VAR_LASTVALID		0x00000002
 #define VAR_NOISEVALID		0x00000004
 #define VAR_SUBMITNOISE		0x00000008
-	int slots;
-	int nr;
-	struct ts_sample_mt **cur_mt;
-	struct ts_sample *samp;
+	/* input not yet looked at, because there was no room for output */
+	struct ts_sample *queue;
+	int queue_len;
+	int queue_size;
+	struct ts_sample_mt *queue_mt;
+	int queue_mt_len;
+	int queue_mt_size;
+	int32_t slot;
+	int32_t tracking_id;
 };
 
 static int sqr(int x)
@@ -57,20 +62,37 @@ static int sqr(int x)
 	return x * x;
 }
 
-static int variance_read(struct tslib_module_info *info, struct ts_sample *samp,
-			 int nr)
+static int variance_process(struct tslib_module_info *info,
+			    struct ts_sample *samp, int nr, int max)
 {
 	struct tslib_variance *var = (struct tslib_variance *)info;
 	struct ts_sample cur;
+	struct ts_sample *queue;
 	int count = 0, dist;
+	int i = 0;
 
-	while (count < nr) {
+	/* a sample may come out twice, so work from a copy of the input */
+	if (var->queue_len + nr > var->queue_size) {
+		queue = realloc(var->queue,
+				(var->queue_len + nr) * sizeof(*queue));
+		if (!queue)
+			return -ENOMEM;
+
+		var->queue = queue;
+		var->queue_size = var->queue_len + nr;
+	}
+	memcpy(&var->queue[var->queue_len], samp, nr * sizeof(*samp));
+	var->queue_len += nr;
+
+	while (count < max) {
 		if (var->flags & VAR_SUBMITNOISE) {
 			cur = var->noise;
 			var->flags &= ~VAR_SUBMITNOISE;
 		} else {
-			if (info->next->ops->read(info->next, &cur, 1) < 1)
-				return count;
+			if (i == var->queue_len)
+				break;
+
+			cur = var->queue[i++];
 		}
 
 		if (cur.pressure == 0) {
@@ -135,102 +157,95 @@ acceptsample:
 		var->last = cur;
 	}
 
+	var->queue_len -= i;
+	memmove(&var->queue[0], &var->queue[i],
+		var->queue_len * sizeof(var->queue[0]));
+
 	return count;
 }
 
+static void variance_put_mt(struct tslib_variance *var,
+			    struct ts_sample_mt *frame, int max_slots,
+			    struct ts_sample *s, short pen_down)
+{
+	int i;
+
+	for (i = 0; i < max_slots; i++)
+		frame[i].valid = 0;
+
+	frame[0].x = s->x;
+	frame[0].y = s->y;
+	frame[0].pressure = s->pressure;
+	frame[0].tv = s->tv;
+	frame[0].valid |= TSLIB_MT_VALID;
+	frame[0].slot = var->slot;
+	frame[0].tracking_id = var->tracking_id;
+	frame[0].pen_down = pen_down;
+}
+
 /* No multitouch support here! This behaves like the old variance_read() call.
  * Only slot 0 is read.
  */
-static int variance_read_mt(struct tslib_module_info *info,
-			    struct ts_sample_mt **samp_mt,
-			    int max_slots, int nr)
+static int variance_process_mt(struct tslib_module_info *info,
+			       struct ts_sample_mt **samp_mt,
+			       int max_slots, int nr, int max)
 {
 	struct tslib_variance *var = (struct tslib_variance *)info;
+	struct ts_sample_mt *queue;
 	int count = 0, dist;
 	int i, j;
 	struct ts_sample cur;
 	short pen_down = 1;
-	int ret;
-
-	if (!info->next->ops->read_mt)
-		return -ENOSYS;
-
-	if (var->samp == NULL) {
-		var->samp = calloc(nr, sizeof(struct ts_sample));
-		if (!var->samp)
-			return -ENOMEM;
-	} else {
-		if (nr == var->nr)
-			memset(var->samp, 0, nr * sizeof(struct ts_sample));
-	}
 
-	if (var->cur_mt == NULL || max_slots > var->slots || nr > var->nr) {
+	if (var->queue_mt_len + nr > var->queue_mt_size) {
 	#ifdef DEBUG
 		fprintf(stderr, "tslib: WARNING: no multitouch when using the variance filter\n");
 	#endif
-		if (var->cur_mt) {
-			for (i = 0; i < var->nr; i++)
-				free(var->cur_mt[i]);
-
-			free(var->cur_mt);
-		}
-
-		var->cur_mt = malloc(nr * sizeof(struct ts_sample_mt *));
-		if (!var->cur_mt)
+		queue = realloc(var->queue_mt,
+				(var->queue_mt_len + nr) * sizeof(*queue));
+		if (!queue)
 			return -ENOMEM;
 
-		for (i = 0; i < nr; i++) {
-			var->cur_mt[i] = malloc(max_slots * sizeof(struct ts_sample_mt));
-			if (!var->cur_mt[i]) {
-				for (j = 0; j <= i; j++)
-					free(var->cur_mt[j]);
-
-				free(var->cur_mt);
-				var->cur_mt = NULL;
-				free(var->samp);
-				var->samp = NULL;
-				return -ENOMEM;
+		var->queue_mt = queue;
+		var->queue_mt_size = var->queue_mt_len + nr;
+	}
+
+	for (i = 0; i < nr; i++) {
+		for (j = 1; j < max_slots; j++) {
+			if (samp_mt[i][j].valid & TSLIB_MT_VALID) {
+			#ifdef DEBUG
+				fprintf(stderr,
+					"VARIANCE: MT data dropped.\n");
+			#endif
+				/* XXX Attention. You lose multitouch
+				 * using ts_read_mt() with the variance
+				 * filter
+				 */
+				break;
 			}
 		}
+		if (!(samp_mt[i][0].valid & TSLIB_MT_VALID))
+			continue;
 
-		var->slots = max_slots;
-		var->nr = nr;
+		var->queue_mt[var->queue_mt_len++] = samp_mt[i][0];
 	}
 
-	while (count < nr) {
+	i = 0;
+	while (count < max) {
 		if (var->flags & VAR_SUBMITNOISE) {
 			cur = var->noise;
 			var->flags &= ~VAR_SUBMITNOISE;
 		} else {
-			ret = info->next->ops->read_mt(info->next, var->cur_mt,
-						       max_slots, 1);
-			if (ret < 0) {
-				count = ret;
-				goto out;
-			} else if (ret == 0) {
-				goto out;
-			}
-
-			for (i = 1; i < max_slots; i++) {
-				if (var->cur_mt[0][i].valid & TSLIB_MT_VALID) {
-				#ifdef DEBUG
-					fprintf(stderr,
-						"VARIANCE: MT data dropped.\n");
-				#endif
-					/* XXX Attention. You lose multitouch
-					 * using ts_read_mt() with the variance
-					 * filter
-					 */
-					var->cur_mt[0][i].valid = 0;
-				}
-			}
-			if (!(var->cur_mt[0][0].valid & TSLIB_MT_VALID))
-				continue;
-
-			cur.x = var->cur_mt[0][0].x;
-			cur.y = var->cur_mt[0][0].y;
-			cur.pressure = var->cur_mt[0][0].pressure;
-			cur.tv = var->cur_mt[0][0].tv;
+			if (i == var->queue_mt_len)
+				break;
+
+			cur.x = var->queue_mt[i].x;
+			cur.y = var->queue_mt[i].y;
+			cur.pressure = var->queue_mt[i].pressure;
+			cur.tv = var->queue_mt[i].tv;
+			var->slot = var->queue_mt[i].slot;
+			var->tracking_id = var->queue_mt[i].tracking_id;
+			i++;
 		}
 
 		if (cur.pressure == 0) {
@@ -272,15 +287,10 @@ static int variance_read_mt(struct tslib_module_info *info,
 					/* Two "noises": it's just a quick pen
 					 * movement
 					 */
-					var->samp[count] = var->last = var->noise;
-					samp_mt[count][0].x = var->samp[count].x;
-					samp_mt[count][0].y = var->samp[count].y;
-					samp_mt[count][0].pressure = var->samp[count].pressure;
-					samp_mt[count][0].tv = var->samp[count].tv;
-					samp_mt[count][0].valid |= TSLIB_MT_VALID;
-					samp_mt[count][0].slot = var->cur_mt[0][0].slot;
-					samp_mt[count][0].tracking_id = var->cur_mt[0][0].tracking_id;
-					samp_mt[count][0].pen_down = pen_down;
+					var->last = var->noise;
+					variance_put_mt(var, samp_mt[count],
+							max_slots, &var->last,
+							pen_down);
 					count++;
 					var->flags = (var->flags &
 						      ~VAR_NOISEVALID) |
@@ -302,35 +312,31 @@ acceptsample:
 		fprintf(stderr, "VARIANCE----------------> %d %d %d\n",
 			var->last.x, var->last.y, var->last.pressure);
 #endif
-		var->samp[count] = var->last;
-		samp_mt[count][0].x = var->samp[count].x;
-		samp_mt[count][0].y = var->samp[count].y;
-		samp_mt[count][0].pressure = var->samp[count].pressure;
-		samp_mt[count][0].tv = var->samp[count].tv;
-		samp_mt[count][0].valid |= TSLIB_MT_VALID;
-		samp_mt[count][0].slot = var->cur_mt[0][0].slot;
-		samp_mt[count][0].tracking_id = var->cur_mt[0][0].tracking_id;
-		samp_mt[count][0].pen_down = var->last_pen_down;
+		variance_put_mt(var, samp_mt[count], max_slots, &var->last,
+				var->last_pen_down);
 		count++;
 		var->last = cur;
 	}
 
-out:
+	var->queue_mt_len -= i;
+	memmove(&var->queue_mt[0], &var->queue_mt[i],
+		var->queue_mt_len * sizeof(var->queue_mt[0]));
+
+	/* input frames we didn't write to are all empty now */
+	for (i = count; i < nr; i++) {
+		for (j = 0; j < max_slots; j++)
+			samp_mt[i][j].valid = 0;
+	}
+
 	return count;
 }
 
 static int variance_fini(struct tslib_module_info *info)
 {
 	struct tslib_variance *var = (struct tslib_variance *)info;
-	int i;
 
-	if (var->cur_mt) {
-		for (i = 0; i < var->nr; i++)
-			free(var->cur_mt[i]);
-
-		free(var->cur_mt);
-	}
-	free(var->samp);
+	free(var->queue);
+	free(var->queue_mt);
 
 	free(info);
 
@@ -338,8 +344,10 @@ static int variance_fini(struct tslib_module_info *info)
 }
 
 static const struct tslib_ops variance_ops = {
-	.read		= variance_read,
-	.read_mt	= variance_read_mt,
+	.read		= tslib_filter_read,
+	.read_mt	= tslib_filter_read_mt,
+	.process	= variance_process,
+	.process_mt	= variance_process_mt,
 	.fini		= variance_fini,
 };
 
@@ -386,10 +394,12 @@ TSAPI struct tslib_module_info *variance_mod_init(__attribute__ ((unused)) struc
 	var->delta = 30;
 	var->flags = 0;
 	var->last_pen_down = 1;
-	var->slots = 0;
-	var->cur_mt = NULL;
-	var->nr = 0;
-	var->samp = NULL;
+	var->queue = NULL;
+	var->queue_len = 0;
+	var->queue_size = 0;
+	var->queue_mt = NULL;
+	var->queue_mt_len = 0;
+	var->queue_mt_size = 0;
 
 	if (tslib_parse_vars(&var->module, variance_vars, NR_VARS, params)) {
 		free(var);
@@ -34,83 +34,101 @@ struct tslib_input {
 	int vendor;
 	int product;
 	int len;
+	short reopen;
 };
 
-static int waveshare_read(struct tslib_module_info *inf, struct ts_sample *samp,
-			  int nr)
+/* look for the hidraw device with our vid/pid and read from that instead */
+static int waveshare_reopen(struct tslib_input *i)
 {
-	static short reopen = 1;
+	struct tsdev *ts = i->module.dev;
 	struct stat devstat;
 	struct hidraw_devinfo info;
 	char name_buf[512];
 	int cnt;
 	short found = 0;
-	struct tslib_input *i = (struct tslib_input *) inf;
-	struct tsdev *ts = inf->dev;
 	struct tsdev *ts_tmp;
-	char *buf;
+	int fd;
 	int ret;
 
-	if (reopen == 1) {
-		reopen = 0;
-
-		if (i->vendor > 0 && i->product > 0) {
+	if (i->vendor > 0 && i->product > 0) {
 #ifdef DEBUG
-			fprintf(stderr,
-				"waveshare: searching for device using hidraw...\n");
+		fprintf(stderr,
+			"waveshare: searching for device using hidraw...\n");
 #endif
-			for (cnt = 0; cnt < HIDRAW_MAX_DEVICES; cnt++) {
-				snprintf(name_buf, sizeof(name_buf),
-					 "/dev/hidraw%d", cnt);
+		for (cnt = 0; cnt < HIDRAW_MAX_DEVICES; cnt++) {
+			snprintf(name_buf, sizeof(name_buf),
+				 "/dev/hidraw%d", cnt);
 #ifdef DEBUG
-				fprintf(stderr,
-					"waveshare: device: %s\n", name_buf);
+			fprintf(stderr,
+				"waveshare: device: %s\n", name_buf);
 #endif
-				ret = stat(name_buf, &devstat);
-				if (ret < 0)
-					continue;
+			ret = stat(name_buf, &devstat);
+			if (ret < 0)
+				continue;
 
-				ts_tmp = ts_open(name_buf, 0);
-				if (!ts_tmp)
-					continue;
+			ts_tmp = ts_open(name_buf, 0);
+			if (!ts_tmp)
+				continue;
 
 #ifdef DEBUG
-				fprintf(stderr, "  opened\n");
+			fprintf(stderr, "  opened\n");
 #endif
-				ret = ioctl(ts_tmp->fd, HIDIOCGRAWINFO, &info);
-				if (ret < 0) {
-					ts_close(ts_tmp);
-					continue;
-				}
+			ret = ioctl(ts_tmp->fd, HIDIOCGRAWINFO, &info);
+			if (ret < 0) {
+				ts_close(ts_tmp);
+				continue;
+			}
 
-				info.vendor &= 0xFFFF;
-				info.product &= 0xFFFF;
+			info.vendor &= 0xFFFF;
+			info.product &= 0xFFFF;
 #ifdef DEBUG
-				fprintf(stderr,
-					"  vid=%04X, pid=%04X\n",
-					info.vendor, info.product);
+			fprintf(stderr,
+				"  vid=%04X, pid=%04X\n",
+				info.vendor, info.product);
 #endif
 
-				if (i->vendor == info.vendor &&
-				    i->product == info.product) {
-					close(ts->fd);
-
-					ts->fd = ts_tmp->fd;
-					found = 1;
-#ifdef DEBUG
-					fprintf(stderr, "  correct device\n");
-#endif
+			if (i->vendor == info.vendor &&
+			    i->product == info.product) {
+				/* ts_close() below closes the one we found */
+				fd = dup(ts_tmp->fd);
+				if (fd < 0) {
 					ts_close(ts_tmp);
-					break;
+					return -1;
 				}
+				close(ts->fd);
 
+				ts->fd = fd;
+				found = 1;
+#ifdef DEBUG
+				fprintf(stderr, "  correct device\n");
+#endif
 				ts_close(ts_tmp);
-			} /* for HIDRAW_MAX_DEVICES */
+				break;
+			}
+
+			ts_close(ts_tmp);
+		} /* for HIDRAW_MAX_DEVICES */
+
+		if (found == 0)
+			return -1;
+	} /* vid/pid set */
+
+	return 0;
+}
 
-			if (found == 0)
-				return -1;
-		} /* vid/pid set */
-	} /* reopen */
+static int waveshare_read(struct tslib_module_info *inf, struct ts_sample *samp,
+			  int nr)
+{
+	struct tslib_input *i = (struct tslib_input *) inf;
+	struct tsdev *ts = inf->dev;
+	char *buf;
+	int ret;
+
+	if (i->reopen) {
+		i->reopen = 0;
+		if (waveshare_reopen(i) < 0)
+			return -1;
+	}
 
 	buf = alloca(i->len * nr);
 
@@ -153,13 +171,6 @@ static int waveshare_read_mt(struct tslib_module_info *inf,
 {
 	struct tslib_input *i = (struct tslib_input *)inf;
 	struct tsdev *ts = inf->dev;
-	static short reopen = 1;
-	struct stat devstat;
-	struct hidraw_devinfo info;
-	char name_buf[512];
-	int cnt;
-	short found = 0;
-	struct tsdev *ts_tmp;
 	char *buf;
 	int ret;
 	int count = 0;
@@ -171,66 +182,11 @@ static int waveshare_read_mt(struct tslib_module_info *inf,
 		max_slots = 1;
 	}
 
-	if (reopen == 1) {
-		reopen = 0;
-
-		if (i->vendor > 0 && i->product > 0) {
-#ifdef DEBUG
-			fprintf(stderr,
-				"waveshare: searching for device using hidraw...\n");
-#endif
-			for (cnt = 0; cnt < HIDRAW_MAX_DEVICES; cnt++) {
-				snprintf(name_buf, sizeof(name_buf),
-					 "/dev/hidraw%d", cnt);
-#ifdef DEBUG
-				fprintf(stderr,
-					"waveshare: device: %s\n", name_buf);
-#endif
-				ret = stat(name_buf, &devstat);
-				if (ret < 0)
-					continue;
-
-				ts_tmp = ts_open(name_buf, 0);
-				if (!ts_tmp)
-					continue;
-
-#ifdef DEBUG
-				fprintf(stderr, "  opened\n");
-#endif
-				ret = ioctl(ts_tmp->fd, HIDIOCGRAWINFO, &info);
-				if (ret < 0) {
-					ts_close(ts_tmp);
-					continue;
-				}
-
-				info.vendor &= 0xFFFF;
-				info.product &= 0xFFFF;
-#ifdef DEBUG
-				fprintf(stderr,
-					"  vid=%04X, pid=%04X\n",
-					info.vendor, info.product);
-#endif
-
-				if (i->vendor == info.vendor &&
-				    i->product == info.product) {
-					close(ts->fd);
-
-					ts->fd = ts_tmp->fd;
-					found = 1;
-#ifdef DEBUG
-					fprintf(stderr, "  correct device\n");
-#endif
-					ts_close(ts_tmp);
-					break;
-				}
-
-				ts_close(ts_tmp);
-			} /* for HIDRAW_MAX_DEVICES */
-
-			if (found == 0)
-				return -1;
-		} /* vid/pid set */
-	} /* reopen */
+	if (i->reopen) {
+		i->reopen = 0;
+		if (waveshare_reopen(i) < 0)
+			return -1;
+	}
 
 	buf = alloca(i->len * nr);
 
@@ -338,6 +294,7 @@ TSAPI struct tslib_module_info *waveshare_mod_init(struct tsdev *dev,
 	i->vendor = 0;
 	i->product = 0;
 	i->len = 25;
+	i->reopen = 1;
 
 	if (tslib_parse_vars(&i->module, raw_vars, NR_VARS, params)) {
 		free(i);
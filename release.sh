@@ -137,6 +137,8 @@ make distclean
 	--enable-galax=static \
 	--enable-h3600=static \
 	--enable-mk712=static \
+	--enable-replay=static \
+	--enable-synth=static \
 	--enable-tatung=static \
 	--enable-touchkit=static \
 	--enable-ucb1x00=static \
@@ -153,7 +155,10 @@ make distclean
 	--enable-linear=static \
 	--enable-linear-h2200=static \
 	--enable-lowpass=static \
-	--enable-crop=static
+	--enable-crop=static \
+	--enable-oneeuro=static \
+	--enable-predict=static \
+	--enable-resample=static
 
 make -j"${NUMCPUS}"
 make clean
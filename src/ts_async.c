@@ -0,0 +1,374 @@
+/*
+ *  tslib/src/ts_async.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Read and filter samples on a thread of our own. Finished frames are
+ * handed to ts_read_mt() through a single-producer/single-consumer ring,
+ * so reading them takes neither locks nor system calls.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tslib-private.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H)
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/* frames read through the filter chain at once */
+#define TS_ASYNC_BATCH	16
+
+struct ts_async {
+	pthread_t thread;
+	int efd;		/* readable while there are frames */
+	int stop_fd;		/* tells the thread to stop */
+	int fd_flags;		/* of ts->fd, before we started */
+	int max_slots;
+
+	/*
+	 * cap frames of max_slots samples. Frames from head up to tail are
+	 * ready to be read. Only the thread writes tail. head is moved by
+	 * the reader, and by the thread if it drops the oldest frame; both
+	 * do that by compare-and-swap.
+	 */
+	uint32_t cap;
+	uint32_t head;
+	uint32_t tail;
+	struct ts_sample_mt *ring;
+	struct ts_frame_info *ring_info;
+
+	/* the thread's own buffer for the filter chain */
+	struct ts_sample_mt **batch;
+
+	unsigned long dropped;
+	int error;		/* why the thread stopped */
+};
+
+static void ts_async_signal(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof(one)) < 0) {
+		/* the counter is full, so it's readable anyway */
+	}
+}
+
+static void ts_async_push(struct tsdev *ts, struct ts_async *a,
+			  const struct ts_sample_mt *frame)
+{
+	uint32_t tail = a->tail;
+	uint32_t head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+
+	if (tail - head == a->cap) {
+		if (__atomic_load_n(&ts->async_overflow, __ATOMIC_RELAXED) ==
+		    TS_ASYNC_DROP_NEWEST) {
+			__atomic_add_fetch(&a->dropped, 1, __ATOMIC_RELAXED);
+			/* it has no number yet, but the application sees a gap */
+			ts->seq++;
+			return;
+		}
+
+		/* drop the oldest, unless the reader just took it */
+		if (__atomic_compare_exchange_n(&a->head, &head, head + 1, 0,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE))
+			__atomic_add_fetch(&a->dropped, 1, __ATOMIC_RELAXED);
+	}
+
+	memcpy(&a->ring[(tail & (a->cap - 1)) * a->max_slots], frame,
+	       a->max_slots * sizeof(struct ts_sample_mt));
+	__ts_frame_info(ts, frame, a->max_slots,
+			&a->ring_info[tail & (a->cap - 1)]);
+	__atomic_store_n(&a->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void *ts_async_thread(void *arg)
+{
+	struct tsdev *ts = arg;
+	struct ts_async *a = ts->async;
+	struct pollfd pfd[2];
+	int ret;
+	int i;
+
+	pfd[1].fd = a->stop_fd;
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		errno = 0;
+		ret = __ts_chain_read_mt(ts, a->batch, a->max_slots,
+					 TS_ASYNC_BATCH);
+		if (ret > 0) {
+			for (i = 0; i < ret; i++)
+				ts_async_push(ts, a, a->batch[i]);
+
+			ts_async_signal(a->efd);
+			continue;
+		}
+
+		if (ret == -1)
+			ret = errno ? -errno : -EIO;
+
+		if (ret != 0 && ret != -EAGAIN && ret != -EINTR)
+			break;
+
+		/* the filters took it all, but there may be more read ahead */
+		if (ret == 0 && ts->raw_more)
+			continue;
+
+		pfd[0].fd = ts->fd;
+		pfd[0].events = POLLIN;
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ret = -errno;
+			break;
+		}
+
+		if (pfd[1].revents) {
+			ret = 0;
+			break;
+		}
+
+		if (pfd[0].revents & POLLNVAL) {
+			ret = -EBADF;
+			break;
+		}
+	}
+
+	__atomic_store_n(&a->error, ret, __ATOMIC_RELEASE);
+	ts_async_signal(a->efd);
+
+	return NULL;
+}
+
+static void ts_async_free(struct ts_async *a)
+{
+	if (a->efd >= 0)
+		close(a->efd);
+	if (a->stop_fd >= 0)
+		close(a->stop_fd);
+
+	if (a->batch)
+		free(a->batch[0]);
+	free(a->batch);
+	free(a->ring);
+	free(a->ring_info);
+	free(a);
+}
+
+int ts_start_async(struct tsdev *ts, int max_slots, int capacity)
+{
+	struct ts_async *a;
+	uint32_t cap = 1;
+	int ret;
+	int i;
+
+	if (ts->async)
+		return -EBUSY;
+
+	if (max_slots < 1 || capacity < 1 || capacity > (1 << 20))
+		return -EINVAL;
+
+	while (cap < (uint32_t)capacity)
+		cap <<= 1;
+
+	a = calloc(1, sizeof(*a));
+	if (!a)
+		return -ENOMEM;
+
+	a->efd = -1;
+	a->stop_fd = -1;
+	a->cap = cap;
+	a->max_slots = max_slots;
+
+	a->ring = calloc((size_t)cap * max_slots, sizeof(struct ts_sample_mt));
+	a->ring_info = calloc(cap, sizeof(*a->ring_info));
+	a->batch = malloc(TS_ASYNC_BATCH * sizeof(*a->batch));
+	if (!a->ring || !a->ring_info || !a->batch) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	a->batch[0] = calloc(TS_ASYNC_BATCH * max_slots,
+			     sizeof(struct ts_sample_mt));
+	if (!a->batch[0]) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	for (i = 1; i < TS_ASYNC_BATCH; i++)
+		a->batch[i] = a->batch[0] + i * max_slots;
+
+	a->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	a->stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (a->efd < 0 || a->stop_fd < 0) {
+		ret = -errno;
+		goto err;
+	}
+
+	/* the thread waits in poll() so that we can stop it */
+	a->fd_flags = fcntl(ts->fd, F_GETFL);
+	if (a->fd_flags < 0 ||
+	    fcntl(ts->fd, F_SETFL, a->fd_flags | O_NONBLOCK) < 0) {
+		ret = -errno;
+		goto err;
+	}
+
+	ts->async = a;
+	ret = pthread_create(&a->thread, NULL, ts_async_thread, ts);
+	if (ret) {
+		ts->async = NULL;
+		fcntl(ts->fd, F_SETFL, a->fd_flags);
+		ret = -ret;
+		goto err;
+	}
+
+	return 0;
+
+err:
+	ts_async_free(a);
+	return ret;
+}
+
+int ts_stop_async(struct tsdev *ts)
+{
+	struct ts_async *a = ts->async;
+
+	if (!a)
+		return 0;
+
+	ts_async_signal(a->stop_fd);
+	pthread_join(a->thread, NULL);
+
+	fcntl(ts->fd, F_SETFL, a->fd_flags);
+
+	ts->async = NULL;
+	ts_async_free(a);
+
+	return 0;
+}
+
+int ts_async_fd(struct tsdev *ts)
+{
+	if (!ts->async)
+		return -1;
+
+	return ts->async->efd;
+}
+
+unsigned long ts_async_dropped(struct tsdev *ts)
+{
+	if (!ts->async)
+		return 0;
+
+	return __atomic_load_n(&ts->async->dropped, __ATOMIC_RELAXED);
+}
+
+/* wait == 0: never wait, like for a non-blocking device */
+int __ts_async_read_mt(struct tsdev *ts, struct ts_sample_mt **samp,
+		       struct ts_frame_info *info, int max_slots, int nr,
+		       int wait)
+{
+	struct ts_async *a = ts->async;
+	struct pollfd pfd;
+	uint64_t cnt;
+	uint32_t head, tail;
+	int slots = max_slots < a->max_slots ? max_slots : a->max_slots;
+	int n = 0;
+	int ret;
+
+	while (n < nr) {
+		head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+		tail = __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE);
+
+		if (head == tail) {
+			if (n)
+				break;
+
+			/* clear the eventfd first, so no wakeup gets lost */
+			if (read(a->efd, &cnt, sizeof(cnt)) > 0)
+				continue;
+
+			ret = __atomic_load_n(&a->error, __ATOMIC_ACQUIRE);
+			if (ret)
+				return ret;
+
+			if (!wait || (a->fd_flags & O_NONBLOCK))
+				return -EAGAIN;
+
+			pfd.fd = a->efd;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+				return -errno;
+
+			continue;
+		}
+
+		memcpy(samp[n], &a->ring[(head & (a->cap - 1)) * a->max_slots],
+		       slots * sizeof(struct ts_sample_mt));
+		if (info)
+			info[n] = a->ring_info[head & (a->cap - 1)];
+
+		/* if the thread dropped this one meanwhile, our copy is stale */
+		if (!__atomic_compare_exchange_n(&a->head, &head, head + 1, 0,
+						 __ATOMIC_ACQ_REL,
+						 __ATOMIC_ACQUIRE))
+			continue;
+
+		if (max_slots > slots)
+			memset(&samp[n][slots], 0, (max_slots - slots) *
+			       sizeof(struct ts_sample_mt));
+		n++;
+	}
+
+	return n;
+}
+
+#else
+
+int ts_start_async(__attribute__ ((unused)) struct tsdev *ts,
+		   __attribute__ ((unused)) int max_slots,
+		   __attribute__ ((unused)) int capacity)
+{
+	return -ENOSYS;
+}
+
+int ts_stop_async(__attribute__ ((unused)) struct tsdev *ts)
+{
+	return 0;
+}
+
+int ts_async_fd(__attribute__ ((unused)) struct tsdev *ts)
+{
+	return -1;
+}
+
+unsigned long ts_async_dropped(__attribute__ ((unused)) struct tsdev *ts)
+{
+	return 0;
+}
+
+int __ts_async_read_mt(__attribute__ ((unused)) struct tsdev *ts,
+		       __attribute__ ((unused)) struct ts_sample_mt **samp,
+		       __attribute__ ((unused)) struct ts_frame_info *info,
+		       __attribute__ ((unused)) int max_slots,
+		       __attribute__ ((unused)) int nr,
+		       __attribute__ ((unused)) int wait)
+{
+	return -ENOSYS;
+}
+
+#endif
@@ -22,6 +22,7 @@ int __ts_attach(struct tsdev *ts, struct tslib_module_info *info)
 	info->dev = ts;
 	info->next = ts->list;
 	ts->list = info;
+	__ts_chain_reset(ts);
 
 	return 0;
 }
@@ -33,6 +34,7 @@ int __ts_attach_raw(struct tsdev *ts, struct tslib_module_info *info)
 	info->dev = ts;
 	info->next = prev_list;
 	ts->list_raw = info;
+	__ts_chain_reset(ts);
 
 	/*
 	 * ensure the last item in the normal list now points to the
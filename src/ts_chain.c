@@ -0,0 +1,236 @@
+/*
+ *  tslib/src/ts_chain.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Run the filter chain. Filters that implement process/process_mt are
+ * driven from here in one pass over a buffer the raw module filled,
+ * instead of each one pulling from the next.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "tslib-private.h"
+
+/* for filters that are called by a module that doesn't know process() */
+int tslib_filter_read(struct tslib_module_info *inf, struct ts_sample *samp,
+		      int nr)
+{
+	int ret;
+
+	/* held back samples first */
+	ret = inf->ops->process(inf, samp, 0, nr);
+	if (ret != 0)
+		return ret;
+
+	ret = inf->next->ops->read(inf->next, samp, nr);
+	if (ret <= 0)
+		return ret;
+
+	return inf->ops->process(inf, samp, ret, nr);
+}
+
+int tslib_filter_read_mt(struct tslib_module_info *inf,
+			 struct ts_sample_mt **samp, int max_slots, int nr)
+{
+	int ret;
+
+	if (!inf->ops->process_mt || !inf->next->ops->read_mt)
+		return -ENOSYS;
+
+	ret = inf->ops->process_mt(inf, samp, max_slots, 0, nr);
+	if (ret != 0)
+		return ret;
+
+	ret = inf->next->ops->read_mt(inf->next, samp, max_slots, nr);
+	if (ret <= 0)
+		return ret;
+
+	return inf->ops->process_mt(inf, samp, max_slots, ret, nr);
+}
+
+void __ts_chain_reset(struct tsdev *ts)
+{
+	__ts_transform_unfuse(ts);
+	free(ts->chain);
+	ts->chain = NULL;
+	ts->chain_len = 0;
+	ts->chain_len_mt = 0;
+}
+
+/*
+ * ts->chain lists the modules top-down. The first chain_len of them can
+ * process() and are run by us, the one after that is where we read from.
+ * Modules that only transform coordinates are merged, see ts_transform.c.
+ */
+static int ts_chain_build(struct tsdev *ts)
+{
+	struct tslib_module_info *info;
+	int n = 0;
+	int ret;
+
+	for (info = ts->list; info; info = info->next)
+		n++;
+
+	ts->chain = malloc((n + 1) * sizeof(*ts->chain));
+	if (!ts->chain)
+		return -ENOMEM;
+
+	n = 0;
+	for (info = ts->list; info; info = info->next)
+		ts->chain[n++] = info;
+	ts->chain[n] = NULL;
+
+	ret = __ts_transform_fuse(ts);
+	if (ret < 0) {
+		__ts_chain_reset(ts);
+		return ret;
+	}
+
+	for (n = 0; ts->chain[n] && ts->chain[n]->ops->process; n++)
+		;
+	ts->chain_len = n;
+
+	for (n = 0; ts->chain[n] && ts->chain[n]->ops->process_mt; n++)
+		;
+	ts->chain_len_mt = n;
+
+	return __ts_stats_chain(ts);
+}
+
+/* run chain[i], with the stats if they're on */
+static int ts_chain_process(struct tsdev *ts, int i, struct ts_sample *samp,
+			    int nr, int max)
+{
+	struct tslib_module_info *info = ts->chain[i];
+	uint64_t start;
+	int ret;
+
+	TS_TRACE3(module_entry, ts, ts->chain_len - i, nr);
+	if (!ts->stats) {
+		ret = info->ops->process(info, samp, nr, max);
+	} else {
+		start = __ts_stats_now();
+		ret = info->ops->process(info, samp, nr, max);
+		__ts_stats_stage(ts, i, start, nr, ret);
+	}
+	TS_TRACE3(module_return, ts, ts->chain_len - i, ret);
+
+	return ret;
+}
+
+static int ts_chain_process_mt(struct tsdev *ts, int i,
+			       struct ts_sample_mt **samp, int max_slots,
+			       int nr, int max)
+{
+	struct tslib_module_info *info = ts->chain[i];
+	uint64_t start;
+	int ret;
+
+	TS_TRACE3(module_entry, ts, ts->chain_len_mt - i, nr);
+	if (!ts->stats) {
+		ret = info->ops->process_mt(info, samp, max_slots, nr, max);
+	} else {
+		start = __ts_stats_now();
+		ret = info->ops->process_mt(info, samp, max_slots, nr, max);
+		__ts_stats_stage(ts, i, start, nr, ret);
+	}
+	TS_TRACE3(module_return, ts, ts->chain_len_mt - i, ret);
+
+	return ret;
+}
+
+int __ts_chain_read(struct tsdev *ts, struct ts_sample *samp, int nr)
+{
+	struct tslib_module_info *src;
+	uint64_t start;
+	int ret = 0;
+	int i;
+
+	if (!ts->chain) {
+		ret = ts_chain_build(ts);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* hand out what the filters held back, if any */
+	for (i = ts->chain_len - 1; i >= 0; i--) {
+		ret = ts_chain_process(ts, i, samp, ret, nr);
+		if (ret < 0)
+			return ret;
+	}
+	if (ret > 0)
+		return ret;
+
+	src = ts->chain[ts->chain_len];
+	if (!src)
+		return -ENODEV;
+
+	TS_TRACE3(module_entry, ts, 0, nr);
+	if (ts->stats) {
+		start = __ts_stats_now();
+		ret = src->ops->read(src, samp, nr);
+		__ts_stats_stage(ts, ts->chain_len, start, 0, ret);
+	} else {
+		ret = src->ops->read(src, samp, nr);
+	}
+	TS_TRACE3(module_return, ts, 0, ret);
+	ts->raw_more = ret > 0;
+
+	for (i = ts->chain_len - 1; i >= 0 && ret > 0; i--)
+		ret = ts_chain_process(ts, i, samp, ret, nr);
+
+	return ret;
+}
+
+int __ts_chain_read_mt(struct tsdev *ts, struct ts_sample_mt **samp,
+		       int max_slots, int nr)
+{
+	struct tslib_module_info *src;
+	uint64_t start;
+	int ret = 0;
+	int i;
+
+	if (!ts->chain) {
+		ret = ts_chain_build(ts);
+		if (ret < 0)
+			return ret;
+	}
+
+	for (i = ts->chain_len_mt - 1; i >= 0; i--) {
+		ret = ts_chain_process_mt(ts, i, samp, max_slots, ret, nr);
+		if (ret < 0)
+			return ret;
+	}
+	if (ret > 0)
+		return ret;
+
+	src = ts->chain[ts->chain_len_mt];
+	if (!src)
+		return -ENODEV;
+
+	if (!src->ops->read_mt)
+		return -ENOSYS;
+
+	TS_TRACE3(module_entry, ts, 0, nr);
+	if (ts->stats) {
+		start = __ts_stats_now();
+		ret = src->ops->read_mt(src, samp, max_slots, nr);
+		__ts_stats_stage(ts, ts->chain_len_mt, start, 0, ret);
+	} else {
+		ret = src->ops->read_mt(src, samp, max_slots, nr);
+	}
+	TS_TRACE3(module_return, ts, 0, ret);
+	ts->raw_more = ret > 0;
+
+	for (i = ts->chain_len_mt - 1; i >= 0 && ret > 0; i--)
+		ret = ts_chain_process_mt(ts, i, samp, max_slots, ret, nr);
+
+	return ret;
+}
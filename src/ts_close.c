@@ -30,6 +30,11 @@ int ts_close(struct tsdev *ts)
 	int ret = 0;
 	struct tslib_module_info *info, *next;
 
+	ts_stop_async(ts);
+
+	/* fused stages point to the modules */
+	__ts_chain_reset(ts);
+
 	info = ts->list;
 	while (info) {
 		/* Save the "next" pointer now because info will be freed */
@@ -49,12 +54,17 @@ int ts_close(struct tsdev *ts)
 		info = next;
 	}
 
-	if (ts_close_restricted)
+	if (ts->virtual)
+		__ts_virtual_free(ts);
+	else if (ts_close_restricted)
 		ts_close_restricted(ts->fd, NULL);
 	else
 		ret = close(ts->fd);
 
 	free(ts->eventpath);
+	free(ts->pointercal);
+	__ts_read_latest_reset(ts);
+	__ts_stats_free(ts);
 
 	free(ts);
 
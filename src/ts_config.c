@@ -142,7 +142,9 @@ static int __ts_config(struct tsdev *ts, char **conffile_modules,
 		#endif
 			discard_null_tokens(&p, &module_name);
 			if (!conffile_modules) {
-				ret = ts_load_module_raw(ts, module_name, p);
+				/* what's pushed is the raw input */
+				if (!ts->virtual)
+					ret = ts_load_module_raw(ts, module_name, p);
 			} else {
 			#ifdef DEBUG
 				printf("TSLIB_CONFFILE: module_raw %s %s\n",
@@ -195,7 +197,19 @@ int ts_reconfig(struct tsdev *ts)
 	void *handle;
 	int ret;
 	struct tslib_module_info *info, *next;
-	int fd;
+	struct ts_virtual *virtual;
+	char *eventpath;
+	unsigned long long seq;
+	int fd, clock;
+
+	/* the thread runs the modules */
+	if (ts->async)
+		return -EBUSY;
+
+	TS_TRACE1(reconfig, ts);
+
+	/* fused stages point to the modules */
+	__ts_chain_reset(ts);
 
 	info = ts->list;
 	while (info) {
@@ -213,10 +227,27 @@ int ts_reconfig(struct tsdev *ts)
 
 		info = next;
 	}
+	__ts_read_latest_reset(ts);
+	__ts_stats_free(ts);
+	free(ts->pointercal);
 
 	fd = ts->fd;	/* save temp */
+	eventpath = ts->eventpath;
+	clock = ts->clock;	/* what the application compares against */
+	virtual = ts->virtual;
+	seq = ts->seq;		/* syn_dropped starts over, seq doesn't */
 	memset(ts, 0, sizeof(struct tsdev));
 	ts->fd = fd;
+	ts->eventpath = eventpath;
+	ts->clock = clock;
+	ts->seq = seq;
+
+	if (virtual) {
+		ts->virtual = virtual;
+		ret = __ts_virtual_attach(ts);
+		if (ret)
+			return ret;
+	}
 
 	ret = ts_config(ts);
 	return ret;
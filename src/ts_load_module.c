@@ -102,12 +102,27 @@ static const struct tslib_module_desc tslib_modules[] = {
 #ifdef TSLIB_STATIC_ONE_WIRE_TS_INPUT_MODULE
 	{ "one_wire_ts_input", one_wire_ts_input_mod_init },
 #endif
+#ifdef TSLIB_STATIC_ONEEURO_MODULE
+	{ "oneeuro", oneeuro_mod_init },
+#endif
+#ifdef TSLIB_STATIC_PREDICT_MODULE
+	{ "predict", predict_mod_init },
+#endif
 #ifdef TSLIB_STATIC_PTHRES_MODULE
 	{ "pthres", pthres_mod_init },
 #endif
+#ifdef TSLIB_STATIC_REPLAY_MODULE
+	{ "replay", replay_mod_init },
+#endif
+#ifdef TSLIB_STATIC_RESAMPLE_MODULE
+	{ "resample", resample_mod_init },
+#endif
 #ifdef TSLIB_STATIC_SKIP_MODULE
 	{ "skip", skip_mod_init },
 #endif
+#ifdef TSLIB_STATIC_SYNTH_MODULE
+	{ "synth", synth_mod_init },
+#endif
 #ifdef TSLIB_STATIC_TATUNG_MODULE
 	{ "tatung", tatung_mod_init },
 #endif
@@ -246,6 +261,10 @@ static int __ts_load_module(struct tsdev *ts, const char *module,
 	else
 		ret = __ts_attach(ts, info);
 
+	/* without it, ts_get_module_stats() only doesn't know the name */
+	if (ret == 0)
+		__ts_stats_name(ts, info, module);
+
 	if (ret) {
 #ifdef DEBUG
 		ts_error("Can't attach %s\n", module);
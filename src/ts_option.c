@@ -12,15 +12,18 @@
  * Interface for setting parameters for the core library
  */
 #include "config.h"
+#include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "tslib-private.h"
 
 int ts_option(struct tsdev *ts, enum ts_param param, ...)
 {
+	const struct timeval *tv;
 	int ret;
 	va_list ap;
 
@@ -35,6 +38,53 @@ int ts_option(struct tsdev *ts, enum ts_param param, ...)
 	case TS_SCREEN_ROT:
 		ts->rotation = va_arg(ap, int);
 		break;
+	case TS_ASYNC_OVERFLOW:
+		ret = va_arg(ap, int);
+		if (ret != TS_ASYNC_DROP_NEWEST && ret != TS_ASYNC_DROP_OLDEST) {
+			ret = -EINVAL;
+			break;
+		}
+		__atomic_store_n(&ts->async_overflow, ret, __ATOMIC_RELAXED);
+		ret = 0;
+		break;
+	case TS_VSYNC:
+		tv = va_arg(ap, const struct timeval *);
+		ret = 0;
+		if (tv) {
+			/* 0 means not set, a microsecond off doesn't matter */
+			ret = (tv->tv_sec % 1000) * 1000000 + tv->tv_usec;
+			if (ret == 0)
+				ret = 1;
+		}
+		__atomic_store_n(&ts->vsync, ret, __ATOMIC_RELAXED);
+		ret = 0;
+		break;
+	case TS_STATS:
+		/* the thread would be counting into what we free */
+		if (ts->async) {
+			ret = -EBUSY;
+			break;
+		}
+		ret = __ts_stats_enable(ts, va_arg(ap, int));
+		break;
+	case TS_CLOCK:
+		/* the thread reads, and the raw module sets it on the device */
+		if (ts->async) {
+			ret = -EBUSY;
+			break;
+		}
+		ret = va_arg(ap, int);
+		if (ret != CLOCK_REALTIME && ret != CLOCK_MONOTONIC
+#ifdef CLOCK_BOOTTIME
+		    && ret != CLOCK_BOOTTIME
+#endif
+		    ) {
+			ret = -EINVAL;
+			break;
+		}
+		ts->clock = ret;
+		ret = 0;
+		break;
 	}
 	va_end(ap);
 
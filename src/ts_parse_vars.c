@@ -26,12 +26,11 @@
 
 #define BUF_SIZE 1024
 
-static char s_holder[BUF_SIZE];
-
 int tslib_parse_vars(struct tslib_module_info *mod,
 		     const struct tslib_vars *vars, int nr,
 		     const char *str)
 {
+	char s_holder[BUF_SIZE];	/* our own copy, so it's reentrant */
 	char *s, *p;
 	int ret = 0;
 
@@ -0,0 +1,70 @@
+/*
+ *  tslib/src/ts_pointercal.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Read the calibration file once for all modules that need it.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "tslib-private.h"
+
+/*
+ * Sets *pcal to the contents of the calibration file, or NULL if there is
+ * none. Returns -1 with errno set if it can't be read.
+ */
+int tslib_get_pointercal(struct tsdev *ts,
+			 const struct tslib_pointercal **pcal)
+{
+	struct tslib_pointercal *p;
+	struct stat sbuf;
+	FILE *pcal_fd;
+	char *calfile;
+
+	if (ts->pointercal) {
+		*pcal = ts->pointercal;
+		return 0;
+	}
+
+	*pcal = NULL;
+
+	if ((calfile = getenv("TSLIB_CALIBFILE")) == NULL)
+		calfile = TS_POINTERCAL;
+
+	if (stat(calfile, &sbuf) != 0)
+		return 0;
+
+	pcal_fd = fopen(calfile, "r");
+	if (!pcal_fd)
+		return -1;
+
+	p = calloc(1, sizeof(*p));
+	if (!p) {
+		fclose(pcal_fd);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (p->nr_a = 0; p->nr_a < 7; p->nr_a++)
+		if (fscanf(pcal_fd, "%d", &p->a[p->nr_a]) != 1)
+			break;
+
+	p->nr_res = fscanf(pcal_fd, "%d %d", &p->res[0], &p->res[1]);
+	p->nr_rot = fscanf(pcal_fd, "%d", &p->rot);
+
+	fclose(pcal_fd);
+
+	ts->pointercal = p;
+	*pcal = p;
+
+	return 0;
+}
@@ -13,6 +13,10 @@
  */
 #include "config.h"
 
+#include <errno.h>
+#include <stddef.h>
+#include <sys/time.h>
+
 #include "tslib-private.h"
 
 #ifdef DEBUG
@@ -28,7 +32,14 @@ int ts_read(struct tsdev *ts, struct ts_sample *samp, int nr)
 	int i;
 #endif
 
-	result = ts->list->ops->read(ts->list, samp, nr);
+	/* the thread reads multitouch frames only */
+	if (ts->async)
+		return -EBUSY;
+
+	result = __ts_chain_read(ts, samp, nr);
+	if (ts->stats && result > 0)
+		__ts_stats_read(ts, samp, result);
+	TS_TRACE2(read_return, ts, result);
 #ifdef DEBUG
 	for (i = 0; i < result; i++) {
 		fprintf(stderr, "TS_READ----> x = %d, y = %d, pressure = %d\n",
@@ -41,15 +52,27 @@ int ts_read(struct tsdev *ts, struct ts_sample *samp, int nr)
 
 }
 
-int ts_read_mt(struct tsdev *ts, struct ts_sample_mt **samp, int max_slots,
-	       int nr)
+static int ts_read_mt_common(struct tsdev *ts, struct ts_sample_mt **samp,
+			     struct ts_frame_info *info, int max_slots, int nr)
 {
 	int result;
+	int i;
 #ifdef DEBUG
-	int i, j;
+	int j;
 #endif
 
-	result = ts->list->ops->read_mt(ts->list, samp, max_slots, nr);
+	if (ts->async) {
+		/* numbered when queued, so that the frames it drops count */
+		result = __ts_async_read_mt(ts, samp, info, max_slots, nr, 1);
+	} else {
+		result = __ts_chain_read_mt(ts, samp, max_slots, nr);
+		for (i = 0; i < result; i++)
+			__ts_frame_info(ts, samp[i], max_slots,
+					info ? &info[i] : NULL);
+	}
+	if (ts->stats && result > 0)
+		__ts_stats_read_mt(ts, samp, max_slots, result);
+	TS_TRACE2(read_return, ts, result);
 #ifdef DEBUG
 	for (j = 0; j < result; j++) {
 		for (i = 0; i < max_slots; i++) {
@@ -63,5 +86,48 @@ int ts_read_mt(struct tsdev *ts, struct ts_sample_mt **samp, int max_slots,
 	}
 #endif
 	return result;
+}
+
+int ts_read_mt(struct tsdev *ts, struct ts_sample_mt **samp, int max_slots,
+	       int nr)
+{
+	return ts_read_mt_common(ts, samp, NULL, max_slots, nr);
+}
 
+int ts_read_mt_info(struct tsdev *ts, struct ts_sample_mt **samp,
+		    struct ts_frame_info *info, int max_slots, int nr)
+{
+	return ts_read_mt_common(ts, samp, info, max_slots, nr);
+}
+
+/* numbers the frame; without info, that's all */
+void __ts_frame_info(struct tsdev *ts, const struct ts_sample_mt *frame,
+		     int max_slots, struct ts_frame_info *info)
+{
+	unsigned long dropped;
+	const struct timeval *tv = NULL;
+	int i;
+
+	/* whatever the kernel dropped, there was a frame in it at least */
+	dropped = __atomic_load_n(&ts->syn_dropped, __ATOMIC_RELAXED);
+	ts->seq += 1 + (dropped - ts->seq_syn_dropped);
+	ts->seq_syn_dropped = dropped;
+	if (!info)
+		return;
+	info->seq = ts->seq;
+
+	for (i = 0; i < max_slots; i++) {
+		if (!(frame[i].valid & TSLIB_MT_VALID))
+			continue;
+		if (!tv || timercmp(&frame[i].tv, tv, >))
+			tv = &frame[i].tv;
+	}
+
+	info->time_ns = tv ? (unsigned long long)tv->tv_sec * 1000000000 +
+			     tv->tv_usec * 1000ULL : 0;
+}
+
+unsigned long ts_syn_dropped(struct tsdev *ts)
+{
+	return __atomic_load_n(&ts->syn_dropped, __ATOMIC_RELAXED);
 }
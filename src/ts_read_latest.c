@@ -0,0 +1,238 @@
+/*
+ *  tslib/src/ts_read_latest.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Read everything that is pending, and hand out only the most recent
+ * sample of every slot. The filters still see every sample, so their
+ * history stays right. Touches and releases are never merged away.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tslib-private.h"
+
+/* frames read through the filter chain at once */
+#define TS_LATEST_BATCH	16
+
+struct ts_latest {
+	int max_slots;
+
+	/* frames read, from pos up to count not handed out yet */
+	struct ts_sample_mt **buf;
+	int pos;
+	int count;
+
+	/* what the application saw last, per slot */
+	int32_t *tracking_id;
+	short *pen_down;
+};
+
+void __ts_read_latest_reset(struct tsdev *ts)
+{
+	struct ts_latest *l = ts->latest;
+
+	if (!l)
+		return;
+
+	if (l->buf)
+		free(l->buf[0]);
+	free(l->buf);
+	free(l->tracking_id);
+	free(l->pen_down);
+	free(l);
+
+	ts->latest = NULL;
+}
+
+static int ts_latest_alloc(struct tsdev *ts, int max_slots)
+{
+	struct ts_latest *l;
+	int i;
+
+	__ts_read_latest_reset(ts);
+
+	l = calloc(1, sizeof(*l));
+	if (!l)
+		return -ENOMEM;
+
+	l->max_slots = max_slots;
+	l->buf = malloc(TS_LATEST_BATCH * sizeof(*l->buf));
+	l->tracking_id = malloc(max_slots * sizeof(*l->tracking_id));
+	l->pen_down = calloc(max_slots, sizeof(*l->pen_down));
+	if (l->buf)
+		l->buf[0] = calloc(TS_LATEST_BATCH * max_slots,
+				   sizeof(struct ts_sample_mt));
+	ts->latest = l;
+
+	if (!l->buf || !l->buf[0] || !l->tracking_id || !l->pen_down) {
+		__ts_read_latest_reset(ts);
+		return -ENOMEM;
+	}
+
+	for (i = 1; i < TS_LATEST_BATCH; i++)
+		l->buf[i] = l->buf[0] + i * max_slots;
+	for (i = 0; i < max_slots; i++)
+		l->tracking_id[i] = -1;
+
+	return 0;
+}
+
+/*
+ * Read the next batch of frames. Only if wait is set, and the device is a
+ * blocking one, this waits for them.
+ */
+static int ts_latest_fill(struct tsdev *ts, struct ts_latest *l, int wait)
+{
+	struct pollfd pfd;
+	int flags;
+	int ret;
+
+	if (ts->async) {
+		ret = __ts_async_read_mt(ts, l->buf, NULL, l->max_slots,
+					 TS_LATEST_BATCH, wait);
+		goto out;
+	}
+
+	/* nothing to wait for, it's there or it isn't */
+	if (ts->virtual) {
+		ret = __ts_chain_read_mt(ts, l->buf, l->max_slots,
+					 TS_LATEST_BATCH);
+		goto out;
+	}
+
+	flags = fcntl(ts->fd, F_GETFL);
+	if (flags < 0)
+		return -errno;
+
+	for (;;) {
+		/* we must not block once we have something to hand out */
+		if (!(flags & O_NONBLOCK) &&
+		    fcntl(ts->fd, F_SETFL, flags | O_NONBLOCK) < 0)
+			return -errno;
+
+		errno = 0;
+		ret = __ts_chain_read_mt(ts, l->buf, l->max_slots,
+					 TS_LATEST_BATCH);
+		if (ret == -1)
+			ret = errno ? -errno : -EIO;	/* EOF, for one */
+
+		if (!(flags & O_NONBLOCK))
+			fcntl(ts->fd, F_SETFL, flags);
+
+		/* the filters took it all, but there may be more read ahead */
+		if (ret == 0 && ts->raw_more)
+			continue;
+
+		if (ret != -EAGAIN || !wait || (flags & O_NONBLOCK))
+			break;
+
+		pfd.fd = ts->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			return -errno;
+	}
+
+out:
+	if (ret < 0)
+		return ret;
+
+	l->pos = 0;
+	l->count = ret;
+
+	return ret;
+}
+
+/*
+ * A slot of the frame we build is a touch or release the application
+ * didn't see yet. It must not be replaced by one of the next contact.
+ */
+static int ts_latest_conflicts(const struct ts_latest *l,
+			       const struct ts_sample_mt *samp,
+			       const struct ts_sample_mt *frame)
+{
+	int j;
+
+	for (j = 0; j < l->max_slots; j++) {
+		if (!(frame[j].valid & TSLIB_MT_VALID) ||
+		    !(samp[j].valid & TSLIB_MT_VALID))
+			continue;
+
+		if (samp[j].tracking_id == l->tracking_id[j] &&
+		    samp[j].pen_down == l->pen_down[j])
+			continue;
+
+		if (frame[j].tracking_id != samp[j].tracking_id ||
+		    frame[j].pen_down != samp[j].pen_down)
+			return 1;
+	}
+
+	return 0;
+}
+
+int ts_read_latest(struct tsdev *ts, struct ts_sample_mt *samp,
+		   int max_slots)
+{
+	struct ts_latest *l = ts->latest;
+	struct ts_sample_mt *frame;
+	int merged = 0;
+	int ret = 0;
+	int j;
+
+	if (max_slots < 1)
+		return -EINVAL;
+
+	if (!l || l->max_slots != max_slots) {
+		ret = ts_latest_alloc(ts, max_slots);
+		if (ret < 0)
+			return ret;
+		l = ts->latest;
+	}
+
+	memset(samp, 0, max_slots * sizeof(*samp));
+
+	for (;;) {
+		if (l->pos == l->count) {
+			ret = ts_latest_fill(ts, l, !merged);
+			if (ret == 0 || ret == -EINTR)
+				continue;	/* the filters kept them */
+			if (ret < 0) {
+				/* hand out what we have, errors come next time */
+				if (merged)
+					break;
+				return ret;
+			}
+		}
+
+		frame = l->buf[l->pos];
+		if (ts_latest_conflicts(l, samp, frame))
+			break;
+
+		for (j = 0; j < max_slots; j++) {
+			if (frame[j].valid & TSLIB_MT_VALID)
+				samp[j] = frame[j];
+		}
+		l->pos++;
+		merged++;
+	}
+
+	for (j = 0; j < max_slots; j++) {
+		if (!(samp[j].valid & TSLIB_MT_VALID))
+			continue;
+
+		l->tracking_id[j] = samp[j].tracking_id;
+		l->pen_down[j] = samp[j].pen_down;
+	}
+
+	return 1;
+}
@@ -13,6 +13,8 @@
  */
 #include "config.h"
 
+#include <errno.h>
+
 #include "tslib-private.h"
 
 #ifdef DEBUG
@@ -26,7 +28,12 @@ int ts_read_raw(struct tsdev *ts, struct ts_sample *samp, int nr)
 #ifdef DEBUG
 	int i;
 #endif
-	int result = ts->list_raw->ops->read(ts->list_raw, samp, nr);
+	int result;
+
+	if (ts->async)
+		return -EBUSY;
+
+	result = ts->list_raw->ops->read(ts->list_raw, samp, nr);
 
 #ifdef DEBUG
 	for (i = 0; i < result; i++) {
@@ -46,8 +53,12 @@ int ts_read_raw_mt(struct tsdev *ts, struct ts_sample_mt **samp, int slots,
 #ifdef DEBUG
 	int i, j;
 #endif
+	int result;
+
+	if (ts->async)
+		return -EBUSY;
 
-	int result = ts->list_raw->ops->read_mt(ts->list_raw, samp, slots, nr);
+	result = ts->list_raw->ops->read_mt(ts->list_raw, samp, slots, nr);
 #ifdef DEBUG
 	for (i = 0; i < result; i++) {
 		for (j = 0; j < slots; j++) {
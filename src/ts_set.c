@@ -0,0 +1,351 @@
+/*
+ *  tslib/src/ts_set.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Read from many touchscreens in one loop. The devices of a set are
+ * waited for with epoll, and read from in turns, whichever are ready.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tslib-private.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+struct ts_set_dev {
+	struct tsdev *ts;
+	int fd;
+};
+
+struct ts_set {
+	int epfd;
+
+	struct ts_set_dev **dev;
+	int nr;
+	int alloc;
+
+	/* devices epoll said are ready, that we didn't read all from yet */
+	struct epoll_event *events;
+	struct ts_set_dev **ready;
+	int nr_ready;
+	struct ts_set_dev **served;
+};
+
+struct ts_set *ts_set_create(void)
+{
+	struct ts_set *set;
+
+	set = calloc(1, sizeof(*set));
+	if (!set)
+		return NULL;
+
+	set->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (set->epfd < 0) {
+		free(set);
+		return NULL;
+	}
+
+	return set;
+}
+
+void ts_set_destroy(struct ts_set *set)
+{
+	int i;
+
+	if (!set)
+		return;
+
+	for (i = 0; i < set->nr; i++)
+		free(set->dev[i]);
+
+	close(set->epfd);
+	free(set->dev);
+	free(set->events);
+	free(set->ready);
+	free(set->served);
+	free(set);
+}
+
+int ts_set_fd(struct ts_set *set)
+{
+	return set->epfd;
+}
+
+int ts_set_add(struct ts_set *set, struct tsdev *ts)
+{
+	struct ts_set_dev *d;
+	struct epoll_event ev;
+	int flags;
+	int i;
+
+	for (i = 0; i < set->nr; i++) {
+		if (set->dev[i]->ts == ts)
+			return -EEXIST;
+	}
+
+	/* we must not block on one device while others have samples */
+	if (!ts->async) {
+		flags = fcntl(ts->fd, F_GETFL);
+		if (flags < 0)
+			return -errno;
+		if (!(flags & O_NONBLOCK))
+			return -EINVAL;
+	}
+
+	if (set->nr == set->alloc) {
+		int alloc = set->alloc ? set->alloc * 2 : 8;
+		void *p;
+
+		p = realloc(set->dev, alloc * sizeof(*set->dev));
+		if (!p)
+			return -ENOMEM;
+		set->dev = p;
+
+		p = realloc(set->ready, alloc * sizeof(*set->ready));
+		if (!p)
+			return -ENOMEM;
+		set->ready = p;
+
+		p = realloc(set->served, alloc * sizeof(*set->served));
+		if (!p)
+			return -ENOMEM;
+		set->served = p;
+
+		p = realloc(set->events, alloc * sizeof(*set->events));
+		if (!p)
+			return -ENOMEM;
+		set->events = p;
+
+		set->alloc = alloc;
+	}
+
+	d = malloc(sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+
+	d->ts = ts;
+	d->fd = ts->async ? ts_async_fd(ts) : ts->fd;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = d;
+	if (epoll_ctl(set->epfd, EPOLL_CTL_ADD, d->fd, &ev) < 0) {
+		free(d);
+		return -errno;
+	}
+
+	set->dev[set->nr++] = d;
+
+	return 0;
+}
+
+int ts_set_remove(struct ts_set *set, struct tsdev *ts)
+{
+	struct ts_set_dev *d = NULL;
+	int i;
+
+	for (i = 0; i < set->nr; i++) {
+		if (set->dev[i]->ts == ts) {
+			d = set->dev[i];
+			set->dev[i] = set->dev[--set->nr];
+			break;
+		}
+	}
+	if (!d)
+		return -ENOENT;
+
+	for (i = 0; i < set->nr_ready; i++) {
+		if (set->ready[i] == d) {
+			memmove(&set->ready[i], &set->ready[i + 1],
+				(set->nr_ready - i - 1) * sizeof(*set->ready));
+			set->nr_ready--;
+			break;
+		}
+	}
+
+	epoll_ctl(set->epfd, EPOLL_CTL_DEL, d->fd, NULL);
+	free(d);
+
+	return 0;
+}
+
+static int ts_set_read_dev(struct ts_set_dev *d, struct ts_sample_mt **samp,
+			   int max_slots, int nr)
+{
+	if (d->ts->async)
+		return __ts_async_read_mt(d->ts, samp, NULL, max_slots, nr, 0);
+
+	return ts_read_mt(d->ts, samp, max_slots, nr);
+}
+
+/* add what epoll reports to the devices we know are ready */
+static int ts_set_poll(struct ts_set *set, int timeout)
+{
+	struct ts_set_dev *d;
+	int ret;
+	int i, j;
+
+	ret = epoll_wait(set->epfd, set->events, set->nr, timeout);
+	if (ret < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	for (i = 0; i < ret; i++) {
+		d = set->events[i].data.ptr;
+
+		for (j = 0; j < set->nr_ready; j++) {
+			if (set->ready[j] == d)
+				break;
+		}
+		if (j == set->nr_ready)
+			set->ready[set->nr_ready++] = d;
+	}
+
+	return ret;
+}
+
+static int ts_set_elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000 +
+	       (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+int ts_set_read_mt(struct ts_set *set, struct ts_sample_mt **samp,
+		   struct tsdev **devs, int max_slots, int nr, int timeout)
+{
+	struct ts_set_dev *d;
+	struct timespec start;
+	int wait = timeout;
+	int n = 0;
+	int ret;
+	int i, k;
+
+	if (set->nr == 0)
+		return -ENOENT;
+
+	if (timeout > 0)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/*
+	 * Devices that are still ready from last time must not keep the
+	 * others from being looked at, so ask epoll about those without
+	 * waiting.
+	 */
+	ret = ts_set_poll(set, set->nr_ready ? 0 : wait);
+	if (ret < 0 || set->nr_ready == 0)
+		return ret;
+
+	for (;;) {
+		/*
+		 * Every ready device gets one turn. The ones that had more
+		 * than we could take stay ready, and go last next time.
+		 */
+		for (i = 0, k = 0; i < set->nr_ready && n < nr; i++) {
+			d = set->ready[i];
+
+			ret = ts_set_read_dev(d, samp + n, max_slots, nr - n);
+			if (ret < 0 && ret != -EAGAIN && ret != -EINTR) {
+				/*
+				 * a broken device, let the app deal with it.
+				 * Return what we have first.
+				 */
+				if (n == 0) {
+					devs[0] = d->ts;
+					n = ret;
+					set->served[k++] = d;
+					i++;
+				}
+				break;
+			}
+
+			/*
+			 * What the raw module read ahead doesn't make epoll
+			 * report the device again. If it handed out samples,
+			 * it may have more, even if the filters let less through.
+			 */
+			if (ret == nr - n ||
+			    (!d->ts->async && d->ts->raw_more))
+				set->served[k++] = d;
+
+			for (; ret > 0; ret--)
+				devs[n++] = d->ts;
+		}
+
+		memmove(set->ready, set->ready + i,
+			(set->nr_ready - i) * sizeof(*set->ready));
+		memcpy(set->ready + set->nr_ready - i, set->served,
+		       k * sizeof(*set->served));
+		set->nr_ready += k - i;
+
+		if (n != 0)
+			return n;
+
+		/* woken up for less than an event, wait for the rest */
+		if (timeout > 0) {
+			wait = timeout - ts_set_elapsed_ms(&start);
+			if (wait < 0)
+				wait = 0;
+		}
+
+		ret = ts_set_poll(set, set->nr_ready ? 0 : wait);
+		if (ret < 0 || set->nr_ready == 0)
+			return ret;
+	}
+}
+
+#else
+
+struct ts_set *ts_set_create(void)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+void ts_set_destroy(__attribute__ ((unused)) struct ts_set *set)
+{
+}
+
+int ts_set_fd(__attribute__ ((unused)) struct ts_set *set)
+{
+	return -1;
+}
+
+int ts_set_add(__attribute__ ((unused)) struct ts_set *set,
+	       __attribute__ ((unused)) struct tsdev *ts)
+{
+	return -ENOSYS;
+}
+
+int ts_set_remove(__attribute__ ((unused)) struct ts_set *set,
+		  __attribute__ ((unused)) struct tsdev *ts)
+{
+	return -ENOSYS;
+}
+
+int ts_set_read_mt(__attribute__ ((unused)) struct ts_set *set,
+		   __attribute__ ((unused)) struct ts_sample_mt **samp,
+		   __attribute__ ((unused)) struct tsdev **devs,
+		   __attribute__ ((unused)) int max_slots,
+		   __attribute__ ((unused)) int nr,
+		   __attribute__ ((unused)) int timeout)
+{
+	return -ENOSYS;
+}
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ *  tslib/src/ts_stats.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * What every stage of the filter chain costs, and how old the samples are
+ * that ts_read() and ts_read_mt() return. Nothing is collected until it's
+ * enabled by ts_option(ts, TS_STATS, 1); until then, all this costs is a
+ * test for NULL per stage.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tslib-private.h"
+
+/* what ts_load_module() loaded, to put names to the chain's modules */
+struct ts_module_name {
+	struct ts_module_name *next;
+	const struct tslib_module_info *info;
+	char name[];
+};
+
+struct ts_stats {
+	/* by the position in ts->chain, up to and including the source */
+	struct ts_module_stats *stage;
+	int nr;
+
+	struct ts_latency_stats latency;
+};
+
+int __ts_stats_name(struct tsdev *ts, const struct tslib_module_info *info,
+		    const char *name)
+{
+	struct ts_module_name *n;
+
+	n = malloc(sizeof(*n) + strlen(name) + 1);
+	if (!n)
+		return -ENOMEM;
+
+	n->info = info;
+	strcpy(n->name, name);
+	n->next = ts->names;
+	ts->names = n;
+
+	return 0;
+}
+
+static const char *ts_stats_name(struct tsdev *ts,
+				 const struct tslib_module_info *info)
+{
+	const struct ts_module_name *n;
+
+	for (n = ts->names; n; n = n->next) {
+		if (n->info == info)
+			return n->name;
+	}
+
+	return "?";
+}
+
+/* for a fused stage, the names of the modules in it, like "invert+linear" */
+static void ts_stats_stage_name(struct tsdev *ts,
+				const struct tslib_module_info *info,
+				char *name, size_t size)
+{
+	struct tslib_module_info *const *stage;
+	size_t len = 0;
+	int nr, i;
+
+	nr = __ts_transform_stages(info, &stage);
+	if (nr == 0) {
+		stage = (struct tslib_module_info *const *)&info;
+		nr = 1;
+	}
+
+	name[0] = '\0';
+	for (i = 0; i < nr && len + 1 < size; i++) {
+		if (i)
+			name[len++] = '+';
+		strncpy(name + len, ts_stats_name(ts, stage[i]), size - len - 1);
+		name[size - 1] = '\0';
+		len = strlen(name);
+	}
+}
+
+/* the chain was (re)built: the stages may not be what they were */
+int __ts_stats_chain(struct tsdev *ts)
+{
+	struct ts_stats *st = ts->stats;
+	int n, i;
+
+	if (!st || !ts->chain)
+		return 0;
+
+	for (n = 0; ts->chain[n]; n++)
+		;
+
+	free(st->stage);
+	st->nr = 0;
+	st->stage = calloc(n + 1, sizeof(*st->stage));
+	if (!st->stage)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		ts_stats_stage_name(ts, ts->chain[i], st->stage[i].name,
+				    sizeof(st->stage[i].name));
+	}
+	st->nr = n;
+
+	return 0;
+}
+
+int __ts_stats_enable(struct tsdev *ts, int on)
+{
+	struct ts_stats *st = ts->stats;
+
+	if (st) {
+		free(st->stage);
+		free(st);
+		ts->stats = NULL;
+	}
+
+	if (!on)
+		return 0;
+
+	st = calloc(1, sizeof(*st));
+	if (!st)
+		return -ENOMEM;
+
+	ts->stats = st;
+
+	return __ts_stats_chain(ts);
+}
+
+void __ts_stats_free(struct tsdev *ts)
+{
+	struct ts_module_name *n, *next;
+
+	__ts_stats_enable(ts, 0);
+
+	for (n = ts->names; n; n = next) {
+		next = n->next;
+		free(n);
+	}
+	ts->names = NULL;
+}
+
+uint64_t __ts_stats_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void __ts_stats_stage(struct tsdev *ts, int i, uint64_t start, int in, int out)
+{
+	struct ts_stats *st = ts->stats;
+	struct ts_module_stats *s;
+	uint64_t t;
+
+	if (i >= st->nr)
+		return;
+
+	t = __ts_stats_now() - start;
+	s = &st->stage[i];
+
+	s->calls++;
+	s->time_ns += t;
+	if (t > s->time_max_ns)
+		s->time_max_ns = t;
+
+	s->samples_in += in;
+	if (out > 0)
+		s->samples_out += out;
+	if (out < in)
+		s->samples_held += in - (out > 0 ? out : 0);
+}
+
+/* in the clock of the timestamps, see TS_CLOCK */
+static void ts_stats_clock(struct tsdev *ts, struct timespec *now)
+{
+	if (clock_gettime(ts->clock, now))
+		clock_gettime(CLOCK_REALTIME, now);
+}
+
+static void ts_stats_latency(struct ts_stats *st, const struct timespec *now,
+			     const struct timeval *tv)
+{
+	int64_t us;
+
+	us = (int64_t)(now->tv_sec - tv->tv_sec) * 1000000 +
+	     (now->tv_nsec / 1000 - tv->tv_usec);
+
+	/* the clock was set */
+	if (us < 0)
+		return;
+
+	st->latency.samples++;
+	st->latency.latency_us += us;
+	if ((uint64_t)us > st->latency.latency_max_us)
+		st->latency.latency_max_us = us;
+}
+
+void __ts_stats_read(struct tsdev *ts, const struct ts_sample *samp, int nr)
+{
+	struct timespec now;
+	int i;
+
+	ts_stats_clock(ts, &now);
+
+	for (i = 0; i < nr; i++)
+		ts_stats_latency(ts->stats, &now, &samp[i].tv);
+}
+
+void __ts_stats_read_mt(struct tsdev *ts, struct ts_sample_mt **samp,
+			int max_slots, int nr)
+{
+	struct timespec now;
+	int i, j;
+
+	ts_stats_clock(ts, &now);
+
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < max_slots; j++) {
+			if (samp[i][j].valid & TSLIB_MT_VALID)
+				ts_stats_latency(ts->stats, &now, &samp[i][j].tv);
+		}
+	}
+}
+
+int ts_get_module_stats(struct tsdev *ts, struct ts_module_stats *stats,
+			int nr, struct ts_latency_stats *latency)
+{
+	struct ts_stats *st = ts->stats;
+	int n, i;
+
+	if (!st)
+		return -EINVAL;
+
+	if (latency)
+		*latency = st->latency;
+
+	/* down to where the samples are read from, that one first */
+	n = ts->chain_len > ts->chain_len_mt ? ts->chain_len : ts->chain_len_mt;
+	if (n >= st->nr)
+		n = st->nr - 1;
+
+	for (i = 0; i <= n && i < nr; i++)
+		stats[i] = st->stage[n - i];
+
+	return n + 1;
+}
@@ -0,0 +1,634 @@
+/*
+ *  tslib/src/ts_trace.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * .tstrace files: multitouch frames, as ts_read_raw_mt() and ts_read_mt()
+ * return them, recorded compactly for offline analysis and replay.
+ *
+ * After a header that describes the device, every frame is a record of
+ *
+ *	varint	nr << 1 | stream	the number of valid samples in it
+ *	then, nr times:
+ *	varint	slot			index into the frame
+ *	varint	mask			which fields changed, see trace_fields
+ *	zigzag varints			the changes, by bit
+ *
+ * The changes are to the previous sample of the same slot of the same
+ * stream, except for the time, which changes from the previous sample of
+ * the stream. Most of a frame is what it was, so most records are a few
+ * bytes. The header is little endian.
+ *
+ * Reading maps the file where that is possible, and decodes from there.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tslib-private.h"
+
+#define TS_TRACE_MAGIC		"TSTRACE"
+#define TS_TRACE_VERSION	1
+#define TS_TRACE_HEADER		120
+#define TS_TRACE_STREAMS	2
+
+/* the writer flushes about this much at a time */
+#define TS_TRACE_BUF		65536
+
+/* worst case: a varint of 64 bits is 10 bytes */
+#define VARINT_MAX		10
+
+#define TRACE_FIELD(f)	{ offsetof(struct ts_sample_mt, f), \
+			  sizeof(((struct ts_sample_mt *)0)->f) }
+
+/* bit n + 1 of the mask; bit 0 is the time */
+static const struct {
+	size_t offset;
+	size_t size;
+} trace_fields[] = {
+	TRACE_FIELD(x),
+	TRACE_FIELD(y),
+	TRACE_FIELD(pressure),
+	TRACE_FIELD(tracking_id),
+	TRACE_FIELD(pen_down),
+	TRACE_FIELD(valid),
+	TRACE_FIELD(slot),
+	TRACE_FIELD(tool_type),
+	TRACE_FIELD(tool_x),
+	TRACE_FIELD(tool_y),
+	TRACE_FIELD(touch_major),
+	TRACE_FIELD(width_major),
+	TRACE_FIELD(touch_minor),
+	TRACE_FIELD(width_minor),
+	TRACE_FIELD(orientation),
+	TRACE_FIELD(distance),
+	TRACE_FIELD(blob_id),
+};
+
+#define NR_FIELDS (sizeof(trace_fields) / sizeof(trace_fields[0]))
+
+/* slot, mask and every field, changed */
+#define SAMPLE_MAX		(2 * VARINT_MAX + (NR_FIELDS + 1) * VARINT_MAX)
+
+struct ts_trace {
+	struct ts_trace_info info;
+
+	/* what the last sample of every slot of each stream was */
+	struct ts_sample_mt *last[TS_TRACE_STREAMS];
+	int64_t last_us[TS_TRACE_STREAMS];
+
+	/* writing */
+	FILE *f;
+	unsigned char *buf;
+	size_t len;
+	size_t size;
+	int err;
+
+	/* reading */
+	int stream;
+	const unsigned char *data;
+	size_t data_len;
+	size_t pos;
+	int mapped;
+};
+
+static int32_t trace_get(const struct ts_sample_mt *s, unsigned int n)
+{
+	const char *p = (const char *)s + trace_fields[n].offset;
+
+	if (trace_fields[n].size == sizeof(short))
+		return *(const short *)p;
+
+	return *(const int32_t *)p;
+}
+
+static void trace_set(struct ts_sample_mt *s, unsigned int n, int32_t v)
+{
+	char *p = (char *)s + trace_fields[n].offset;
+
+	if (trace_fields[n].size == sizeof(short))
+		*(short *)p = (short)v;
+	else
+		*(int32_t *)p = v;
+}
+
+static int64_t trace_us(const struct timeval *tv)
+{
+	return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+	       (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static unsigned char *put_varint(unsigned char *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+
+	return p;
+}
+
+static unsigned char *put_zigzag(unsigned char *p, int64_t v)
+{
+	return put_varint(p, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+/* -1 if the record runs past the end of the file */
+static int get_varint(struct ts_trace *t, uint64_t *v)
+{
+	unsigned int shift = 0;
+	unsigned char c;
+
+	*v = 0;
+	do {
+		if (t->pos >= t->data_len || shift >= 64)
+			return -1;
+
+		c = t->data[t->pos++];
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	return 0;
+}
+
+static int get_zigzag(struct ts_trace *t, int64_t *v)
+{
+	uint64_t u;
+
+	if (get_varint(t, &u))
+		return -1;
+
+	*v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+
+	return 0;
+}
+
+static struct ts_trace *trace_alloc(const struct ts_trace_info *info)
+{
+	struct ts_trace *t;
+	int i;
+
+	if (info->max_slots <= 0)
+		return NULL;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->info = *info;
+	t->info.name[sizeof(t->info.name) - 1] = '\0';
+
+	for (i = 0; i < TS_TRACE_STREAMS; i++) {
+		t->last[i] = calloc(info->max_slots, sizeof(struct ts_sample_mt));
+		if (!t->last[i]) {
+			for (i--; i >= 0; i--)
+				free(t->last[i]);
+			free(t);
+			return NULL;
+		}
+	}
+
+	return t;
+}
+
+static void trace_free(struct ts_trace *t)
+{
+	int i;
+
+	for (i = 0; i < TS_TRACE_STREAMS; i++)
+		free(t->last[i]);
+	free(t);
+}
+
+static int trace_flush(struct ts_trace *t)
+{
+	errno = 0;
+	if (t->len && !t->err &&
+	    fwrite(t->buf, 1, t->len, t->f) != t->len)
+		t->err = errno ? -errno : -EIO;
+
+	t->len = 0;
+
+	return t->err;
+}
+
+struct ts_trace *ts_trace_create(const char *path,
+				 const struct ts_trace_info *info)
+{
+	const struct ts_trace_axis *axis[3];
+	unsigned char *p;
+	struct ts_trace *t;
+	int i;
+
+	t = trace_alloc(info);
+	if (!t)
+		return NULL;
+
+	/* room for at least a frame with every slot in it */
+	t->size = TS_TRACE_BUF;
+	if (t->size < VARINT_MAX + (size_t)info->max_slots * SAMPLE_MAX)
+		t->size = VARINT_MAX + (size_t)info->max_slots * SAMPLE_MAX;
+
+	t->buf = malloc(t->size);
+	if (!t->buf) {
+		trace_free(t);
+		return NULL;
+	}
+
+	t->f = fopen(path, "wb");
+	if (!t->f) {
+		free(t->buf);
+		trace_free(t);
+		return NULL;
+	}
+
+	p = t->buf;
+	memset(p, 0, TS_TRACE_HEADER);
+	memcpy(p, TS_TRACE_MAGIC, sizeof(TS_TRACE_MAGIC));
+	put_le32(p + 8, TS_TRACE_VERSION);
+	put_le32(p + 12, TS_TRACE_HEADER);
+	memcpy(p + 16, t->info.name, sizeof(t->info.name));
+	put_le32(p + 80, t->info.max_slots);
+
+	axis[0] = &t->info.x;
+	axis[1] = &t->info.y;
+	axis[2] = &t->info.pressure;
+	for (i = 0; i < 3; i++) {
+		put_le32(p + 84 + i * 12, axis[i]->minimum);
+		put_le32(p + 88 + i * 12, axis[i]->maximum);
+		put_le32(p + 92 + i * 12, axis[i]->resolution);
+	}
+	t->len = TS_TRACE_HEADER;
+	t->stream = -1;
+
+	return t;
+}
+
+int ts_trace_write_mt(struct ts_trace *t, int stream,
+		      struct ts_sample_mt **samp, int max_slots, int nr)
+{
+	struct ts_sample_mt *s, *last;
+	unsigned char *p, *mask_at;
+	uint64_t mask;
+	int64_t us, d;
+	unsigned int n;
+	int i, j, valid;
+
+	if (!t->f || stream < 0 || stream >= TS_TRACE_STREAMS)
+		return -EINVAL;
+
+	if (max_slots > t->info.max_slots)
+		max_slots = t->info.max_slots;
+
+	for (i = 0; i < nr; i++) {
+		valid = 0;
+		for (j = 0; j < max_slots; j++) {
+			if (samp[i][j].valid & TSLIB_MT_VALID)
+				valid++;
+		}
+		if (!valid)
+			continue;
+
+		if (t->size - t->len < VARINT_MAX + (size_t)valid * SAMPLE_MAX &&
+		    trace_flush(t))
+			return t->err;
+
+		p = put_varint(t->buf + t->len, (uint64_t)valid << 1 | stream);
+
+		for (j = 0; j < max_slots; j++) {
+			s = &samp[i][j];
+			if (!(s->valid & TSLIB_MT_VALID))
+				continue;
+
+			last = &t->last[stream][j];
+			p = put_varint(p, j);
+
+			/* the mask is at most 3 bytes; write it when we know it */
+			mask_at = p;
+			p += 3;
+
+			mask = 0;
+			us = trace_us(&s->tv);
+			if (us != t->last_us[stream]) {
+				p = put_zigzag(p, us - t->last_us[stream]);
+				t->last_us[stream] = us;
+				mask |= 1;
+			}
+
+			for (n = 0; n < NR_FIELDS; n++) {
+				d = (int64_t)trace_get(s, n) - trace_get(last, n);
+				if (d == 0)
+					continue;
+
+				p = put_zigzag(p, d);
+				mask |= (uint64_t)1 << (n + 1);
+			}
+
+			/* full-width, so the changes needn't move */
+			mask_at[0] = (mask & 0x7f) | 0x80;
+			mask_at[1] = ((mask >> 7) & 0x7f) | 0x80;
+			mask_at[2] = (mask >> 14) & 0x7f;
+
+			*last = *s;
+		}
+
+		t->len = p - t->buf;
+	}
+
+	if (t->len >= TS_TRACE_BUF && trace_flush(t))
+		return t->err;
+
+	return nr;
+}
+
+static int trace_map(struct ts_trace *t, FILE *f)
+{
+	unsigned char *data;
+	size_t size = 0, len;
+
+#ifdef HAVE_SYS_MMAN_H
+	struct stat st;
+	void *map;
+
+	if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) &&
+	    st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			   fileno(f), 0);
+		if (map != MAP_FAILED) {
+			t->data = map;
+			t->data_len = st.st_size;
+			t->mapped = 1;
+			return 0;
+		}
+	}
+#endif
+
+	/* a pipe, or no mmap() */
+	data = NULL;
+	len = 0;
+	do {
+		if (len == size) {
+			unsigned char *tmp;
+
+			size = size ? size * 2 : TS_TRACE_BUF;
+			tmp = realloc(data, size);
+			if (!tmp) {
+				free(data);
+				return -ENOMEM;
+			}
+			data = tmp;
+		}
+		len += fread(data + len, 1, size - len, f);
+	} while (len == size);
+
+	if (ferror(f)) {
+		free(data);
+		return -EIO;
+	}
+
+	t->data = data;
+	t->data_len = len;
+
+	return 0;
+}
+
+static void trace_unmap(struct ts_trace *t)
+{
+#ifdef HAVE_SYS_MMAN_H
+	if (t->mapped) {
+		munmap((void *)t->data, t->data_len);
+		return;
+	}
+#endif
+	free((void *)t->data);
+}
+
+struct ts_trace *ts_trace_open(const char *path, int stream)
+{
+	struct ts_trace_axis *axis[3];
+	struct ts_trace_info info;
+	struct ts_trace *t, tmp;
+	const unsigned char *p;
+	uint32_t header;
+	FILE *f;
+	int i;
+
+	if (stream < 0 || stream >= TS_TRACE_STREAMS) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	memset(&tmp, 0, sizeof(tmp));
+	i = trace_map(&tmp, f);
+	fclose(f);
+	if (i) {
+		errno = -i;
+		return NULL;
+	}
+
+	p = tmp.data;
+	if (tmp.data_len < TS_TRACE_HEADER ||
+	    memcmp(p, TS_TRACE_MAGIC, sizeof(TS_TRACE_MAGIC)) != 0 ||
+	    get_le32(p + 8) != TS_TRACE_VERSION)
+		goto invalid;
+
+	header = get_le32(p + 12);
+	if (header < TS_TRACE_HEADER || header > tmp.data_len)
+		goto invalid;
+
+	memset(&info, 0, sizeof(info));
+	memcpy(info.name, p + 16, sizeof(info.name));
+	info.max_slots = (int32_t)get_le32(p + 80);
+
+	axis[0] = &info.x;
+	axis[1] = &info.y;
+	axis[2] = &info.pressure;
+	for (i = 0; i < 3; i++) {
+		axis[i]->minimum = (int32_t)get_le32(p + 84 + i * 12);
+		axis[i]->maximum = (int32_t)get_le32(p + 88 + i * 12);
+		axis[i]->resolution = (int32_t)get_le32(p + 92 + i * 12);
+	}
+
+	t = trace_alloc(&info);
+	if (!t) {
+		trace_unmap(&tmp);
+		errno = info.max_slots <= 0 ? EINVAL : ENOMEM;
+		return NULL;
+	}
+
+	t->data = tmp.data;
+	t->data_len = tmp.data_len;
+	t->mapped = tmp.mapped;
+	t->pos = header;
+	t->stream = stream;
+
+	return t;
+
+invalid:
+	trace_unmap(&tmp);
+	errno = EINVAL;
+	return NULL;
+}
+
+const struct ts_trace_info *ts_trace_get_info(struct ts_trace *t)
+{
+	return &t->info;
+}
+
+/*
+ * Decode the record at t->pos. Returns 1 if it's of the stream that is
+ * read, and then fills frame, 0 if it is not, -ENODATA at the end of the
+ * file and -EINVAL if it is garbage.
+ */
+static int trace_decode(struct ts_trace *t, struct ts_sample_mt *frame,
+			int max_slots)
+{
+	size_t start = t->pos;
+	struct ts_sample_mt *last;
+	uint64_t head, slot, mask;
+	int64_t d;
+	unsigned int n;
+	int stream, nr, i;
+
+	if (get_varint(t, &head))
+		goto end;
+
+	stream = head & 1;
+	if (head >> 1 > (uint64_t)t->info.max_slots)
+		return -EINVAL;
+	nr = head >> 1;
+
+	if (stream == t->stream)
+		memset(frame, 0, max_slots * sizeof(*frame));
+
+	for (i = 0; i < nr; i++) {
+		if (get_varint(t, &slot) || get_varint(t, &mask))
+			goto end;
+
+		if (slot >= (uint64_t)t->info.max_slots ||
+		    mask >> (NR_FIELDS + 1))
+			return -EINVAL;
+
+		last = &t->last[stream][slot];
+
+		if (mask & 1) {
+			if (get_zigzag(t, &d))
+				goto end;
+			t->last_us[stream] += d;
+		}
+
+		for (n = 0; n < NR_FIELDS; n++) {
+			if (!(mask & ((uint64_t)1 << (n + 1))))
+				continue;
+
+			if (get_zigzag(t, &d))
+				goto end;
+			trace_set(last, n, (int32_t)(trace_get(last, n) + d));
+		}
+
+		last->tv.tv_sec = t->last_us[stream] / 1000000;
+		last->tv.tv_usec = t->last_us[stream] % 1000000;
+
+		if (stream == t->stream && slot < (uint64_t)max_slots)
+			frame[slot] = *last;
+	}
+
+	return stream == t->stream;
+
+end:
+	/* a record cut short, like by a recorder that was killed */
+	t->pos = start;
+	return -ENODATA;
+}
+
+int ts_trace_read_mt(struct ts_trace *t, struct ts_sample_mt **samp,
+		     int max_slots, int nr)
+{
+	int i = 0, ret;
+
+	if (!t->data)
+		return -EINVAL;
+
+	while (i < nr) {
+		ret = trace_decode(t, samp[i], max_slots);
+		if (ret == -ENODATA)
+			break;
+		if (ret < 0)
+			return i ? i : ret;
+
+		i += ret;
+	}
+
+	return i;
+}
+
+int ts_trace_rewind(struct ts_trace *t)
+{
+	int i;
+
+	if (!t->data)
+		return -EINVAL;
+
+	for (i = 0; i < TS_TRACE_STREAMS; i++) {
+		memset(t->last[i], 0,
+		       t->info.max_slots * sizeof(struct ts_sample_mt));
+		t->last_us[i] = 0;
+	}
+	t->pos = get_le32(t->data + 12);
+
+	return 0;
+}
+
+int ts_trace_close(struct ts_trace *t)
+{
+	int ret = 0;
+
+	if (t->f) {
+		ret = trace_flush(t);
+		if (fclose(t->f) && !ret)
+			ret = -errno;
+		free(t->buf);
+	}
+
+	if (t->data)
+		trace_unmap(t);
+
+	trace_free(t);
+
+	return ret;
+}
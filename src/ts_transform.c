@@ -0,0 +1,466 @@
+/*
+ *  tslib/src/ts_transform.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * Coordinate transforms. Module invert, linear and crop describe what
+ * they do as a struct ts_transform. When they are stacked in ts.conf,
+ * they are composed into one stage of the filter chain, so the samples
+ * are transformed once, no matter how many of them there are.
+ *
+ * Composing is exact: maps are done modulo 2^32 and the division of
+ * module linear is never moved, so the result is always the same as
+ * running the modules one after another.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tslib-private.h"
+
+/*
+ * See Granlund and Montgomery, "Division by Invariant Integers using
+ * Multiplication".
+ */
+void ts_div_init(struct ts_div *div, uint32_t d)
+{
+	uint32_t log2_d = 0;
+	uint64_t m;
+	uint32_t rem;
+
+	while ((d >> log2_d) > 1)
+		log2_d++;
+
+	div->add = 0;
+	div->shift = log2_d;
+
+	/* powers of 2 (and 0, which is never divided by) are just shifts */
+	if ((d & (d - 1)) == 0) {
+		div->magic = 0;
+		return;
+	}
+
+	m = ((uint64_t)1 << (32 + log2_d)) / d;
+	rem = ((uint64_t)1 << (32 + log2_d)) % d;
+
+	if (d - rem >= ((uint32_t)1 << log2_d)) {
+		/* the magic number needs 33 bits. use 32 and add */
+		m += m;
+		if (rem + rem >= d || rem + rem < rem)
+			m++;
+
+		div->add = 1;
+	}
+	div->magic = (uint32_t)m + 1;
+}
+
+static inline uint32_t ts_udiv(uint32_t n, const struct ts_div *div)
+{
+	uint32_t q;
+
+	if (!div->magic)
+		return n >> div->shift;
+
+	q = ((uint64_t)div->magic * n) >> 32;
+	if (div->add)
+		return (((n - q) >> 1) + q) >> div->shift;
+
+	return q >> div->shift;
+}
+
+void ts_transform_init(struct ts_transform *t)
+{
+	memset(t, 0, sizeof(*t));
+	t->m[0][0] = 1;
+	t->m[1][1] = 1;
+	t->m2[0][0] = 1;
+	t->m2[1][1] = 1;
+}
+
+/* m, off = next_m * (m, off) + next_off */
+static void ts_map_compose(uint32_t m[2][2], uint32_t off[2],
+			   const uint32_t next_m[2][2],
+			   const uint32_t next_off[2])
+{
+	uint32_t r[2][2];
+	uint32_t o[2];
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		r[i][0] = next_m[i][0] * m[0][0] + next_m[i][1] * m[1][0];
+		r[i][1] = next_m[i][0] * m[0][1] + next_m[i][1] * m[1][1];
+		o[i] = next_m[i][0] * off[0] + next_m[i][1] * off[1] +
+		       next_off[i];
+	}
+
+	memcpy(m, r, sizeof(r));
+	memcpy(off, o, sizeof(o));
+}
+
+/*
+ * Add next to the end of t. Returns -EAGAIN if that's not possible: there
+ * is only room for one division, and clipping has to be done last.
+ */
+int ts_transform_append(struct ts_transform *t,
+			const struct ts_transform *next)
+{
+	uint32_t m[2][2];
+	uint32_t off[2];
+
+	if (t->flags & TS_TRANSFORM_CLIP)
+		return -EAGAIN;
+
+	if ((t->flags & TS_TRANSFORM_DIV) && (next->flags & TS_TRANSFORM_DIV))
+		return -EAGAIN;
+
+	if (next->flags & TS_TRANSFORM_DIV) {
+		memcpy(m, next->m, sizeof(m));
+		memcpy(off, next->off, sizeof(off));
+		ts_map_compose(t->m, t->off, m, off);
+
+		t->div = next->div;
+		t->div_neg = next->div_neg;
+		t->scale_x = next->scale_x;
+		t->scale_y = next->scale_y;
+		t->div_x = next->div_x;
+		t->div_y = next->div_y;
+		t->p_offset = next->p_offset;
+		t->p_mult = next->p_mult;
+		t->div_p = next->div_p;
+		memcpy(t->m2, next->m2, sizeof(t->m2));
+		memcpy(t->off2, next->off2, sizeof(t->off2));
+		t->flags |= TS_TRANSFORM_MAP | TS_TRANSFORM_DIV;
+	} else if (next->flags & TS_TRANSFORM_MAP) {
+		if (t->flags & TS_TRANSFORM_DIV) {
+			ts_map_compose(t->m2, t->off2, next->m, next->off);
+		} else {
+			ts_map_compose(t->m, t->off, next->m, next->off);
+			t->flags |= TS_TRANSFORM_MAP;
+		}
+	}
+
+	if (next->flags & TS_TRANSFORM_CLIP) {
+		t->clip = next->clip;
+		t->flags |= TS_TRANSFORM_CLIP;
+	}
+
+	return 0;
+}
+
+static inline void ts_transform_apply(const struct ts_transform *t,
+				      int *x, int *y, unsigned int *pressure)
+{
+	uint32_t xtemp = *x;
+	uint32_t ytemp = *y;
+	uint32_t nx, ny;
+	uint32_t q;
+
+	if (t->flags & TS_TRANSFORM_MAP) {
+		nx = t->m[0][0] * xtemp + t->m[0][1] * ytemp + t->off[0];
+		ny = t->m[1][0] * xtemp + t->m[1][1] * ytemp + t->off[1];
+		xtemp = nx;
+		ytemp = ny;
+	}
+
+	if (t->flags & TS_TRANSFORM_DIV) {
+		/* rounded towards 0, like a signed division */
+		q = ts_udiv((int32_t)xtemp < 0 ? -xtemp : xtemp, &t->div);
+		nx = (((int32_t)xtemp < 0) != t->div_neg) ? -q : q;
+		q = ts_udiv((int32_t)ytemp < 0 ? -ytemp : ytemp, &t->div);
+		ny = (((int32_t)ytemp < 0) != t->div_neg) ? -q : q;
+
+		if (t->scale_x)
+			nx = ts_udiv(nx * t->scale_x, &t->div_x);
+		if (t->scale_y)
+			ny = ts_udiv(ny * t->scale_y, &t->div_y);
+
+		*pressure = ts_udiv((*pressure + t->p_offset) * t->p_mult,
+				    &t->div_p);
+
+		xtemp = t->m2[0][0] * nx + t->m2[0][1] * ny + t->off2[0];
+		ytemp = t->m2[1][0] * nx + t->m2[1][1] * ny + t->off2[1];
+	}
+
+	*x = (int32_t)xtemp;
+	*y = (int32_t)ytemp;
+}
+
+static inline int ts_clip_outside(const struct ts_clip *clip, int x, int y)
+{
+	return x >= clip->w || x < 0 || y >= clip->h || y < 0;
+}
+
+int ts_transform_process(struct ts_transform *t, struct ts_sample *samp,
+			 int nr)
+{
+	struct ts_clip *clip = t->clip;
+	int nread = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct ts_sample cur = samp[i];
+
+		ts_transform_apply(t, &cur.x, &cur.y, &cur.pressure);
+
+		if (t->flags & TS_TRANSFORM_CLIP) {
+			/* drop, except pen up after a sample we let through */
+			if (ts_clip_outside(clip, cur.x, cur.y) &&
+			    (cur.pressure != 0 || clip->last_pressure == 0))
+				continue;
+
+			clip->last_pressure = cur.pressure;
+		}
+
+		samp[nread++] = cur;
+	}
+
+	return nread;
+}
+
+int ts_transform_process_mt(struct ts_transform *t,
+			    struct ts_sample_mt **samp, int max_slots, int nr)
+{
+	struct ts_clip *clip = t->clip;
+	int32_t *last_tid;
+	int i, j;
+
+	if ((t->flags & TS_TRANSFORM_CLIP) &&
+	    (!clip->last_tid || max_slots > clip->slots)) {
+		last_tid = realloc(clip->last_tid, max_slots * sizeof(int32_t));
+		if (!last_tid)
+			return -ENOMEM;
+
+		/* -1, so that a first touch out of range gets dropped */
+		for (j = clip->slots; j < max_slots; j++)
+			last_tid[j] = -1;
+
+		clip->last_tid = last_tid;
+		clip->slots = max_slots;
+	}
+
+	for (i = 0; i < nr; i++) {
+		for (j = 0; j < max_slots; j++) {
+			struct ts_sample_mt *s = &samp[i][j];
+
+			if (!(s->valid & TSLIB_MT_VALID))
+				continue;
+
+			ts_transform_apply(t, &s->x, &s->y, &s->pressure);
+
+			if (!(t->flags & TS_TRANSFORM_CLIP))
+				continue;
+
+			/*
+			 * drop, except a lifted contact that was let through
+			 * before. Otherwise the app would never see the
+			 * release.
+			 */
+			if (ts_clip_outside(clip, s->x, s->y) &&
+			    (s->tracking_id != -1 || clip->last_tid[j] == -1))
+				s->valid &= ~TSLIB_MT_VALID;
+
+			if (s->valid & TSLIB_MT_VALID)
+				clip->last_tid[j] = s->tracking_id;
+		}
+	}
+
+	return nr;
+}
+
+/*
+ * A stage of the filter chain that runs the transforms of several
+ * modules at once. It is not in ts->list, only in ts->chain.
+ */
+struct ts_fused {
+	struct tslib_module_info module;
+	struct ts_transform t;
+	unsigned int res_x;
+	unsigned int res_y;
+	int nr;
+	/* in the order they would run */
+	struct tslib_module_info **stage;
+};
+
+static void ts_fused_update(struct ts_fused *f)
+{
+	int i;
+
+	ts_transform_init(&f->t);
+	for (i = 0; i < f->nr; i++)
+		ts_transform_append(&f->t,
+				    f->stage[i]->ops->transform(f->stage[i]));
+
+	f->res_x = f->module.dev->res_x;
+	f->res_y = f->module.dev->res_y;
+}
+
+static int ts_fused_process(struct tslib_module_info *info,
+			    struct ts_sample *samp, int nr,
+			    __attribute__ ((unused)) int max)
+{
+	struct ts_fused *f = (struct ts_fused *)info;
+
+	if (info->dev->res_x != f->res_x || info->dev->res_y != f->res_y)
+		ts_fused_update(f);
+
+	return ts_transform_process(&f->t, samp, nr);
+}
+
+static int ts_fused_process_mt(struct tslib_module_info *info,
+			       struct ts_sample_mt **samp, int max_slots,
+			       int nr, __attribute__ ((unused)) int max)
+{
+	struct ts_fused *f = (struct ts_fused *)info;
+
+	if (info->dev->res_x != f->res_x || info->dev->res_y != f->res_y)
+		ts_fused_update(f);
+
+	return ts_transform_process_mt(&f->t, samp, max_slots, nr);
+}
+
+static int ts_fused_fini(struct tslib_module_info *info)
+{
+	struct ts_fused *f = (struct ts_fused *)info;
+
+	free(f->stage);
+	free(f);
+
+	return 0;
+}
+
+static const struct tslib_ops ts_fused_ops = {
+	.process	= ts_fused_process,
+	.process_mt	= ts_fused_process_mt,
+	.fini		= ts_fused_fini,
+};
+
+/* one stage for chain[top] to chain[bottom], bottom running first */
+static struct tslib_module_info *ts_fused_new(struct tsdev *ts,
+					      struct tslib_module_info **chain,
+					      int top, int bottom)
+{
+	struct ts_fused *f;
+	int i;
+
+	f = calloc(1, sizeof(*f));
+	if (!f)
+		return NULL;
+
+	f->nr = bottom - top + 1;
+	f->stage = malloc(f->nr * sizeof(*f->stage));
+	if (!f->stage) {
+		free(f);
+		return NULL;
+	}
+
+	for (i = 0; i < f->nr; i++)
+		f->stage[i] = chain[bottom - i];
+
+	f->module.dev = ts;
+	f->module.ops = &ts_fused_ops;
+	ts_fused_update(f);
+
+	return &f->module;
+}
+
+static void ts_fused_free(struct tslib_module_info **chain)
+{
+	int i;
+
+	for (i = 0; chain[i]; i++) {
+		if (chain[i]->ops == &ts_fused_ops)
+			ts_fused_fini(chain[i]);
+	}
+}
+
+/*
+ * Replace adjacent modules in ts->chain that have a transform by one
+ * stage doing all of it. Only the part of the chain we run ourselves,
+ * the modules with process(), is looked at.
+ */
+int __ts_transform_fuse(struct tsdev *ts)
+{
+	struct tslib_module_info **chain = ts->chain;
+	struct tslib_module_info **out;
+	struct tslib_module_info *fused;
+	struct ts_transform t;
+	int n, len;
+	int pos;
+	int i, j;
+
+	for (n = 0; chain[n]; n++)
+		;
+
+	for (len = 0; chain[len] && chain[len]->ops->process; len++)
+		;
+
+	out = malloc((n + 1) * sizeof(*out));
+	if (!out)
+		return -ENOMEM;
+
+	/* fill from the bottom up, that's the order samples go through */
+	pos = n;
+	out[pos] = NULL;
+	for (i = n - 1; i >= len; i--)
+		out[--pos] = chain[i];
+
+	while (i >= 0) {
+		if (!chain[i]->ops->transform) {
+			out[--pos] = chain[i--];
+			continue;
+		}
+
+		ts_transform_init(&t);
+		ts_transform_append(&t, chain[i]->ops->transform(chain[i]));
+		for (j = i - 1; j >= 0 && chain[j]->ops->transform; j--) {
+			if (ts_transform_append(&t,
+					chain[j]->ops->transform(chain[j])))
+				break;
+		}
+
+		if (i - j > 1) {
+			fused = ts_fused_new(ts, chain, j + 1, i);
+			if (!fused) {
+				ts_fused_free(out + pos);
+				free(out);
+				return -ENOMEM;
+			}
+			out[--pos] = fused;
+		} else {
+			out[--pos] = chain[i];
+		}
+		i = j;
+	}
+
+	memmove(out, out + pos, (n - pos + 1) * sizeof(*out));
+	free(ts->chain);
+	ts->chain = out;
+
+	return 0;
+}
+
+void __ts_transform_unfuse(struct tsdev *ts)
+{
+	if (ts->chain)
+		ts_fused_free(ts->chain);
+}
+
+/* the modules a fused stage stands for, in the order they run, or 0 */
+int __ts_transform_stages(const struct tslib_module_info *info,
+			  struct tslib_module_info *const **stage)
+{
+	const struct ts_fused *f = (const struct ts_fused *)info;
+
+	if (info->ops != &ts_fused_ops)
+		return 0;
+
+	*stage = f->stage;
+
+	return f->nr;
+}
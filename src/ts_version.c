@@ -17,16 +17,40 @@
 #include "config.h"
 #include "tslib.h"
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #define LIBTS_DATESTAMP "[unreleased]"
 
+#ifdef LIBTS_VERSION_CURRENT
+#define LIBTS_VERSION_NUM					\
+	((LIBTS_VERSION_CURRENT - LIBTS_VERSION_AGE) << 16 |	\
+	 LIBTS_VERSION_AGE << 8 | LIBTS_VERSION_REVISION)
+#else
+#define LIBTS_VERSION_NUM 0x000000
+#endif
+
 static struct ts_lib_version_data version_data = {
 	PACKAGE_VERSION,
-	0x000000,	/* version_num calculated below */
+	LIBTS_VERSION_NUM,
 	0		/* features */
 	| TSLIB_VERSION_MT
 	| TSLIB_VERSION_OPEN_RESTRICTED
 	| TSLIB_VERSION_EVENTPATH
 	| TSLIB_VERSION_VERSION
+	| TSLIB_VERSION_LATEST
+	| TSLIB_VERSION_STATS
+	| TSLIB_VERSION_SYN_DROPPED
+	| TSLIB_VERSION_CLOCK
+	| TSLIB_VERSION_TRACE
+	| TSLIB_VERSION_VIRTUAL
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_EVENTFD_H)
+	| TSLIB_VERSION_ASYNC
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+	| TSLIB_VERSION_SET
+#endif
 	,
 };
 
@@ -35,45 +59,36 @@ static struct ts_lib_version_data version_data = {
  */
 struct ts_lib_version_data *ts_libversion(void)
 {
-	static short initialized;
-	int major = 0;
-	int minor = 0;
-	int patch = 0;
-
-	if (initialized)
-		return &version_data;
-
-#ifdef LIBTS_VERSION_CURRENT
-	major = LIBTS_VERSION_CURRENT - LIBTS_VERSION_AGE;
-	minor = LIBTS_VERSION_AGE;
-	patch = LIBTS_VERSION_REVISION;
-
-	version_data.version_num |= major << 16;
-	version_data.version_num |= minor << 8;
-	version_data.version_num |= patch << 0;
-#endif
-
-	initialized = 1;
-
 	return &version_data;
 }
 
+static char version[100];
+
 /* remember our library version value is 24 bit. 8 bit per library version */
-char *tslib_version(void)
+static void tslib_version_init(void)
 {
-	static char version[100];
 	struct ts_lib_version_data *ver = ts_libversion();
-	static short initialized;
-
-	if (initialized)
-		return version;
 
 	snprintf(version, sizeof(version),
 		"tslib %s / libts ABI version %d (0x%06X)\nRelease-Date: %s\n",
 		ver->package_version, ver->version_num >> 16, ver->version_num,
 		LIBTS_DATESTAMP);
+}
 
-	initialized = 1;
+char *tslib_version(void)
+{
+#ifdef HAVE_PTHREAD_H
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, tslib_version_init);
+#else
+	static short initialized;
+
+	if (!initialized) {
+		tslib_version_init();
+		initialized = 1;
+	}
+#endif
 
 	return version;
 }
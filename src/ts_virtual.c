@@ -0,0 +1,217 @@
+/*
+ *  tslib/src/ts_virtual.c
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * A touchscreen without a device: its raw module is a queue of the frames
+ * the application pushes, for when something else reads the device, like
+ * libinput does for a compositor. The filters of ts.conf then run on them
+ * as they do on what module_raw input reads, a whole batch at a time.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tslib-private.h"
+
+#define TS_VIRTUAL_QUEUE	16
+
+struct ts_virtual {
+	struct tslib_module_info module;
+
+	/* a ring of size frames of slots samples each */
+	struct ts_sample_mt *buf;
+	int slots;
+	int size;
+	int head;
+	int count;
+};
+
+static struct ts_sample_mt *virtual_frame(struct ts_virtual *v, int i)
+{
+	return v->buf + ((v->head + i) % v->size) * v->slots;
+}
+
+static int virtual_read(struct tslib_module_info *inf, struct ts_sample *samp,
+			int nr)
+{
+	struct ts_virtual *v = (struct ts_virtual *)inf;
+	const struct ts_sample_mt *s;
+	int i = 0, j;
+
+	while (i < nr && v->count) {
+		s = virtual_frame(v, 0);
+		v->head = (v->head + 1) % v->size;
+		v->count--;
+
+		/* a single touch is the contact in the lowest slot */
+		for (j = 0; j < v->slots; j++) {
+			if (s[j].valid & TSLIB_MT_VALID)
+				break;
+		}
+		if (j == v->slots)
+			continue;
+
+		samp[i].x = s[j].x;
+		samp[i].y = s[j].y;
+		samp[i].pressure = s[j].tracking_id == -1 ? 0 : s[j].pressure;
+		samp[i].tv = s[j].tv;
+		i++;
+	}
+
+	return i ? i : -EAGAIN;
+}
+
+static int virtual_read_mt(struct tslib_module_info *inf,
+			   struct ts_sample_mt **samp, int max_slots, int nr)
+{
+	struct ts_virtual *v = (struct ts_virtual *)inf;
+	int slots = max_slots < v->slots ? max_slots : v->slots;
+	int i;
+
+	if (!v->count)
+		return -EAGAIN;
+
+	if (nr > v->count)
+		nr = v->count;
+
+	for (i = 0; i < nr; i++) {
+		memcpy(samp[i], virtual_frame(v, i), slots * sizeof(**samp));
+		if (max_slots > slots)
+			memset(samp[i] + slots, 0,
+			       (max_slots - slots) * sizeof(**samp));
+	}
+
+	v->head = (v->head + nr) % v->size;
+	v->count -= nr;
+
+	return nr;
+}
+
+/* the queue stays, ts_reconfig() attaches it again */
+static int virtual_fini(__attribute__ ((unused)) struct tslib_module_info *inf)
+{
+	return 0;
+}
+
+static const struct tslib_ops virtual_ops = {
+	.read		= virtual_read,
+	.read_mt	= virtual_read_mt,
+	.fini		= virtual_fini,
+};
+
+int __ts_virtual_attach(struct tsdev *ts)
+{
+	int ret;
+
+	ret = __ts_attach_raw(ts, &ts->virtual->module);
+	if (ret)
+		return ret;
+
+	__ts_stats_name(ts, &ts->virtual->module, "virtual");
+
+	return 0;
+}
+
+void __ts_virtual_free(struct tsdev *ts)
+{
+	free(ts->virtual->buf);
+	free(ts->virtual);
+	ts->virtual = NULL;
+}
+
+struct tsdev *ts_open_virtual(int max_slots)
+{
+	struct ts_virtual *v;
+	struct tsdev *ts;
+
+	if (max_slots <= 0)
+		return NULL;
+
+	ts = calloc(1, sizeof(struct tsdev));
+	if (!ts)
+		return NULL;
+
+	v = calloc(1, sizeof(*v));
+	if (!v) {
+		free(ts);
+		return NULL;
+	}
+
+	v->module.ops = &virtual_ops;
+	v->slots = max_slots;
+
+	ts->fd = -1;
+	ts->virtual = v;
+
+	if (__ts_virtual_attach(ts)) {
+		__ts_virtual_free(ts);
+		free(ts);
+		return NULL;
+	}
+
+	return ts;
+}
+
+static int virtual_grow(struct ts_virtual *v, int nr)
+{
+	struct ts_sample_mt *buf;
+	int size = v->size ? v->size : TS_VIRTUAL_QUEUE;
+	int i;
+
+	while (size < v->count + nr)
+		size *= 2;
+
+	buf = malloc(size * v->slots * sizeof(*buf));
+	if (!buf)
+		return -ENOMEM;
+
+	/* oldest first, from the start */
+	for (i = 0; i < v->count; i++) {
+		memcpy(buf + i * v->slots, virtual_frame(v, i),
+		       v->slots * sizeof(*buf));
+	}
+
+	free(v->buf);
+	v->buf = buf;
+	v->size = size;
+	v->head = 0;
+
+	return 0;
+}
+
+int ts_push_raw_mt(struct tsdev *ts, struct ts_sample_mt **samp, int max_slots,
+		   int nr)
+{
+	struct ts_virtual *v = ts->virtual;
+	struct ts_sample_mt *frame;
+	int slots, i, ret;
+
+	if (!v || nr < 0)
+		return -EINVAL;
+
+	if (v->count + nr > v->size) {
+		ret = virtual_grow(v, nr);
+		if (ret)
+			return ret;
+	}
+
+	slots = max_slots < v->slots ? max_slots : v->slots;
+
+	for (i = 0; i < nr; i++) {
+		frame = virtual_frame(v, v->count);
+		memcpy(frame, samp[i], slots * sizeof(*frame));
+		if (v->slots > slots)
+			memset(frame + slots, 0,
+			       (v->slots - slots) * sizeof(*frame));
+		v->count++;
+	}
+
+	return nr;
+}
@@ -17,11 +17,78 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stdint.h>
 #include <tslib.h>
 
 struct tslib_module_info;
 struct tsdev;
 
+/*
+ * Division by a divisor that only changes with the configuration, done
+ * as a multiplication by a precomputed "magic" number and shifts. The
+ * result is exactly what the division would give.
+ */
+struct ts_div {
+	uint32_t	magic;
+	uint8_t		shift;
+	uint8_t		add;
+};
+
+/* what module crop remembers about the samples it let through */
+struct ts_clip {
+	int32_t		w;
+	int32_t		h;
+	uint32_t	last_pressure;
+	int32_t		*last_tid;
+	int32_t		slots;
+};
+
+#define TS_TRANSFORM_MAP	0x1
+#define TS_TRANSFORM_DIV	0x2
+#define TS_TRANSFORM_CLIP	0x4
+
+/*
+ * The coordinate work of module invert, linear and crop. Steps are done
+ * in this order, the ones in flags only:
+ *
+ * TS_TRANSFORM_MAP:  (x, y) = m * (x, y) + off, modulo 2^32
+ * TS_TRANSFORM_DIV:  x and y divided by div (negative if div_neg) and
+ *                    rounded towards 0, multiplied by scale_x/y and
+ *                    divided by div_x/y if scale_x/y aren't 0, the
+ *                    pressure scaled, and then (x, y) = m2 * (x, y) + off2
+ * TS_TRANSFORM_CLIP: samples outside of clip->w and clip->h dropped
+ *
+ * Adjacent ones are composed into one by ts_transform_append(), see
+ * ts_transform.c.
+ */
+struct ts_transform {
+	unsigned int	flags;
+	uint32_t	m[2][2];
+	uint32_t	off[2];
+	struct ts_div	div;
+	int		div_neg;
+	uint32_t	scale_x;
+	uint32_t	scale_y;
+	struct ts_div	div_x;
+	struct ts_div	div_y;
+	uint32_t	p_offset;
+	uint32_t	p_mult;
+	struct ts_div	div_p;
+	uint32_t	m2[2][2];
+	uint32_t	off2[2];
+	struct ts_clip	*clip;
+};
+
+/* the calibration file, see tslib_get_pointercal() */
+struct tslib_pointercal {
+	int		a[7];
+	int		nr_a;		/* how many of a[] were read */
+	int		res[2];
+	int		nr_res;		/* fscanf() result for res[] */
+	int		rot;
+	int		nr_rot;		/* fscanf() result for rot */
+};
+
 struct tslib_vars {
 	const char *name;
 	void *data;
@@ -34,6 +101,26 @@ struct tslib_ops {
 	int (*read_mt)(struct tslib_module_info *inf,
 		       struct ts_sample_mt **samp, int max_slots, int nr);
 	int (*fini)(struct tslib_module_info *inf);
+	/*
+	 * Filters may implement process/process_mt instead of pulling
+	 * samples from the next module themselves. They get nr samples
+	 * (or frames) in samp, that has room for max of them, filter them
+	 * in place and return how many are left. A filter may hold samples
+	 * back and hand them out later; it is called with nr == 0 to do
+	 * that. read/read_mt should then be set to tslib_filter_read and
+	 * tslib_filter_read_mt.
+	 */
+	int (*process)(struct tslib_module_info *inf, struct ts_sample *samp,
+		       int nr, int max);
+	int (*process_mt)(struct tslib_module_info *inf,
+			  struct ts_sample_mt **samp, int max_slots,
+			  int nr, int max);
+	/*
+	 * Filters that only transform coordinates may describe what they
+	 * do instead. Adjacent ones are then run as one stage. The
+	 * description may change if the screen resolution does.
+	 */
+	const struct ts_transform *(*transform)(struct tslib_module_info *inf);
 };
 
 struct tslib_module_info {
@@ -47,10 +134,29 @@ typedef struct tslib_module_info *(*tslib_module_init)(struct tsdev *dev,
 						       const char *params);
 #define TSLIB_MODULE_INIT(f) TSAPI tslib_module_init mod_init = &f
 
+TSAPI extern int tslib_filter_read(struct tslib_module_info *inf,
+				   struct ts_sample *samp, int nr);
+TSAPI extern int tslib_filter_read_mt(struct tslib_module_info *inf,
+				      struct ts_sample_mt **samp,
+				      int max_slots, int nr);
+
 TSAPI extern int tslib_parse_vars(struct tslib_module_info *,
 			    const struct tslib_vars *, int,
 			    const char *);
 
+TSAPI extern int tslib_get_pointercal(struct tsdev *ts,
+				      const struct tslib_pointercal **pcal);
+
+TSAPI extern void ts_div_init(struct ts_div *div, uint32_t d);
+TSAPI extern void ts_transform_init(struct ts_transform *t);
+TSAPI extern int ts_transform_append(struct ts_transform *t,
+				     const struct ts_transform *next);
+TSAPI extern int ts_transform_process(struct ts_transform *t,
+				      struct ts_sample *samp, int nr);
+TSAPI extern int ts_transform_process_mt(struct ts_transform *t,
+					 struct ts_sample_mt **samp,
+					 int max_slots, int nr);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,6 +19,7 @@ extern "C" {
 
 #include "tslib.h"
 #include "tslib-filter.h"
+#include "tslib-trace.h"
 
 struct tsdev {
 	int fd;
@@ -32,10 +33,79 @@ struct tsdev {
 	unsigned int res_x;
 	unsigned int res_y;
 	int rotation;
+
+	/* cached filter chain for ts_read(), see ts_chain.c */
+	struct tslib_module_info **chain;
+	int chain_len;
+	int chain_len_mt;
+	/*
+	 * The raw module handed out samples on the last chain read. It may
+	 * hold more than poll() on fd tells: module_raw input reads ahead.
+	 */
+	int raw_more;
+
+	/* see tslib_get_pointercal() */
+	struct tslib_pointercal *pointercal;
+
+	/* reader thread, see ts_async.c */
+	struct ts_async *async;
+	int async_overflow;
+
+	/*
+	 * next display frame, see TS_VSYNC. In us, modulo 1000 seconds to be
+	 * read and written at once everywhere. 0 if not set.
+	 */
+	int vsync;
+
+	/* frames read ahead, see ts_read_latest.c */
+	struct ts_latest *latest;
+
+	/* see TS_STATS and ts_stats.c */
+	struct ts_stats *stats;
+	struct ts_module_name *names;
+
+	/* counted by the raw modules, see ts_syn_dropped() */
+	unsigned long syn_dropped;
+
+	/* of the samples' timestamps, see TS_CLOCK. Set by the raw module */
+	int clock;
+
+	/* numbers the frames, see ts_read_mt_info() */
+	unsigned long long seq;
+	unsigned long seq_syn_dropped;
+
+	/* no device, the raw module is a queue; see ts_virtual.c */
+	struct ts_virtual *virtual;
 };
 
 int __ts_attach(struct tsdev *ts, struct tslib_module_info *info);
 int __ts_attach_raw(struct tsdev *ts, struct tslib_module_info *info);
+void __ts_chain_reset(struct tsdev *ts);
+void __ts_read_latest_reset(struct tsdev *ts);
+int __ts_chain_read(struct tsdev *ts, struct ts_sample *samp, int nr);
+int __ts_chain_read_mt(struct tsdev *ts, struct ts_sample_mt **samp,
+		       int max_slots, int nr);
+int __ts_async_read_mt(struct tsdev *ts, struct ts_sample_mt **samp,
+		       struct ts_frame_info *info, int max_slots, int nr,
+		       int wait);
+void __ts_frame_info(struct tsdev *ts, const struct ts_sample_mt *frame,
+		     int max_slots, struct ts_frame_info *info);
+int __ts_transform_fuse(struct tsdev *ts);
+void __ts_transform_unfuse(struct tsdev *ts);
+int __ts_transform_stages(const struct tslib_module_info *info,
+			  struct tslib_module_info *const **stage);
+int __ts_stats_name(struct tsdev *ts, const struct tslib_module_info *info,
+		    const char *name);
+int __ts_stats_chain(struct tsdev *ts);
+int __ts_stats_enable(struct tsdev *ts, int on);
+void __ts_stats_free(struct tsdev *ts);
+uint64_t __ts_stats_now(void);
+void __ts_stats_stage(struct tsdev *ts, int i, uint64_t start, int in, int out);
+void __ts_stats_read(struct tsdev *ts, const struct ts_sample *samp, int nr);
+void __ts_stats_read_mt(struct tsdev *ts, struct ts_sample_mt **samp,
+			int max_slots, int nr);
+int __ts_virtual_attach(struct tsdev *ts);
+void __ts_virtual_free(struct tsdev *ts);
 int ts_load_module(struct tsdev *dev, const char *module, const char *params);
 int ts_load_module_raw(struct tsdev *dev, const char *module, const char *params);
 int ts_error(const char *fmt, ...);
@@ -0,0 +1,43 @@
+#ifndef _TSLIB_TRACE_H_
+#define _TSLIB_TRACE_H_
+/*
+ *  tslib/src/tslib-trace.h
+ *
+ * This file is placed under the LGPL.  Please see the file
+ * COPYING for more details.
+ *
+ * SPDX-License-Identifier: LGPL-2.1
+ *
+ *
+ * USDT probes of provider "tslib", for bpftrace, perf or SystemTap. Built
+ * with ENABLE_USDT, every probe is a single nop until a tracer attaches;
+ * without it, they're gone. Code using them has to include config.h first.
+ *
+ *   raw_event(type, code, value)	an input event was read
+ *   frame(nr, tv_sec, tv_usec)		SYN_REPORT completed frame nr, from
+ *					0, of what the raw module reads
+ *   syn_dropped()			the kernel dropped events
+ *   module_entry(ts, stage, nr)	a stage of the chain is run on nr
+ *   module_return(ts, stage, ret)	samples, and returns ret. Stage 0 is
+ *					the raw module, 1 the first filter
+ *					in ts.conf, and so on; the index of
+ *					ts_get_module_stats() has the name.
+ *   read_return(ts, ret)		ts_read() or ts_read_mt() returns
+ *   reconfig(ts)			ts_reconfig() is called
+ */
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+#define TS_TRACE0(name)			DTRACE_PROBE(tslib, name)
+#define TS_TRACE1(name, a)		DTRACE_PROBE1(tslib, name, a)
+#define TS_TRACE2(name, a, b)		DTRACE_PROBE2(tslib, name, a, b)
+#define TS_TRACE3(name, a, b, c)	DTRACE_PROBE3(tslib, name, a, b, c)
+#else
+#define TS_TRACE0(name)			do { } while (0)
+#define TS_TRACE1(name, a)		do { } while (0)
+#define TS_TRACE2(name, a, b)		do { } while (0)
+#define TS_TRACE3(name, a, b, c)	do { } while (0)
+#endif
+
+#endif /* _TSLIB_TRACE_H_ */
@@ -39,6 +39,8 @@ extern "C" {
 #endif /* TSLIB_INTERNAL */
 
 struct tsdev;
+struct ts_set;
+struct ts_trace;
 
 struct ts_sample {
 	int		x;
@@ -84,6 +86,49 @@ struct ts_sample_mt {
 #define TSLIB_MT_VALID			(1 << 0)	/* any new data */
 #define TSLIB_MT_VALID_TOOL		(1 << 1)	/* new tool_x or tool_y data */
 
+/* see ts_read_mt_info() */
+struct ts_frame_info {
+	unsigned long long	time_ns;	/* on the clock set by TS_CLOCK */
+	unsigned long long	seq;		/* skips the frames that were lost */
+};
+
+/* see ts_get_module_stats(). Samples are frames for ts_read_mt(). */
+struct ts_module_stats {
+	char			name[64];	/* "invert+linear" if fused */
+	unsigned long		calls;
+	unsigned long long	samples_in;
+	unsigned long long	samples_out;
+	unsigned long long	samples_held;	/* dropped, or handed out later */
+	unsigned long long	time_ns;
+	unsigned long long	time_max_ns;
+};
+
+/* from the kernel's timestamp to ts_read() returning the sample */
+struct ts_latency_stats {
+	unsigned long long	samples;
+	unsigned long long	latency_us;
+	unsigned long long	latency_max_us;
+};
+
+/* see ts_trace_create() */
+#define TS_TRACE_STREAM_RAW		0	/* what ts_read_raw_mt() returns */
+#define TS_TRACE_STREAM_FILTERED	1	/* what ts_read_mt() returns */
+
+struct ts_trace_axis {
+	int		minimum;
+	int		maximum;
+	int		resolution;
+};
+
+/* the device a .tstrace file was recorded from */
+struct ts_trace_info {
+	char			name[64];
+	int			max_slots;
+	struct ts_trace_axis	x;
+	struct ts_trace_axis	y;
+	struct ts_trace_axis	pressure;
+};
+
 struct ts_lib_version_data {
 	const char	*package_version;
 	int		version_num;
@@ -94,12 +139,28 @@ struct ts_lib_version_data {
 #define TSLIB_VERSION_OPEN_RESTRICTED	(1 << 1)	/* ts_open_restricted() */
 #define TSLIB_VERSION_EVENTPATH		(1 << 2)	/* ts_get_eventpath() */
 #define TSLIB_VERSION_VERSION		(1 << 3)	/* tslib_version() */
+#define TSLIB_VERSION_ASYNC		(1 << 4)	/* ts_start_async() */
+#define TSLIB_VERSION_SET		(1 << 5)	/* ts_set_create() */
+#define TSLIB_VERSION_LATEST		(1 << 6)	/* ts_read_latest() */
+#define TSLIB_VERSION_STATS		(1 << 7)	/* ts_get_module_stats() */
+#define TSLIB_VERSION_SYN_DROPPED	(1 << 8)	/* ts_syn_dropped() */
+#define TSLIB_VERSION_CLOCK		(1 << 9)	/* TS_CLOCK, ts_read_mt_info() */
+#define TSLIB_VERSION_TRACE		(1 << 10)	/* ts_trace_create() */
+#define TSLIB_VERSION_VIRTUAL		(1 << 11)	/* ts_open_virtual() */
 
 enum ts_param {
 	TS_SCREEN_RES = 0,		/* 2 integer args, x and y */
-	TS_SCREEN_ROT			/* 1 integer arg, 1 = rotate */
+	TS_SCREEN_ROT,			/* 1 integer arg, 1 = rotate */
+	TS_ASYNC_OVERFLOW,		/* 1 integer arg, see below */
+	TS_VSYNC,			/* 1 struct timeval * arg, next frame */
+	TS_STATS,			/* 1 integer arg, 1 = collect stats */
+	TS_CLOCK			/* 1 clockid_t arg, of the timestamps */
 };
 
+/* what ts_start_async() does if ts_read_mt() is too slow */
+#define TS_ASYNC_DROP_NEWEST		0
+#define TS_ASYNC_DROP_OLDEST		1
+
 struct ts_module_conf {
 	char *name;
 	char *params;
@@ -165,6 +226,19 @@ TSAPI struct tsdev *ts_open(const char *dev_name, int nonblock);
  */
 TSAPI struct tsdev *ts_setup(const char *dev_name, int nonblock);
 
+/*
+ * Open a touchscreen without a device, for frames of up to slots samples
+ * that the application reads itself and pushes. ts_config() loads the
+ * filters; the module_raw lines of ts.conf are skipped.
+ */
+TSAPI struct tsdev *ts_open_virtual(int slots);
+
+/*
+ * Queue nr frames for ts_read_mt() and ts_read_raw_mt() of a virtual
+ * touchscreen. Returns nr, or a negative error number.
+ */
+TSAPI int ts_push_raw_mt(struct tsdev *, struct ts_sample_mt **, int slots, int nr);
+
 /*
  * Return a scaled touchscreen sample.
  */
@@ -180,11 +254,115 @@ TSAPI int ts_read_raw(struct tsdev *, struct ts_sample *, int);
  */
 TSAPI int ts_read_mt(struct tsdev *, struct ts_sample_mt **, int slots, int nr);
 
+/*
+ * Like ts_read_mt(), and fills in the time and sequence number of every
+ * frame as well.
+ */
+TSAPI int ts_read_mt_info(struct tsdev *, struct ts_sample_mt **,
+			  struct ts_frame_info *info, int slots, int nr);
+
 /*
  * Return a raw, unscaled touchscreen multitouch sample.
  */
 TSAPI int ts_read_raw_mt(struct tsdev *, struct ts_sample_mt **, int slots, int nr);
 
+/*
+ * Read all multitouch samples that are pending, and return one frame with
+ * the most recent sample of every slot. Touches and releases are kept.
+ */
+TSAPI int ts_read_latest(struct tsdev *, struct ts_sample_mt *, int slots);
+
+/*
+ * Read and filter on a thread of the library. ts_read_mt() then takes
+ * the frames that are ready, without blocking in read().
+ */
+TSAPI int ts_start_async(struct tsdev *, int slots, int capacity);
+
+/*
+ * Stop the thread started by ts_start_async().
+ */
+TSAPI int ts_stop_async(struct tsdev *);
+
+/*
+ * Returns a file descriptor that is readable while ts_read_mt() has frames.
+ */
+TSAPI int ts_async_fd(struct tsdev *);
+
+/*
+ * Returns how many frames were dropped because ts_read_mt() was too slow.
+ */
+TSAPI unsigned long ts_async_dropped(struct tsdev *);
+
+/*
+ * Returns how often the kernel dropped events because we didn't read them
+ * in time. The raw module recovers from that by asking the device for its
+ * state.
+ */
+TSAPI unsigned long ts_syn_dropped(struct tsdev *);
+
+/*
+ * Create an empty set of touchscreen devices, to read from many at once.
+ */
+TSAPI struct ts_set *ts_set_create(void);
+
+/*
+ * Free a set. The devices in it are not closed.
+ */
+TSAPI void ts_set_destroy(struct ts_set *);
+
+/*
+ * Add a non-blocking device to a set, or remove it.
+ */
+TSAPI int ts_set_add(struct ts_set *, struct tsdev *);
+TSAPI int ts_set_remove(struct ts_set *, struct tsdev *);
+
+/*
+ * Returns a file descriptor that is readable while a device of the set is.
+ */
+TSAPI int ts_set_fd(struct ts_set *);
+
+/*
+ * Return multitouch samples from whichever devices of the set have them.
+ * devs[i] is set to the device samp[i] came from. Waits up to timeout
+ * milliseconds, or forever if it is negative.
+ */
+TSAPI int ts_set_read_mt(struct ts_set *, struct ts_sample_mt **samp,
+			 struct tsdev **devs, int slots, int nr, int timeout);
+
+/*
+ * Record multitouch frames to a .tstrace file, to one of two streams, like
+ * the raw and the filtered samples of the same device. Returns nr, or a
+ * negative error number.
+ */
+TSAPI struct ts_trace *ts_trace_create(const char *path,
+				       const struct ts_trace_info *info);
+TSAPI int ts_trace_write_mt(struct ts_trace *, int stream,
+			    struct ts_sample_mt **samp, int slots, int nr);
+
+/*
+ * Read the frames of one stream of a .tstrace file back, like ts_read_mt().
+ * Returns 0 at the end of the file.
+ */
+TSAPI struct ts_trace *ts_trace_open(const char *path, int stream);
+TSAPI const struct ts_trace_info *ts_trace_get_info(struct ts_trace *);
+TSAPI int ts_trace_read_mt(struct ts_trace *, struct ts_sample_mt **samp,
+			   int slots, int nr);
+TSAPI int ts_trace_rewind(struct ts_trace *);
+
+/*
+ * Finish writing a .tstrace file, or stop reading one. Returns the first
+ * error writing it, if there was one.
+ */
+TSAPI int ts_trace_close(struct ts_trace *);
+
+/*
+ * What every stage of the filter chain cost, since ts_option(ts, TS_STATS, 1).
+ * Fills up to nr of them, where the samples are read from first, and returns
+ * how many there are.
+ */
+TSAPI int ts_get_module_stats(struct tsdev *, struct ts_module_stats *stats,
+			      int nr, struct ts_latency_stats *latency);
+
 /*
  * This function returns a pointer to a static copy of the version info struct.
  */
@@ -0,0 +1,82 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0+
+#
+# Plays a recording saved here through module_raw replay and compares what
+# ts_print_mt prints with "<eventfile>.replay.expected". No uinput, no root.
+set -e
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[0;33m'
+NC='\033[0m' # No Color
+
+OPTIND=1
+
+eventfile=""
+filtername=""
+slots=10
+
+function usage() {
+	echo "Usage: $0 [-f <filtername>] [-j <slots>] -e \"<eventfile>\""
+	echo "available event files:"
+	echo "----------------------"
+	ls -1 | grep '\.events$'
+}
+
+while getopts "h?f:e:j:" opt; do
+    case "$opt" in
+    h|\?)
+	usage
+        exit 0
+        ;;
+    f)  filtername=$OPTARG
+        ;;
+    e)  eventfile=$OPTARG
+        ;;
+    j)  slots=$OPTARG
+        ;;
+    esac
+done
+
+shift $((OPTIND-1))
+
+[ "$1" = "--" ] && shift
+
+if [ -z "$eventfile" ] || [ ! -f "$eventfile" ] ; then
+	echo -e "${YELLOW}Please provide the event file to use${NC}"
+	usage
+	exit 1
+fi
+
+suffix=replay
+if [ -n "$filtername" ] ; then
+	suffix=${filtername}.replay
+fi
+
+mkdir -p result
+conf=result/replay.conf
+echo "module_raw replay speed=max" > $conf
+if [ -n "$filtername" ] ; then
+	grep -v '^module_raw' ${filtername}.conf >> $conf
+fi
+
+# the recording is read as the device, the path in ts.conf can't have spaces
+export TSLIB_CONFFILE=$(readlink -f $conf)
+export TSLIB_TSDEVICE=$(readlink -f "$eventfile")
+
+TS_PRINT_MT=${TS_PRINT_MT:-$(readlink -f ../ts_print_mt)}
+
+# it fails with ENODATA at the end of the recording
+$TS_PRINT_MT -j $slots 2> /dev/null | grep sample > "result/${eventfile}.${suffix}.result" || true
+
+if [ ! -f "${eventfile}.${suffix}.expected" ] ; then
+	echo -e "${RED}WARNING: reference file doesn't yet exist${NC}"
+	exit 1
+fi
+
+if diff "${eventfile}.${suffix}.expected" "result/${eventfile}.${suffix}.result" ; then
+	echo -e "${GREEN}${eventfile}: ok${NC}"
+else
+	echo -e "${RED}${eventfile}: differs${NC}"
+	exit 1
+fi
@@ -0,0 +1,693 @@
+/*
+ *  tslib/tests/ts_bench.c
+ *
+ * This file is part of tslib.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *
+ * Measures what every filter module, and some typical ts.conf chains, cost
+ * per sample, on synthetic input pushed into ts_open_virtual(). The streams
+ * are the same on every run, so are the results, up to the timing. They
+ * are written as JSON, and can be compared to those of an earlier run.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tslib.h"
+
+#define SLOTS		10
+#define FRAME_US	5000	/* 200 Hz */
+
+/*
+ * With glibc, we count the allocations by putting ourselves in front of
+ * malloc(); that includes the library and the modules it loads.
+ */
+#ifdef __GLIBC__
+#define BENCH_ALLOCS
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long allocs;
+
+void *malloc(size_t size)
+{
+	allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+struct bench_chain {
+	const char *name;
+	const char *conf;
+};
+
+/* from raw up, like in ts.conf */
+static const struct bench_chain chains[] = {
+	{ "none",	"" },
+	{ "pthres",	"module pthres pmin=1\n" },
+	{ "variance",	"module variance delta=30\n" },
+	{ "dejitter",	"module dejitter delta=100\n" },
+	{ "debounce",	"module debounce drop_threshold=40\n" },
+	{ "skip",	"module skip nhead=1 ntail=1\n" },
+	{ "median",	"module median depth=5\n" },
+	{ "iir",	"module iir N=6 D=10\n" },
+	{ "lowpass",	"module lowpass factor=0.1 threshold=1\n" },
+	{ "evthres",	"module evthres N=5\n" },
+	{ "invert",	"module invert x0=800 y0=480\n" },
+	{ "linear",	"module linear\n" },
+	{ "crop",	"module crop\n" },
+	{ "resample",	"module resample\n" },
+	{ "predict",	"module predict\n" },
+	{ "oneeuro",	"module oneeuro\n" },
+	{ "chain-default",
+		"module pthres pmin=1\n"
+		"module dejitter delta=100\n"
+		"module linear\n" },
+	{ "chain-smooth",
+		"module median depth=5\n"
+		"module iir N=6 D=10\n"
+		"module dejitter delta=100\n"
+		"module linear\n" },
+	{ "chain-calibrate",
+		"module invert x0=800 y0=480\n"
+		"module linear\n"
+		"module crop\n" },
+	{ "chain-latency",
+		"module oneeuro\n"
+		"module predict\n"
+		"module resample\n" },
+	{ "chain-robust",
+		"module debounce drop_threshold=40\n"
+		"module variance delta=30\n"
+		"module median depth=3\n"
+		"module lowpass\n"
+		"module linear\n"
+		"module crop\n" },
+};
+
+#define NR_CHAINS (sizeof(chains) / sizeof(chains[0]))
+
+enum bench_stream {
+	STREAM_TAP,
+	STREAM_DRAG,
+	STREAM_SWIPE10,
+	STREAM_NOISE,
+	NR_STREAMS
+};
+
+static const char *const stream_names[NR_STREAMS] = {
+	"tap", "drag", "swipe10", "noise"
+};
+
+/* xorshift32: the same numbers everywhere */
+static uint32_t rnd_state;
+
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+
+	return rnd_state;
+}
+
+/* about normally distributed, with sigma */
+static int gauss(int sigma)
+{
+	int64_t sum = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		sum += rnd() & 0xffff;
+
+	/* 4 uniforms of variance 65536^2 / 12: sigma 37837 */
+	return (int)((sum - 2 * 65535) * sigma / 37837);
+}
+
+static void touch(struct ts_sample_mt *s, int slot, int id, int x, int y,
+		  int pressure, int frame)
+{
+	s->slot = slot;
+	s->tracking_id = id;
+	s->x = x;
+	s->y = y;
+	s->pressure = pressure;
+	s->pen_down = 1;
+	s->valid = TSLIB_MT_VALID;
+	s->tv.tv_sec = 1000 + frame / (1000000 / FRAME_US);
+	s->tv.tv_usec = (frame % (1000000 / FRAME_US)) * FRAME_US;
+}
+
+/* where the finger was in the previous frame */
+static void release(struct ts_sample_mt *s, int slot, int frame)
+{
+	const struct ts_sample_mt *prev = s - SLOTS;
+
+	touch(s, slot, -1, prev->x, prev->y, 0, frame);
+	s->pen_down = 0;
+}
+
+static void generate(struct ts_sample_mt *buf, int nr, enum bench_stream st)
+{
+	struct ts_sample_mt *f;
+	int i, j, k, x, y, id = 0;
+
+	rnd_state = 2463534242u + st;
+	memset(buf, 0, nr * SLOTS * sizeof(*buf));
+
+	for (i = 0; i < nr; i++) {
+		f = buf + i * SLOTS;
+
+		switch (st) {
+		case STREAM_TAP:
+			/* 8 frames down, 1 up */
+			k = i % 9;
+			if (k == 0)
+				id++;
+			if (k == 8) {
+				release(&f[0], 0, i);
+				break;
+			}
+			x = 100 + (id * 97) % 600;
+			y = 80 + (id * 61) % 320;
+			touch(&f[0], 0, id, x + gauss(2), y + gauss(2),
+			      200 + gauss(10), i);
+			break;
+
+		case STREAM_DRAG:
+			/* lifted every 500 frames */
+			k = i % 500;
+			if (k == 0)
+				id++;
+			if (k == 499) {
+				release(&f[0], 0, i);
+				break;
+			}
+			x = 200 + k + gauss(1);
+			y = 100 + k / 2 + gauss(1);
+			touch(&f[0], 0, id, x, y, 180 + gauss(8), i);
+			break;
+
+		case STREAM_SWIPE10:
+			/* all fingers go right for 60 frames, then lift */
+			k = i % 61;
+			for (j = 0; j < SLOTS; j++) {
+				if (k == 60) {
+					release(&f[j], j, i);
+					continue;
+				}
+				if (k == 0)
+					id++;
+				touch(&f[j], j, id, 50 + k * 10 + gauss(2),
+				      40 + j * 40 + gauss(2), 150 + gauss(10),
+				      i);
+			}
+			break;
+
+		case STREAM_NOISE:
+			/* a still finger, jittery bursts, and spikes */
+			k = i % 1000;
+			if (k == 0)
+				id++;
+			if (k == 999) {
+				release(&f[0], 0, i);
+				break;
+			}
+			x = 300 + gauss(i % 50 < 5 ? 40 : 3);
+			y = 200 + gauss(i % 50 < 5 ? 40 : 3);
+			if (i % 97 == 0)
+				x += 300;
+			touch(&f[0], 0, id, x, y, 120 + gauss(30), i);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct bench_result {
+	double ns_per_sample;
+	unsigned long allocs;
+	unsigned long samples_out;
+};
+
+static struct tsdev *bench_open(const char *conffile, const char *conf)
+{
+	struct tsdev *ts;
+	FILE *f;
+
+	f = fopen(conffile, "w");
+	if (!f)
+		return NULL;
+	fputs(conf, f);
+	fclose(f);
+
+	ts = ts_open_virtual(SLOTS);
+	if (!ts)
+		return NULL;
+
+	if (ts_config(ts)) {
+		ts_close(ts);
+		return NULL;
+	}
+
+	return ts;
+}
+
+/* run nr frames through in batches, the best of repeat runs */
+static int bench_run(const char *conffile, const struct bench_chain *c,
+		     struct ts_sample_mt **in, int nr, int batch, int repeat,
+		     int mt, struct bench_result *res)
+{
+	struct ts_sample_mt **out_mt;
+	struct ts_sample *out;
+	struct tsdev *ts;
+	uint64_t start, t, best = UINT64_MAX;
+	unsigned long a, samples;
+	int i, n, r, ret = 0;
+
+	out = calloc(batch, sizeof(*out));
+	out_mt = calloc(batch, sizeof(*out_mt));
+	if (!out || !out_mt) {
+		free(out);
+		free(out_mt);
+		return -ENOMEM;
+	}
+	for (i = 0; i < batch; i++) {
+		out_mt[i] = calloc(SLOTS, sizeof(**out_mt));
+		if (!out_mt[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (r = 0; r < repeat; r++) {
+		/* the same state every run */
+		ts = bench_open(conffile, c->conf);
+		if (!ts) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		samples = 0;
+	#ifdef BENCH_ALLOCS
+		a = allocs;
+	#else
+		a = 0;
+	#endif
+		start = now_ns();
+
+		for (i = 0; i < nr; i += batch) {
+			n = nr - i < batch ? nr - i : batch;
+			ts_push_raw_mt(ts, in + i, SLOTS, n);
+
+			do {
+				if (mt)
+					ret = ts_read_mt(ts, out_mt, SLOTS, batch);
+				else
+					ret = ts_read(ts, out, batch);
+				if (ret > 0)
+					samples += ret;
+			} while (ret > 0);
+		}
+
+		t = now_ns() - start;
+	#ifdef BENCH_ALLOCS
+		a = allocs - a;
+	#endif
+		ts_close(ts);
+
+		if (ret < 0 && ret != -EAGAIN)
+			goto out;
+		ret = 0;
+
+		if (t < best)
+			best = t;
+		res->allocs = a;
+		res->samples_out = samples;
+	}
+
+	res->ns_per_sample = (double)best / nr;
+
+out:
+	for (i = 0; i < batch; i++)
+		free(out_mt[i]);
+	free(out_mt);
+	free(out);
+
+	return ret;
+}
+
+struct bench_baseline {
+	char name[64];
+	char stream[16];
+	char mode[8];
+	double ns_per_sample;
+	unsigned long allocs;
+};
+
+/* the results of an earlier run, one per line as we write them */
+static int read_baseline(const char *path, struct bench_baseline **base)
+{
+	struct bench_baseline b, *tmp;
+	char line[512];
+	int nr = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+
+	*base = NULL;
+	while (fgets(line, sizeof(line), f)) {
+		b.allocs = 0;
+		if (sscanf(line,
+			   " {\"name\": \"%63[^\"]\", \"stream\": \"%15[^\"]\", \"mode\": \"%7[^\"]\", \"ns_per_sample\": %lf, \"allocs\": %lu",
+			   b.name, b.stream, b.mode, &b.ns_per_sample,
+			   &b.allocs) < 4)
+			continue;
+
+		tmp = realloc(*base, (nr + 1) * sizeof(**base));
+		if (!tmp) {
+			fclose(f);
+			return -ENOMEM;
+		}
+		*base = tmp;
+		(*base)[nr++] = b;
+	}
+
+	fclose(f);
+
+	return nr;
+}
+
+static const struct bench_baseline *find_baseline(const struct bench_baseline *base,
+						  int nr, const char *name,
+						  const char *stream,
+						  const char *mode)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (strcmp(base[i].name, name) == 0 &&
+		    strcmp(base[i].stream, stream) == 0 &&
+		    strcmp(base[i].mode, mode) == 0)
+			return &base[i];
+	}
+
+	return NULL;
+}
+
+static void usage(char **argv)
+{
+	ts_print_ascii_logo(16);
+	printf("%s", tslib_version());
+	printf("\n");
+	printf("Usage: %s [-n <frames>] [-b <batch>] [-r <repeat>] [-o <file>]\n"
+	       "                [-c <baseline> [-t <percent>]] [-f <name>]\n",
+		argv[0]);
+	printf("\n");
+	printf("-n --frames\n");
+	printf("                frames per stream, default 20000\n");
+	printf("-b --batch\n");
+	printf("                frames pushed and read at once, default 64\n");
+	printf("-r --repeat\n");
+	printf("                runs to take the fastest of, default 3\n");
+	printf("-o --output\n");
+	printf("                write the JSON results to a file, not stdout\n");
+	printf("-c --compare\n");
+	printf("                compare with the results of an earlier run,\n");
+	printf("                and fail if anything got slower or allocates\n");
+	printf("                more\n");
+	printf("-t --threshold\n");
+	printf("                percent slower that is a regression, default 10\n");
+	printf("-f --filter\n");
+	printf("                only benchmark what has this in its name\n");
+	printf("-h --help\n");
+	printf("                print this help text\n");
+	printf("-v --version\n");
+	printf("                print version information only\n");
+	printf("\n");
+	printf("The modules are loaded from TSLIB_PLUGINDIR.\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct ts_sample_mt *buf, **in;
+	struct bench_baseline *base = NULL;
+	const struct bench_baseline *b;
+	struct bench_result res = { 0, 0, 0 };
+	char conffile[] = "/tmp/ts_bench.XXXXXX";
+	char calibfile[] = "/tmp/ts_bench_cal.XXXXXX";
+	const char *output = NULL, *compare = NULL, *filter = NULL;
+	double threshold = 10;
+	int nr = 20000, batch = 64, repeat = 3;
+	int nr_base = 0, regressions = 0, first = 1;
+	int fd, i, st, mt, ret = 0;
+	unsigned int c;
+	FILE *out = stdout;
+
+	while (1) {
+		const struct option long_options[] = {
+			{ "help",         no_argument,       NULL, 'h' },
+			{ "frames",       required_argument, NULL, 'n' },
+			{ "batch",        required_argument, NULL, 'b' },
+			{ "repeat",       required_argument, NULL, 'r' },
+			{ "output",       required_argument, NULL, 'o' },
+			{ "compare",      required_argument, NULL, 'c' },
+			{ "threshold",    required_argument, NULL, 't' },
+			{ "filter",       required_argument, NULL, 'f' },
+			{ "version",      no_argument,       NULL, 'v' },
+		};
+
+		int option_index = 0;
+		int opt = getopt_long(argc, argv, "hn:b:r:o:c:t:f:v", long_options, &option_index);
+
+		if (opt == -1)
+			break;
+
+		switch (opt) {
+		case 'h':
+			usage(argv);
+			return 0;
+
+		case 'v':
+			printf("%s\n", tslib_version());
+			return 0;
+
+		case 'n':
+			nr = atoi(optarg);
+			break;
+
+		case 'b':
+			batch = atoi(optarg);
+			break;
+
+		case 'r':
+			repeat = atoi(optarg);
+			break;
+
+		case 'o':
+			output = optarg;
+			break;
+
+		case 'c':
+			compare = optarg;
+			break;
+
+		case 't':
+			threshold = atof(optarg);
+			break;
+
+		case 'f':
+			filter = optarg;
+			break;
+
+		default:
+			usage(argv);
+			return 1;
+		}
+	}
+
+	if (nr <= 0 || batch <= 0 || repeat <= 0 || threshold < 0) {
+		usage(argv);
+		return 1;
+	}
+
+	if (compare) {
+		nr_base = read_baseline(compare, &base);
+		if (nr_base < 0) {
+			fprintf(stderr, "ts_bench: %s: %s\n", compare,
+				strerror(-nr_base));
+			return 1;
+		}
+	}
+
+	buf = malloc((size_t)nr * SLOTS * sizeof(*buf));
+	in = malloc(nr * sizeof(*in));
+	if (!buf || !in) {
+		perror("ts_bench");
+		return 1;
+	}
+	for (i = 0; i < nr; i++)
+		in[i] = buf + i * SLOTS;
+
+	/* the modules read their ts.conf lines from here */
+	fd = mkstemp(conffile);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+	setenv("TSLIB_CONFFILE", conffile, 1);
+
+	/* linear and crop get an 800x480 screen, scaled from 1000x600 */
+	if (!getenv("TSLIB_CALIBFILE")) {
+		const char *pointercal = "52429 0 0 0 52429 0 65536 800 480 0\n";
+
+		fd = mkstemp(calibfile);
+		if (fd < 0) {
+			perror("mkstemp");
+			unlink(conffile);
+			return 1;
+		}
+		if (write(fd, pointercal, strlen(pointercal)) < 0)
+			perror("write");
+		close(fd);
+		setenv("TSLIB_CALIBFILE", calibfile, 1);
+	} else {
+		calibfile[0] = '\0';
+	}
+
+	if (output) {
+		out = fopen(output, "w");
+		if (!out) {
+			perror(output);
+			ret = 1;
+			goto cleanup;
+		}
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"tslib\": \"%s\",\n", ts_libversion()->package_version);
+	fprintf(out, "  \"frames\": %d,\n", nr);
+	fprintf(out, "  \"batch\": %d,\n", batch);
+	fprintf(out, "  \"repeat\": %d,\n", repeat);
+#ifdef BENCH_ALLOCS
+	fprintf(out, "  \"allocs\": true,\n");
+#else
+	fprintf(out, "  \"allocs\": false,\n");
+#endif
+	fprintf(out, "  \"results\": [\n");
+
+	for (st = 0; st < NR_STREAMS; st++) {
+		generate(buf, nr, st);
+
+		for (c = 0; c < NR_CHAINS; c++) {
+			if (filter && !strstr(chains[c].name, filter))
+				continue;
+
+			for (mt = 1; mt >= 0; mt--) {
+				const char *mode = mt ? "mt" : "single";
+
+				/* ts_read() only sees the first finger */
+				if (!mt && st == STREAM_SWIPE10)
+					continue;
+
+				if (bench_run(conffile, &chains[c], in, nr,
+					      batch, repeat, mt, &res)) {
+					fprintf(stderr,
+						"ts_bench: %s: can't run, is TSLIB_PLUGINDIR set?\n",
+						chains[c].name);
+					continue;
+				}
+
+				fprintf(out, "%s    {\"name\": \"%s\", \"stream\": \"%s\", \"mode\": \"%s\", \"ns_per_sample\": %.1f, \"allocs\": %lu, \"samples_out\": %lu}",
+					first ? "" : ",\n", chains[c].name,
+					stream_names[st], mode,
+					res.ns_per_sample, res.allocs,
+					res.samples_out);
+				first = 0;
+
+				if (!compare)
+					continue;
+
+				b = find_baseline(base, nr_base, chains[c].name,
+						  stream_names[st], mode);
+				if (!b)
+					continue;
+
+				if (res.ns_per_sample >
+				    b->ns_per_sample * (1 + threshold / 100)) {
+					fprintf(stderr,
+						"ts_bench: %s %s %s: %.1f ns per sample, was %.1f (%+.0f%%)\n",
+						chains[c].name, stream_names[st],
+						mode, res.ns_per_sample,
+						b->ns_per_sample,
+						(res.ns_per_sample / b->ns_per_sample - 1) * 100);
+					regressions++;
+				}
+			#ifdef BENCH_ALLOCS
+				if (res.allocs > b->allocs) {
+					fprintf(stderr,
+						"ts_bench: %s %s %s: %lu allocations, was %lu\n",
+						chains[c].name, stream_names[st],
+						mode, res.allocs, b->allocs);
+					regressions++;
+				}
+			#endif
+			}
+		}
+	}
+
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout)
+		fclose(out);
+
+	if (regressions) {
+		fprintf(stderr, "ts_bench: %d regressions against %s\n",
+			regressions, compare);
+		ret = 1;
+	}
+
+cleanup:
+	unlink(conffile);
+	if (calibfile[0])
+		unlink(calibfile);
+	free(base);
+	free(in);
+	free(buf);
+
+	return ret;
+}
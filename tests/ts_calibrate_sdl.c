@@ -87,26 +87,20 @@ static void get_sample(struct tsdev *ts, calibration *cal,
 static void clearbuf(struct tsdev *ts)
 {
 	int fd = ts_fd(ts);
-	fd_set fdset;
-	struct timeval tv;
-	int nfds;
+	int flags = fcntl(fd, F_GETFL);
 	struct ts_sample sample;
+	int ret;
 
-	while (1) {
-		FD_ZERO(&fdset);
-		FD_SET(fd, &fdset);
-
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
+	/* libts reads ahead of the device, so empty it, not the device */
+	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	do {
+		ret = ts_read_raw(ts, &sample, 1);
+	} while (ret > 0);
+	fcntl(fd, F_SETFL, flags);
 
-		nfds = select(fd + 1, &fdset, NULL, NULL, &tv);
-		if (nfds == 0)
-			break;
-
-		if (ts_read_raw(ts, &sample, 1) < 0) {
-			perror("ts_read");
-			exit(1);
-		}
+	if (ret < 0 && ret != -EAGAIN && errno != EAGAIN) {
+		perror("ts_read");
+		exit(1);
 	}
 }
 
@@ -192,13 +192,16 @@ int main(int argc, char **argv)
 	       ver->version_num, ts_get_eventpath(ts));
 
 #ifdef TS_HAVE_EVDEV
+	/* with -j, the device doesn't have to be one, like for module_raw replay */
 	if (ioctl(ts_fd(ts), EVIOCGABS(ABS_MT_SLOT), &slot) < 0) {
-		perror("ioctl EVIOGABS");
-		ts_close(ts);
-		return errno;
+		if (user_slots <= 0) {
+			perror("ioctl EVIOGABS");
+			ts_close(ts);
+			return errno;
+		}
+	} else {
+		max_slots = slot.maximum + 1 - slot.minimum;
 	}
-
-	max_slots = slot.maximum + 1 - slot.minimum;
 #endif
 	if (user_slots > 0)
 		max_slots = user_slots;
@@ -0,0 +1,342 @@
+/*
+ *  tslib/tests/ts_record.c
+ *
+ * This file is part of tslib.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *
+ * Records what the touchscreen delivers, before and after the filters,
+ * to a .tstrace file, until interrupted.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <getopt.h>
+#include <errno.h>
+#include <unistd.h>
+
+#if defined (__FreeBSD__)
+
+#include <dev/evdev/input.h>
+#define TS_HAVE_EVDEV
+
+#elif defined (__linux__)
+
+#include <linux/input.h>
+#define TS_HAVE_EVDEV
+
+#endif
+
+#ifdef TS_HAVE_EVDEV
+#include <sys/ioctl.h>
+#endif
+
+#include "tslib.h"
+
+#ifndef ABS_MT_SLOT /* < 2.6.36 kernel headers */
+# define ABS_MT_SLOT             0x2f    /* MT slot being modified */
+#endif
+
+#define READ_SAMPLES	16
+
+static volatile sig_atomic_t stop;
+
+static void sig(int sig __attribute__((unused)))
+{
+	stop = 1;
+}
+
+static void usage(char **argv)
+{
+	ts_print_ascii_logo(16);
+	printf("%s", tslib_version());
+	printf("\n");
+	printf("Usage: %s [--raw | --filtered] [-i <device>] -o <file.tstrace>\n",
+		argv[0]);
+	printf("\n");
+	printf("-o --output\n");
+	printf("                the file to record to\n");
+	printf("-r --raw\n");
+	printf("                only record what module_raw delivers\n");
+	printf("-f --filtered\n");
+	printf("                only record what the filters deliver\n");
+	printf("-i --idev\n");
+	printf("                explicitly choose the touch input device\n");
+	printf("                overriding TSLIB_TSDEVICE\n");
+	printf("-j --slots\n");
+	printf("                set the number of concurrently available touch\n");
+	printf("                points. This overrides multitouch slots for\n");
+	printf("                testing purposes.\n");
+	printf("-h --help\n");
+	printf("                print this help text\n");
+	printf("-v --version\n");
+	printf("                print version information only\n");
+}
+
+static int errfn(const char *fmt, va_list ap)
+{
+	return vfprintf(stderr, fmt, ap);
+}
+
+static int openfn(const char *path, int flags,
+		  void *user_data __attribute__((unused)))
+{
+	return open(path, flags);
+}
+
+#ifdef TS_HAVE_EVDEV
+static void get_axis(int fd, int code, int fallback,
+		     struct ts_trace_axis *axis)
+{
+	struct input_absinfo abs;
+
+	if (ioctl(fd, EVIOCGABS(code), &abs) < 0 &&
+	    ioctl(fd, EVIOCGABS(fallback), &abs) < 0)
+		return;
+
+	axis->minimum = abs.minimum;
+	axis->maximum = abs.maximum;
+	axis->resolution = abs.resolution;
+}
+#endif
+
+/* read until -EAGAIN, see ts_read(3), and record it */
+static int record(struct tsdev *ts, struct ts_trace *trace, int stream,
+		  struct ts_sample_mt **samp, int max_slots,
+		  unsigned long *frames)
+{
+	int ret;
+
+	while (1) {
+		if (stream == TS_TRACE_STREAM_RAW)
+			ret = ts_read_raw_mt(ts, samp, max_slots, READ_SAMPLES);
+		else
+			ret = ts_read_mt(ts, samp, max_slots, READ_SAMPLES);
+
+		if (ret == -EAGAIN)
+			return 0;
+		if (ret < 0)
+			return ret;
+		/* the filters took it all, there may be more read ahead */
+		if (ret == 0)
+			continue;
+
+		ret = ts_trace_write_mt(trace, stream, samp, max_slots, ret);
+		if (ret < 0)
+			return ret;
+
+		*frames += ret;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct tsdev *ts[2] = { NULL, NULL };
+	struct ts_trace *trace;
+	struct ts_trace_info info;
+	struct ts_sample_mt **samp_mt = NULL;
+	struct pollfd pfd[2];
+	struct sigaction sa;
+#ifdef TS_HAVE_EVDEV
+	struct input_absinfo slot;
+#endif
+	char *tsdevice = NULL;
+	char *output = NULL;
+	int32_t user_slots = 0;
+	int32_t max_slots = 1;
+	unsigned long frames[2] = { 0, 0 };
+	int record_stream[2] = { 1, 1 };
+	int ret = 0, i, n;
+	struct ts_lib_version_data *ver = ts_libversion();
+
+	while (1) {
+		const struct option long_options[] = {
+			{ "help",         no_argument,       NULL, 'h' },
+			{ "idev",         required_argument, NULL, 'i' },
+			{ "output",       required_argument, NULL, 'o' },
+			{ "raw",          no_argument,       NULL, 'r' },
+			{ "filtered",     no_argument,       NULL, 'f' },
+			{ "slots",        required_argument, NULL, 'j' },
+			{ "version",      no_argument,       NULL, 'v' },
+		};
+
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "hvi:o:rfj:", long_options, &option_index);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'h':
+			usage(argv);
+			return 0;
+
+		case 'v':
+			printf("%s\n", tslib_version());
+			return 0;
+
+		case 'i':
+			tsdevice = optarg;
+			break;
+
+		case 'o':
+			output = optarg;
+			break;
+
+		case 'r':
+			record_stream[TS_TRACE_STREAM_FILTERED] = 0;
+			break;
+
+		case 'f':
+			record_stream[TS_TRACE_STREAM_RAW] = 0;
+			break;
+
+		case 'j':
+			user_slots = atoi(optarg);
+			if (user_slots <= 0) {
+				usage(argv);
+				return 0;
+			}
+			break;
+
+		default:
+			usage(argv);
+			return 0;
+		}
+	}
+
+	if (!output || (!record_stream[0] && !record_stream[1])) {
+		usage(argv);
+		return 0;
+	}
+
+	ts_error_fn = errfn;
+	ts_open_restricted = openfn;
+
+	/*
+	 * Once for each stream: the filters keep state, so what ts_read_raw_mt()
+	 * takes away from ts_read_mt() would be missing from its stream.
+	 */
+	for (i = 0; i < 2; i++) {
+		if (!record_stream[i])
+			continue;
+
+		ts[i] = ts_setup(tsdevice, 1);
+		if (!ts[i]) {
+			perror("ts_setup");
+			ret = errno;
+			goto out;
+		}
+	}
+	n = ts[0] ? 0 : 1;
+
+	printf("libts %06X opened device %s\n",
+	       ver->version_num, ts_get_eventpath(ts[n]));
+
+	memset(&info, 0, sizeof(info));
+#ifdef TS_HAVE_EVDEV
+	if (ioctl(ts_fd(ts[n]), EVIOCGNAME(sizeof(info.name) - 1), info.name) < 0)
+		info.name[0] = '\0';
+
+	if (ioctl(ts_fd(ts[n]), EVIOCGABS(ABS_MT_SLOT), &slot) == 0)
+		max_slots = slot.maximum + 1 - slot.minimum;
+
+	get_axis(ts_fd(ts[n]), ABS_MT_POSITION_X, ABS_X, &info.x);
+	get_axis(ts_fd(ts[n]), ABS_MT_POSITION_Y, ABS_Y, &info.y);
+	get_axis(ts_fd(ts[n]), ABS_MT_PRESSURE, ABS_PRESSURE, &info.pressure);
+#endif
+	if (user_slots > 0)
+		max_slots = user_slots;
+	info.max_slots = max_slots;
+
+	samp_mt = calloc(READ_SAMPLES, sizeof(struct ts_sample_mt *));
+	if (!samp_mt) {
+		ret = ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < READ_SAMPLES; i++) {
+		samp_mt[i] = calloc(max_slots, sizeof(struct ts_sample_mt));
+		if (!samp_mt[i]) {
+			ret = ENOMEM;
+			goto out;
+		}
+	}
+
+	trace = ts_trace_create(output, &info);
+	if (!trace) {
+		perror(output);
+		ret = errno;
+		goto out;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	printf("recording to %s, stop with Ctrl-C\n", output);
+
+	while (!stop) {
+		for (i = 0; i < 2; i++) {
+			pfd[i].fd = record_stream[i] ? ts_fd(ts[i]) : -1;
+			pfd[i].events = POLLIN;
+			pfd[i].revents = 0;
+		}
+
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			ret = errno;
+			break;
+		}
+
+		for (i = 0; i < 2; i++) {
+			if (!(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			n = record(ts[i], trace, i, samp_mt, max_slots,
+				   &frames[i]);
+			/* a recording that module_raw replay plays ended */
+			if (n == -ENODATA) {
+				record_stream[i] = 0;
+				if (!record_stream[0] && !record_stream[1])
+					stop = 1;
+				continue;
+			}
+			if (n < 0) {
+				fprintf(stderr, "ts_record: %s\n", strerror(-n));
+				ret = -n;
+				stop = 1;
+				break;
+			}
+		}
+	}
+
+	n = ts_trace_close(trace);
+	if (n < 0) {
+		fprintf(stderr, "ts_record: %s: %s\n", output, strerror(-n));
+		ret = -n;
+	}
+
+	printf("\n%lu raw, %lu filtered frames recorded\n",
+	       frames[TS_TRACE_STREAM_RAW], frames[TS_TRACE_STREAM_FILTERED]);
+
+out:
+	if (samp_mt) {
+		for (i = 0; i < READ_SAMPLES; i++)
+			free(samp_mt[i]);
+		free(samp_mt);
+	}
+	for (i = 0; i < 2; i++) {
+		if (ts[i])
+			ts_close(ts[i]);
+	}
+
+	return ret;
+}
@@ -18,6 +18,7 @@
 #include <getopt.h>
 #include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #if defined (__FreeBSD__)
 
@@ -274,6 +275,77 @@ static int ts_load_module_4_inv(struct ts_verify *data)
 	return ret;
 }
 
+/* TEST ts_setup and ts_read_mt on distinct devices from distinct threads */
+#define NR_THREADS	4
+
+struct ts_verify_thread {
+	pthread_t thread;
+	char *tsdevice;
+	int ret;
+};
+
+static void *ts_verify_thread_fn(void *arg)
+{
+	struct ts_verify_thread *t = arg;
+	struct ts_sample_mt *samp_mt[5];
+	struct tsdev *ts;
+	int i;
+
+	t->ret = -ENOMEM;
+	for (i = 0; i < 5; i++)
+		samp_mt[i] = NULL;
+
+	ts = ts_setup(t->tsdevice, 0);
+	if (!ts) {
+		t->ret = -errno;
+		return NULL;
+	}
+
+	for (i = 0; i < 5; i++) {
+		samp_mt[i] = calloc(16, sizeof(struct ts_sample_mt));
+		if (!samp_mt[i])
+			goto out;
+	}
+
+	t->ret = ts_reconfig(ts);
+	if (t->ret == 0)
+		t->ret = ts_read_mt(ts, samp_mt, 16, 5);
+
+out:
+	for (i = 0; i < 5; i++)
+		free(samp_mt[i]);
+	ts_close(ts);
+
+	return NULL;
+}
+
+static int ts_verify_threads_1(struct ts_verify *data)
+{
+	struct ts_verify_thread t[NR_THREADS];
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < NR_THREADS; i++) {
+		t[i].tsdevice = data->tsdevice;
+		t[i].ret = -ESRCH;
+		if (pthread_create(&t[i].thread, NULL, ts_verify_thread_fn,
+				   &t[i]) != 0) {
+			ret = -1;
+			break;
+		}
+	}
+
+	while (i--) {
+		pthread_join(t[i].thread, NULL);
+		if (data->verbose)
+			printf("thread %d ret: %d\n", i, t[i].ret);
+		if (t[i].ret <= 0)
+			ret = -1;
+	}
+
+	return ret;
+}
+
 static void run_tests(struct ts_verify *data)
 {
 	int32_t ret;
@@ -416,6 +488,13 @@ static void run_tests(struct ts_verify *data)
 		printf("TEST ts_reconfig (1)               ......   " RED "FAIL" RESET "\n");
 	}
 
+	ret = ts_verify_threads_1(data);
+	if (ret == 0) {
+		printf("TEST ts_read_mt (threads)          ......   " GREEN "PASS" RESET "\n");
+	} else {
+		printf("TEST ts_read_mt (threads)          ......   " RED "FAIL" RESET "\n");
+	}
+
 	ret = ts_load_module_4_inv(data);
 	if (ret == 0) {
 		printf("TEST ts_load_module (4)            ......   " RED "FAIL" RESET "\n");